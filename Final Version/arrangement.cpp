@@ -0,0 +1,277 @@
+// arrangement.cpp
+// Road map expansion, validation and the text form of arrangement items.
+
+#include "arrangement.h"
+
+#include <charconv>
+
+using namespace std;
+
+namespace {
+
+string_view trim(string_view s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && (s[b] == ' ' || s[b] == '\t' || s[b] == '\r'))
+        ++b;
+    while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t' || s[e - 1] == '\r'))
+        --e;
+    return s.substr(b, e - b);
+}
+
+bool parseInt(string_view s, int& value)
+{
+    const char* end = s.data() + s.size();
+    auto result = from_chars(s.data(), end, value);
+    return !s.empty() && result.ec == errc() && result.ptr == end;
+}
+
+// Passes of the repeat that starts at index first: the count of the next
+// repeat end, or 1 if another repeat starts (or the list ends) before it.
+int groupPasses(const vector<ArrangementItem>& items, size_t first)
+{
+    for (size_t i = first; i < items.size(); ++i) {
+        if (items[i].type == ARRANGE_REPEAT_END)
+            return items[i].count;
+        if (items[i].type == ARRANGE_REPEAT_START)
+            return 1;
+    }
+    return 1;
+}
+
+bool playsOnPass(const ArrangementItem& item, int pass)
+{
+    return item.passes == 0 || (pass <= 16 && ((item.passes >> (pass - 1)) & 1));
+}
+
+struct Keyword {
+    const char* text;
+    ArrangementItemType type;
+};
+
+const Keyword KEYWORDS[] = {
+    {"|:", ARRANGE_REPEAT_START},
+    {"(D.C.)", ARRANGE_DA_CAPO},
+    {"(TO CODA)", ARRANGE_TO_CODA},
+    {"(CODA)", ARRANGE_CODA},
+    {"(FINE)", ARRANGE_FINE},
+};
+
+} // namespace
+
+vector<uint32_t> arrangementOrder(const Arrangement& arrangement, size_t sectionCount)
+{
+    vector<uint32_t> order;
+    const auto& items = arrangement.items;
+    if (items.empty()) {
+        for (size_t s = 0; s < sectionCount; ++s)
+            order.push_back(static_cast<uint32_t>(s));
+        return order;
+    }
+
+    size_t repeatStart = 0;
+    int pass = 1;
+    bool afterDaCapo = false;
+    size_t i = 0;
+    while (i < items.size() && order.size() < MAX_ARRANGED_PARTS) {
+        const ArrangementItem& item = items[i];
+        switch (item.type) {
+            case ARRANGE_SECTION:
+                if (item.section < sectionCount && playsOnPass(item, pass)) {
+                    for (int n = 0; n < item.count; ++n)
+                        order.push_back(item.section);
+                }
+                ++i;
+                break;
+            case ARRANGE_REPEAT_START:
+                repeatStart = ++i;
+                pass = afterDaCapo ? groupPasses(items, i) : 1;
+                break;
+            case ARRANGE_REPEAT_END:
+                if (!afterDaCapo && pass < item.count) {
+                    ++pass;
+                    i = repeatStart;
+                } else {
+                    pass = 1;
+                    repeatStart = ++i;
+                }
+                break;
+            case ARRANGE_DA_CAPO:
+                if (afterDaCapo) {
+                    ++i;
+                    break;
+                }
+                afterDaCapo = true;
+                i = repeatStart = 0;
+                pass = groupPasses(items, 0);
+                break;
+            case ARRANGE_TO_CODA:
+                ++i;
+                if (afterDaCapo) {
+                    while (i < items.size() && items[i].type != ARRANGE_CODA)
+                        ++i;
+                }
+                break;
+            case ARRANGE_FINE:
+                if (afterDaCapo)
+                    return order;
+                ++i;
+                break;
+            default:
+                ++i;
+                break;
+        }
+    }
+    return order;
+}
+
+bool checkArrangement(const Arrangement& arrangement, size_t sectionCount, string& error)
+{
+    const auto& items = arrangement.items;
+    bool inRepeat = false;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const ArrangementItem& item = items[i];
+        string where = "arrangement item " + to_string(i + 1) + ": ";
+        switch (item.type) {
+            case ARRANGE_SECTION:
+                if (item.section >= sectionCount) {
+                    error = where + "no section " + to_string(item.section);
+                    return false;
+                }
+                if (item.count < 1) {
+                    error = where + "section played zero times";
+                    return false;
+                }
+                break;
+            case ARRANGE_REPEAT_START:
+                if (inRepeat) {
+                    error = where + "repeats cannot nest";
+                    return false;
+                }
+                inRepeat = true;
+                break;
+            case ARRANGE_REPEAT_END:
+                if (item.count < 2) {
+                    error = where + "a repeat plays at least twice";
+                    return false;
+                }
+                inRepeat = false;
+                break;
+            case ARRANGE_TO_CODA: {
+                size_t coda = i + 1;
+                while (coda < items.size() && items[coda].type != ARRANGE_CODA)
+                    ++coda;
+                if (coda == items.size()) {
+                    error = where + "(TO CODA) without a (CODA) after it";
+                    return false;
+                }
+                break;
+            }
+            case ARRANGE_DA_CAPO:
+            case ARRANGE_CODA:
+            case ARRANGE_FINE:
+                break;
+            default:
+                error = where + "unknown item type " + to_string(item.type);
+                return false;
+        }
+    }
+    return true;
+}
+
+bool parseArrangementLine(string_view line, ArrangementItem& item, string& sectionName, string& error)
+{
+    item = ArrangementItem();
+    sectionName.clear();
+    line = trim(line);
+    if (line.empty()) {
+        error = "empty arrangement item";
+        return false;
+    }
+    for (const Keyword& keyword : KEYWORDS) {
+        if (line == keyword.text) {
+            item.type = keyword.type;
+            return true;
+        }
+    }
+    if (line.compare(0, 2, ":|") == 0) {
+        item.type = ARRANGE_REPEAT_END;
+        item.count = 2;
+        string_view countField = trim(line.substr(2));
+        int count;
+        if (!countField.empty()) {
+            if (!parseInt(countField, count) || count < 2 || count > 255) {
+                error = "bad repeat count '" + string(countField) + "'";
+                return false;
+            }
+            item.count = static_cast<uint8_t>(count);
+        }
+        return true;
+    }
+
+    // Section reference: trailing "xN" and "@P,P" modifiers, the rest is the name.
+    item.type = ARRANGE_SECTION;
+    while (true) {
+        size_t space = line.find_last_of(" \t");
+        if (space == string_view::npos)
+            break;
+        string_view token = line.substr(space + 1);
+        int value;
+        if (token.size() > 1 && (token[0] == 'x' || token[0] == 'X') && parseInt(token.substr(1), value)) {
+            if (value < 1 || value > 255) {
+                error = "bad play count '" + string(token) + "'";
+                return false;
+            }
+            item.count = static_cast<uint8_t>(value);
+        } else if (token.size() > 1 && token[0] == '@') {
+            string_view list = token.substr(1);
+            while (!list.empty()) {
+                size_t comma = list.find(',');
+                string_view field = list.substr(0, comma);
+                list = comma == string_view::npos ? string_view() : list.substr(comma + 1);
+                if (!parseInt(field, value) || value < 1 || value > 16) {
+                    error = "bad ending pass '" + string(field) + "'";
+                    return false;
+                }
+                item.passes = static_cast<uint16_t>(item.passes | (1u << (value - 1)));
+            }
+        } else {
+            break;
+        }
+        line = trim(line.substr(0, space));
+    }
+    sectionName = string(line);
+    return true;
+}
+
+string formatArrangementItem(const ArrangementItem& item, const string& sectionName)
+{
+    switch (item.type) {
+        case ARRANGE_SECTION: {
+            string text = sectionName;
+            if (item.count != 1)
+                text += " x" + to_string(item.count);
+            if (item.passes) {
+                text += " @";
+                bool first = true;
+                for (int pass = 1; pass <= 16; ++pass) {
+                    if (!(item.passes & (1u << (pass - 1))))
+                        continue;
+                    if (!first)
+                        text += ',';
+                    text += to_string(pass);
+                    first = false;
+                }
+            }
+            return text;
+        }
+        case ARRANGE_REPEAT_END:
+            return ":| " + to_string(item.count);
+        default:
+            for (const Keyword& keyword : KEYWORDS) {
+                if (keyword.type == item.type)
+                    return keyword.text;
+            }
+            return string();
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef ARRANGEMENT_H
+#define ARRANGEMENT_H
+
+// Song form.
+// An arrangement is the song's road map: an ordered list of references to
+// sections plus the usual score navigation (repeat signs with first/second
+// endings, D.C., To Coda, Coda and Fine). Sections are stored once however
+// often they are played; arrangementOrder() walks the road map and yields
+// the section index of every pass, and the timeline compiler reads measures
+// straight from the shared sections in that order.
+//
+// Text form, one item per line:
+//   NAME [xN] [@P,P...]   play section NAME (N times; only on passes P of
+//                         the enclosing repeat, for first/second endings)
+//   |:                    start of a repeat
+//   :| [N]                end of a repeat, played N times in all (default 2);
+//                         without a |: it repeats from the beginning
+//   (D.C.)                back to the beginning, once
+//   (TO CODA)             after the D.C., jump to the coda from here
+//   (CODA)                the coda sign
+//   (FINE)                after the D.C., stop here
+// After a D.C. repeats are not taken and each repeat plays its last pass.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+enum ArrangementItemType : uint8_t {
+    ARRANGE_SECTION,
+    ARRANGE_REPEAT_START,
+    ARRANGE_REPEAT_END,
+    ARRANGE_DA_CAPO,
+    ARRANGE_TO_CODA,
+    ARRANGE_CODA,
+    ARRANGE_FINE
+};
+
+// One road map entry (8 bytes).
+struct ArrangementItem {
+    ArrangementItemType type = ARRANGE_SECTION;
+    uint8_t count = 1;      // SECTION: plays in a row; REPEAT_END: passes in all
+    uint16_t passes = 0;    // SECTION: bit n plays it on pass n + 1; 0 = every pass
+    uint32_t section = 0;   // SECTION: index into the song's sections
+};
+
+// Empty means every section once, in order.
+struct Arrangement {
+    vector<ArrangementItem> items;
+};
+
+// Upper bound on expanded passes, so a malformed road map cannot run away.
+const size_t MAX_ARRANGED_PARTS = 1 << 20;
+
+// Section index of every part in play order. Items that refer to sections
+// at or past sectionCount are skipped.
+vector<uint32_t> arrangementOrder(const Arrangement& arrangement, size_t sectionCount);
+
+// Checks section references and structure: item types are known, repeats do
+// not nest and every To Coda has a coda after it. Returns false and sets error.
+bool checkArrangement(const Arrangement& arrangement, size_t sectionCount, string& error);
+
+// Parses one line of the text form. For section items sectionName receives
+// the name to resolve; item.section is left for the caller to fill in.
+bool parseArrangementLine(string_view line, ArrangementItem& item, string& sectionName, string& error);
+
+// Text form of one item; sectionName is used for section items.
+string formatArrangementItem(const ArrangementItem& item, const string& sectionName);
+
+#endif // ARRANGEMENT_H
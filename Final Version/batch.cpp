@@ -0,0 +1,548 @@
+// batch.cpp
+// Headless command-line front end: loads, validates, transposes, relabels,
+// converts and renders song files without the interactive menu. Directories
+// are expanded to every song file inside them and the files are processed in
+// parallel on a work-stealing pool, so large batches are limited by cores,
+// not by prompts.
+//
+// Build (from this directory, no Windows headers needed):
+//   g++ -std=c++17 -O2 -o batch batch.cpp songio.cpp songbin.cpp midifile.cpp
+//       tempo.cpp arrangement.cpp note_arena.cpp chord.cpp timeline.cpp synth.cpp mixer.cpp oscillator.cpp
+//       soundfont.cpp voice_pool.cpp mapped_file.cpp thread_pool.cpp -pthread
+//
+// Usage:
+//   batch [options] <file or directory>...
+//     --transpose N     shift every non-drum note by N semitones (-127 to 127)
+//     --relabel         replace chord labels that are not chord symbols with
+//                       the chord each measure plays
+//     --midi            write <name>.mid
+//     --wav             render <name>.wav with the built-in synth
+//     --soundfont FILE  render --wav output with the samples of an .sf2 file
+//     --binary          write <name>.mmsb
+//     --text            write <name>.txt (song sheet)
+//     --out DIR         output directory (default: next to each input); files
+//                       found under a directory argument keep their relative path
+//     --threads N       worker threads (default: all cores; at most 4 per core)
+//     --recursive       descend into subdirectories
+//     --quiet           only print failures and the summary
+// With no output option the files are only loaded and validated. A file whose
+// output would overwrite an input or another file's output fails unprocessed.
+// Exit status is 1 if any file failed to load, validate or convert.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <vector>
+
+#include "chord.h"
+#include "midifile.h"
+#include "songbin.h"
+#include "songio.h"
+#include "soundfont.h"
+#include "synth.h"
+#include "thread_pool.h"
+#include "timeline.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+struct BatchOptions {
+    int transpose = 0;
+    bool relabel = false;
+    bool writeMidi = false;
+    bool writeWav = false;
+    bool writeBinary = false;
+    bool writeText = false;
+    bool recursive = false;
+    bool quiet = false;
+    unsigned threads = 0;
+    string outDir;
+    string soundFontPath;
+    const SoundFont* soundFont = nullptr;   // Opened from soundFontPath, shared by all workers
+};
+
+// An input file and the directory argument it was found under (if any).
+struct BatchFile {
+    fs::path path;
+    fs::path root;
+};
+
+// Outcome of one file; printed as soon as the file is done.
+struct FileResult {
+    bool ok = true;
+    size_t notes = 0;
+    vector<string> messages;
+};
+
+// ===== Song operations =====
+
+bool isSongFile(const fs::path& path)
+{
+    string ext = path.extension().string();
+    transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(tolower(c)); });
+    return ext == ".txt" || ext == ".mmsb" || ext == ".mid" || ext == ".midi";
+}
+
+// Loads any supported format. Returns false if the file could not be read or
+// had bad records; whatever did parse is still left in song.
+bool loadAnySong(const string& path, ParsedSong& song, vector<string>& messages)
+{
+    string error;
+    if (isBinarySongPath(path)) {
+        if (loadSongBinary(path, song, error))
+            return true;
+    } else if (isMidiFilePath(path)) {
+        if (importMidiFile(path, song, error))
+            return true;
+    } else {
+        vector<SongParseError> errors;
+        // One parser thread per file: the pool already keeps every core busy.
+        bool loaded = loadSongSheet(path, song, errors, 1);
+        for (const auto& e : errors)
+            messages.push_back("line " + to_string(e.line) + ": " + e.message);
+        if (loaded)
+            return errors.empty();
+        return false;
+    }
+    messages.push_back(error);
+    return false;
+}
+
+// Structural checks beyond what the parsers enforce.
+bool validateSong(const ParsedSong& song, vector<string>& messages)
+{
+    bool ok = true;
+    if (song.sections.empty()) {
+        messages.push_back("song has no sections");
+        return false;
+    }
+    for (const auto& section : song.sections) {
+        if (section.measures.empty())
+            messages.push_back("section " + section.name + " is empty");
+        for (const auto& measure : section.measures) {
+            if (measure.duration <= 0 && !measure.notes.empty()) {
+                messages.push_back("section " + section.name + ", measure " + to_string(measure.measureNumber) +
+                                   ": notes in a measure with no duration");
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+// Shifts pitched notes; drum notes select kit pieces and are left alone.
+// Returns the number of notes dropped for leaving the MIDI range; the rest of
+// a measure's range is compacted in place.
+size_t transposeSong(ParsedSong& song, int semitones)
+{
+    size_t dropped = 0;
+    PitchId* pitches = song.notes.pitch();
+    const uint8_t* channels = song.notes.channel();
+    for (auto& section : song.sections) {
+        for (auto& measure : section.measures) {
+            NoteRange& range = measure.notes;
+            uint32_t kept = range.first;
+            for (uint32_t row = range.first; row < range.end(); ++row) {
+                if (channels[row] != DRUM_CHANNEL) {
+                    int pitch = pitches[row] + semitones;
+                    if (pitch < 0 || pitch >= PITCH_COUNT)
+                        continue;
+                    pitches[row] = static_cast<PitchId>(pitch);
+                }
+                if (kept != row)
+                    song.notes.copyRow(row, kept);
+                ++kept;
+            }
+            dropped += range.end() - kept;
+            range.count = kept - range.first;
+        }
+    }
+    return dropped;
+}
+
+// What a song sheet written from song no longer holds, found by parsing the
+// sheet back: empty if it round-trips. The sheet writer groups a measure's
+// notes by channel and instrument, so notes are compared as sorted sets.
+vector<string> textSheetLosses(const ParsedSong& song, const string& sheet)
+{
+    ParsedSong reread;
+    vector<SongParseError> errors;
+    parseSongSheet(sheet, reread, errors, 1);
+
+    bool sections = reread.sections.size() != song.sections.size();
+    bool labels = false, pitches = false, velocities = false, lengths = false;
+    auto measureNotes = [](const NoteArena& notes, NoteRange range) {
+        vector<Note> rows;
+        for (uint32_t row = range.first; row < range.end(); ++row)
+            rows.push_back(notes.row(row));
+        sort(rows.begin(), rows.end(), [](const Note& a, const Note& b) {
+            return tie(a.channel, a.instrument, a.midiNote, a.onset, a.velocity, a.duration) <
+                   tie(b.channel, b.instrument, b.midiNote, b.onset, b.velocity, b.duration);
+        });
+        return rows;
+    };
+    for (size_t s = 0; !sections && s < song.sections.size(); ++s) {
+        const auto& before = song.sections[s];
+        const auto& after = reread.sections[s];
+        if (before.name != after.name || before.measures.size() != after.measures.size()) {
+            sections = true;
+            break;
+        }
+        for (size_t m = 0; m < before.measures.size(); ++m) {
+            const Measure& a = before.measures[m];
+            const Measure& b = after.measures[m];
+            if (a.chord != b.chord || a.measureNumber != b.measureNumber || a.duration != b.duration)
+                labels = true;
+            vector<Note> notesBefore = measureNotes(song.notes, a.notes);
+            vector<Note> notesAfter = measureNotes(reread.notes, b.notes);
+            if (notesBefore.size() != notesAfter.size()) {
+                pitches = true;
+                continue;
+            }
+            for (size_t i = 0; i < notesBefore.size(); ++i) {
+                const Note& x = notesBefore[i];
+                const Note& y = notesAfter[i];
+                pitches |= x.midiNote != y.midiNote || x.channel != y.channel || x.instrument != y.instrument;
+                velocities |= x.velocity != y.velocity;
+                lengths |= x.duration != y.duration || x.onset != y.onset;
+            }
+        }
+    }
+
+    vector<string> losses;
+    if (!errors.empty() || sections)
+        losses.push_back("sections");
+    if (labels)
+        losses.push_back("measure labels or lengths");
+    if (pitches)
+        losses.push_back("notes");
+    if (velocities)
+        losses.push_back("note velocities");
+    if (lengths)
+        losses.push_back("note timing");
+    if (reread.channelInstruments != song.channelInstruments)
+        losses.push_back("channel instruments");
+    auto sameTempo = [](const TempoChange& a, const TempoChange& b) {
+        return a.tick == b.tick && a.usPerQuarter == b.usPerQuarter;
+    };
+    auto sameSignature = [](const TimeSignatureChange& a, const TimeSignatureChange& b) {
+        return a.tick == b.tick && a.beats == b.beats && a.beatUnit == b.beatUnit;
+    };
+    if (!equal(song.tempo.tempos.begin(), song.tempo.tempos.end(), reread.tempo.tempos.begin(),
+               reread.tempo.tempos.end(), sameTempo) ||
+        !equal(song.tempo.timeSignatures.begin(), song.tempo.timeSignatures.end(),
+               reread.tempo.timeSignatures.begin(), reread.tempo.timeSignatures.end(), sameSignature))
+        losses.push_back("tempo track");
+    auto sameItem = [](const ArrangementItem& a, const ArrangementItem& b) {
+        return a.type == b.type && a.count == b.count && a.passes == b.passes && a.section == b.section;
+    };
+    if (!equal(song.arrangement.items.begin(), song.arrangement.items.end(), reread.arrangement.items.begin(),
+               reread.arrangement.items.end(), sameItem))
+        losses.push_back("arrangement");
+    return losses;
+}
+
+// ===== Output planning =====
+
+// Output path without extension: next to the input, or under --out with the
+// input's path relative to its directory argument kept.
+fs::path outputStem(const BatchFile& file, const BatchOptions& options)
+{
+    fs::path dir = file.path.parent_path();
+    if (!options.outDir.empty()) {
+        dir = options.outDir;
+        if (!file.root.empty())
+            dir /= file.path.parent_path().lexically_relative(file.root);
+    }
+    return (dir / file.path.stem()).lexically_normal();
+}
+
+// Extensions processFile writes for the chosen outputs.
+vector<const char*> outputExtensions(const BatchOptions& options)
+{
+    vector<const char*> extensions;
+    if (options.writeText) extensions.push_back(".txt");
+    if (options.writeBinary) extensions.push_back(".mmsb");
+    if (options.writeMidi) extensions.push_back(".mid");
+    if (options.writeWav) extensions.push_back(".wav");
+    return extensions;
+}
+
+// Absolute, normalized form of a path that may not exist yet, for comparing
+// planned outputs with inputs.
+fs::path normalizedPath(const fs::path& path)
+{
+    error_code ec;
+    fs::path normal = fs::weakly_canonical(path, ec);
+    if (ec)
+        normal = fs::absolute(path, ec).lexically_normal();
+    return normal;
+}
+
+// Fails every file whose output is another file's output or any file's
+// input. Workers write in parallel and read inputs through a memory map, so
+// either collision would race or truncate a mapped file under a reader.
+void rejectOutputCollisions(const vector<BatchFile>& files, const BatchOptions& options,
+                            vector<FileResult>& results)
+{
+    map<fs::path, size_t> inputs;
+    for (size_t i = 0; i < files.size(); ++i)
+        inputs.emplace(normalizedPath(files[i].path), i);
+    map<fs::path, size_t> writers;
+    for (size_t i = 0; i < files.size(); ++i) {
+        fs::path stem = outputStem(files[i], options);
+        for (const char* ext : outputExtensions(options)) {
+            fs::path path = stem;
+            path += ext;
+            fs::path key = normalizedPath(path);
+            auto input = inputs.find(key);
+            if (input != inputs.end()) {
+                results[i].ok = false;
+                if (input->second == i)
+                    results[i].messages.push_back(path.string() + " is the input file; use --out");
+                else
+                    results[i].messages.push_back(path.string() + " would overwrite input " +
+                                                  files[input->second].path.string() + "; use --out");
+                continue;
+            }
+            auto writer = writers.emplace(key, i).first;
+            if (writer->second != i) {
+                size_t other = writer->second;
+                results[i].ok = false;
+                results[i].messages.push_back(path.string() + " is also written for " + files[other].path.string());
+                results[other].ok = false;
+                results[other].messages.push_back(path.string() + " is also written for " + files[i].path.string());
+            }
+        }
+    }
+}
+
+// ===== Per-file job =====
+
+void processFile(const BatchFile& file, const BatchOptions& options, FileResult& result)
+{
+    const fs::path& input = file.path;
+    ParsedSong song;
+    if (!loadAnySong(input.string(), song, result.messages))
+        result.ok = false;
+    if (song.sections.empty()) {
+        result.ok = false;
+        return;
+    }
+    if (!validateSong(song, result.messages))
+        result.ok = false;
+    for (const auto& section : song.sections) {
+        for (const auto& measure : section.measures)
+            result.notes += measure.notes.count;
+    }
+
+    if (options.transpose != 0) {
+        size_t dropped = transposeSong(song, options.transpose);
+        if (dropped)
+            result.messages.push_back(to_string(dropped) + " notes transposed out of range and dropped");
+    }
+    if (options.relabel) {
+        size_t relabeled = relabelChords(song.sections, song.notes);
+        if (relabeled)
+            result.messages.push_back(to_string(relabeled) + " measures relabeled");
+    }
+
+    fs::path stem = outputStem(file, options);
+    if (!options.outDir.empty()) {
+        error_code ec;
+        fs::create_directories(stem.parent_path(), ec);
+    }
+    auto outputPath = [&stem](const char* ext) {
+        fs::path path = stem;
+        path += ext;
+        return path.string();
+    };
+
+    string error;
+    if (options.writeText) {
+        string path = outputPath(".txt");
+        ostringstream text;
+        writeSongSheet(text, song.sections, song.notes, song.tempo, song.arrangement);
+        string sheet = text.str();
+        ofstream out(path, ios::binary);
+        out.write(sheet.data(), sheet.size());
+        if (!out) {
+            result.messages.push_back("cannot write " + path);
+            result.ok = false;
+        }
+        // Binary and MIDI songs can hold what a sheet cannot; say what was lost.
+        if (isBinarySongPath(input.string()) || isMidiFilePath(input.string())) {
+            vector<string> losses = textSheetLosses(song, sheet);
+            if (!losses.empty()) {
+                string list;
+                for (const auto& loss : losses)
+                    list += (list.empty() ? "" : ", ") + loss;
+                result.messages.push_back("warning: " + path + " does not keep the source's " + list);
+            }
+        }
+    }
+    if (options.writeBinary) {
+        string path = outputPath(".mmsb");
+        if (!saveSongBinary(path, song.sections, song.notes, song.channelInstruments, song.tempo, song.arrangement, error)) {
+            result.messages.push_back(error);
+            result.ok = false;
+        }
+    }
+    if (options.writeMidi || options.writeWav) {
+        Timeline timeline = compileTimeline(song.sections, song.notes, song.tempo, song.arrangement);
+        if (options.writeMidi) {
+            string path = outputPath(".mid");
+            if (!exportMidiFile(song.sections, timeline, song.channelInstruments, path, error)) {
+                result.messages.push_back(error);
+                result.ok = false;
+            }
+        }
+        if (options.writeWav) {
+            string path = outputPath(".wav");
+            RenderSettings settings;
+            settings.soundFont = options.soundFont;
+            if (!renderTimelineToWavFile(timeline, path, settings)) {
+                result.messages.push_back("cannot write " + path);
+                result.ok = false;
+            }
+        }
+    }
+}
+
+// ===== Command line =====
+
+void printUsage()
+{
+    cerr << "usage: batch [--transpose N] [--relabel] [--midi] [--wav] [--soundfont FILE] [--binary] [--text]\n"
+            "             [--out DIR] [--threads N] [--recursive] [--quiet] <file or directory>...\n";
+}
+
+// Parses a whole argument as a decimal integer in [low, high].
+bool parseIntArgument(const char* text, int low, int high, int& value)
+{
+    const char* end = text + strlen(text);
+    auto result = from_chars(text, end, value);
+    return result.ec == errc() && result.ptr == end && end != text && value >= low && value <= high;
+}
+
+int main(int argc, char* argv[])
+{
+    // More workers than this only adds contention; each file is one job.
+    const int maxThreads = static_cast<int>(max(1u, thread::hardware_concurrency()) * 4);
+
+    BatchOptions options;
+    vector<fs::path> inputs;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        int value = 0;   // A rejected number falls through to the usage error below
+        if (arg == "--out" && hasValue) options.outDir = argv[++i];
+        else if (arg == "--soundfont" && hasValue) options.soundFontPath = argv[++i];
+        else if (arg == "--transpose" && hasValue && parseIntArgument(argv[++i], -127, 127, value))
+            options.transpose = value;
+        else if (arg == "--threads" && hasValue && parseIntArgument(argv[++i], 1, INT_MAX, value))
+            options.threads = static_cast<unsigned>(min(value, maxThreads));
+        else if (arg == "--relabel") options.relabel = true;
+        else if (arg == "--midi") options.writeMidi = true;
+        else if (arg == "--wav") options.writeWav = true;
+        else if (arg == "--binary") options.writeBinary = true;
+        else if (arg == "--text") options.writeText = true;
+        else if (arg == "--recursive") options.recursive = true;
+        else if (arg == "--quiet") options.quiet = true;
+        else if (arg.rfind("--", 0) == 0) {
+            printUsage();
+            return 2;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        printUsage();
+        return 2;
+    }
+    SoundFont soundFont;
+    if (!options.soundFontPath.empty()) {
+        string error;
+        if (!soundFont.open(options.soundFontPath, error)) {
+            cerr << error << "\n";
+            return 2;
+        }
+        options.soundFont = &soundFont;
+    }
+    // Expand directories; explicit file arguments are taken as given.
+    vector<BatchFile> files;
+    for (const auto& input : inputs) {
+        error_code ec;
+        if (fs::is_directory(input, ec)) {
+            auto collect = [&files, &input](const fs::directory_entry& entry) {
+                if (entry.is_regular_file() && isSongFile(entry.path()))
+                    files.push_back({entry.path(), input});
+            };
+            if (options.recursive) {
+                for (const auto& entry : fs::recursive_directory_iterator(input, ec))
+                    collect(entry);
+            } else {
+                for (const auto& entry : fs::directory_iterator(input, ec))
+                    collect(entry);
+            }
+        } else {
+            files.push_back({input, fs::path()});
+        }
+    }
+    sort(files.begin(), files.end(), [](const BatchFile& a, const BatchFile& b) { return a.path < b.path; });
+    // A file named twice (directly and through its directory) is processed once.
+    set<fs::path> seen;
+    files.erase(remove_if(files.begin(), files.end(),
+                          [&seen](const BatchFile& file) { return !seen.insert(normalizedPath(file.path)).second; }),
+                files.end());
+
+    vector<FileResult> results(files.size());
+    rejectOutputCollisions(files, options, results);
+    mutex printLock;
+    auto report = [&](size_t i) {
+        if (!options.quiet || !results[i].ok) {
+            lock_guard<mutex> guard(printLock);
+            cout << (results[i].ok ? "ok     " : "FAILED ") << files[i].path.string() << " ("
+                 << results[i].notes << " notes)\n";
+            for (const auto& message : results[i].messages)
+                cout << "       " << message << "\n";
+        }
+    };
+    auto start = chrono::steady_clock::now();
+    {
+        WorkStealingPool pool(options.threads);
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!results[i].ok) {
+                report(i);
+                continue;
+            }
+            pool.submit([&, i] {
+                try {
+                    processFile(files[i], options, results[i]);
+                } catch (const exception& e) {
+                    results[i].ok = false;
+                    results[i].messages.push_back(string("internal error: ") + e.what());
+                }
+                report(i);
+            });
+        }
+        pool.wait();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t failed = count_if(results.begin(), results.end(), [](const FileResult& r) { return !r.ok; });
+    cout << files.size() << " files, " << failed << " failed, " << seconds << " s\n";
+    return failed ? 1 : 0;
+}
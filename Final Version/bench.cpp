@@ -0,0 +1,712 @@
+// bench.cpp
+// Benchmark suite for the portable parts of the composer: song sheet and
+// binary I/O, MIDI files, pitch, chord and section lookups, timeline compilation
+// and seeking, the tempo map, song form, edit history, playback scheduling,
+// the transport, oscillator kernels, mixing and offline rendering. Results
+// are printed as JSON so runs from different versions can be compared by a
+// script.
+//
+// Build (from this directory, no Windows headers needed):
+//   g++ -std=c++17 -O2 -o bench bench.cpp songio.cpp songbin.cpp midifile.cpp
+//       tempo.cpp arrangement.cpp note_arena.cpp chord.cpp timeline.cpp history.cpp section_registry.cpp
+//       synth.cpp mixer.cpp oscillator.cpp soundfont.cpp voice_pool.cpp scheduler.cpp transport.cpp output.cpp
+//       mapped_file.cpp -pthread
+//
+// Usage:
+//   bench [--channels N] [--measures N] [--notes N] [--repeat N]
+//         [--render-seconds N] [--seed N] [--soundfont FILE] [--out FILE]
+// --soundfont adds SoundFont open and render timings for that .sf2 file.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chord.h"
+#include "history.h"
+#include "midifile.h"
+#include "mixer.h"
+#include "oscillator.h"
+#include "output.h"
+#include "scheduler.h"
+#include "section_registry.h"
+#include "songbin.h"
+#include "songio.h"
+#include "soundfont.h"
+#include "synth.h"
+#include "timeline.h"
+#include "transport.h"
+
+using namespace std;
+
+// ===== Synthetic songs =====
+
+struct SyntheticSongSpec {
+    int channels = 4;
+    int measures = 2000;
+    int notesPerMeasure = 8;
+    int measuresPerSection = 32;
+    unsigned seed = 1;
+};
+
+// Builds a reproducible song: notes are spread across the channels, channel 9
+// (if used) plays drum keys, and each other channel keeps one instrument.
+// The note rows are appended to notes.
+vector<MusicSection> generateSyntheticSong(const SyntheticSongSpec& spec, NoteArena& notes)
+{
+    mt19937 rng(spec.seed);
+    uniform_int_distribution<int> pitch(48, 84), drum(35, 51), velocity(60, 120), length(1, 4);
+
+    vector<MusicSection> sections;
+    for (int m = 0; m < spec.measures; ++m) {
+        if (m % spec.measuresPerSection == 0) {
+            sections.emplace_back();
+            sections.back().name = "S" + to_string(sections.size());
+        }
+        MusicSection& section = sections.back();
+        Measure measure;
+        measure.measureNumber = static_cast<int>(section.measures.size()) + 1;
+        measure.chord = "CMAJ";
+        measure.section = section.name;
+        measure.duration = 250 * length(rng);
+        measure.notes.first = static_cast<uint32_t>(notes.size());
+        measure.notes.count = static_cast<uint32_t>(spec.notesPerMeasure);
+        for (int n = 0; n < spec.notesPerMeasure; ++n) {
+            Note note;
+            int channel = n % max(1, spec.channels);
+            note.channel = static_cast<uint8_t>(channel);
+            note.midiNote = static_cast<PitchId>(channel == DRUM_CHANNEL ? drum(rng) : pitch(rng));
+            note.instrument = static_cast<uint8_t>(channel == DRUM_CHANNEL ? 0 : (channel * 8) % 128);
+            note.velocity = static_cast<uint8_t>(velocity(rng));
+            note.duration = measure.duration;
+            notes.append(note);
+        }
+        section.measures.push_back(move(measure));
+    }
+    return sections;
+}
+
+// ===== Harness =====
+
+struct BenchResult {
+    string name;
+    double ms;       // Best time over all repeats
+    double value;    // Throughput (or the measurement itself, see unit)
+    string unit;
+};
+
+// Runs f repeat times and returns the fastest wall time in milliseconds.
+template <typename F>
+double bestOfMs(int repeat, F f)
+{
+    double best = 1e300;
+    for (int i = 0; i < max(1, repeat); ++i) {
+        auto start = chrono::steady_clock::now();
+        f();
+        best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+double perSecond(double items, double ms)
+{
+    return ms > 0 ? items / (ms / 1000.0) : 0;
+}
+
+string jsonEscape(const string& s)
+{
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+void writeJson(ostream& out, const SyntheticSongSpec& spec, size_t noteCount, int renderSeconds,
+               const vector<BenchResult>& results)
+{
+    out << "{\n  \"config\": {\"channels\": " << spec.channels << ", \"measures\": " << spec.measures
+        << ", \"notes_per_measure\": " << spec.notesPerMeasure << ", \"notes\": " << noteCount
+        << ", \"render_seconds\": " << renderSeconds << ", \"seed\": " << spec.seed << "},\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        char line[256];
+        snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"ms\": %.3f, \"value\": %.1f, \"unit\": \"%s\"}%s\n",
+                 jsonEscape(r.name).c_str(), r.ms, r.value, jsonEscape(r.unit).c_str(),
+                 i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+// ===== Benchmarks =====
+
+int main(int argc, char* argv[])
+{
+    SyntheticSongSpec spec;
+    int repeat = 3;
+    int renderSeconds = 30;
+    string outPath, soundFontPath;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "missing value for " << arg << "\n";
+            return 2;
+        }
+        string value = argv[++i];
+        if (arg == "--channels") spec.channels = clamp(stoi(value), 1, 16);
+        else if (arg == "--measures") spec.measures = max(1, stoi(value));
+        else if (arg == "--notes") spec.notesPerMeasure = max(0, stoi(value));
+        else if (arg == "--repeat") repeat = max(1, stoi(value));
+        else if (arg == "--render-seconds") renderSeconds = max(1, stoi(value));
+        else if (arg == "--seed") spec.seed = static_cast<unsigned>(stoul(value));
+        else if (arg == "--soundfont") soundFontPath = value;
+        else if (arg == "--out") outPath = value;
+        else {
+            cerr << "unknown option " << arg << "\n";
+            return 2;
+        }
+    }
+
+    NoteArena notes;
+    vector<MusicSection> song = generateSyntheticSong(spec, notes);
+    map<int, int> channelInstruments;
+    const size_t noteCount = notes.size();
+    for (size_t row = 0; row < noteCount; ++row)
+        channelInstruments[notes.channel()[row]] = notes.instrument()[row];
+
+    vector<BenchResult> results;
+    auto add = [&results](const string& name, double ms, double value, const string& unit) {
+        results.push_back({name, ms, value, unit});
+        cerr << name << ": " << ms << " ms\n";
+    };
+
+    const filesystem::path tmp = filesystem::temp_directory_path();
+    const string textPath = (tmp / "mm_bench.txt").string();
+    const string binaryPath = (tmp / "mm_bench.mmsb").string();
+    const string midiPath = (tmp / "mm_bench.mid").string();
+
+    // Song sheet text
+    string text;
+    double ms = bestOfMs(repeat, [&] {
+        ostringstream out;
+        writeSongSheet(out, song, notes);
+        text = out.str();
+    });
+    double mb = text.size() / 1e6;
+    add("save_text", ms, perSecond(mb, ms), "MB/s");
+
+    ms = bestOfMs(repeat, [&] {
+        ParsedSong parsed;
+        vector<SongParseError> errors;
+        parseSongSheet(text, parsed, errors, 1);
+    });
+    add("parse_text_1_thread", ms, perSecond(mb, ms), "MB/s");
+
+    ms = bestOfMs(repeat, [&] {
+        ParsedSong parsed;
+        vector<SongParseError> errors;
+        parseSongSheet(text, parsed, errors);
+    });
+    add("parse_text_all_threads", ms, perSecond(mb, ms), "MB/s");
+
+    ofstream(textPath, ios::binary).write(text.data(), text.size());
+    ms = bestOfMs(repeat, [&] {
+        ParsedSong parsed;
+        vector<SongParseError> errors;
+        loadSongSheet(textPath, parsed, errors);
+    });
+    add("load_text_file", ms, perSecond(mb, ms), "MB/s");
+
+    // Binary song
+    string error;
+    ms = bestOfMs(repeat, [&] {
+        saveSongBinary(binaryPath, song, notes, channelInstruments, TempoTrack(), Arrangement(), error);
+    });
+    add("save_binary", ms, perSecond(noteCount, ms), "notes/s");
+    ms = bestOfMs(repeat, [&] {
+        ParsedSong parsed;
+        loadSongBinary(binaryPath, parsed, error);
+    });
+    add("load_binary", ms, perSecond(noteCount, ms), "notes/s");
+    ms = bestOfMs(repeat, [&] {
+        BinarySongFile file;
+        file.open(binaryPath, error);
+    });
+    add("open_binary_toc", ms, perSecond(song.size(), ms), "sections/s");
+
+    // Pitch lookups
+    const int lookups = 1 << 20;
+    vector<string> names;
+    for (int p = 0; p < PITCH_COUNT; ++p)
+        names.emplace_back(pitchName(p));
+    volatile int sink = 0;
+    ms = bestOfMs(repeat, [&] {
+        int sum = 0;
+        for (int i = 0; i < lookups; ++i)
+            sum += parsePitch(names[i & (PITCH_COUNT - 1)]);
+        sink = sum;
+    });
+    add("parse_pitch", ms, perSecond(lookups, ms), "lookups/s");
+    ms = bestOfMs(repeat, [&] {
+        double sum = 0;
+        for (int i = 0; i < lookups; ++i)
+            sum += pitchFrequency(i & (PITCH_COUNT - 1)) + pitchName(i & (PITCH_COUNT - 1))[0];
+        sink = static_cast<int>(sum);
+    });
+    add("pitch_name_and_frequency", ms, perSecond(lookups, ms), "lookups/s");
+
+    // Chord symbols: parse and spell a chart cycling through every root and
+    // quality, with some slash basses and inversions.
+    {
+        const char* roots[] = {"C", "C#", "Db", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"};
+        vector<string> chart;
+        for (const char* root : roots) {
+            for (const auto& quality : CHORD_QUALITIES) {
+                chart.push_back(root + string(quality.suffix));
+                chart.push_back(root + string(quality.suffix) + "/E");
+                chart.push_back(root + string(quality.suffix) + "^1@3");
+            }
+        }
+        ms = bestOfMs(repeat, [&] {
+            int sum = 0;
+            Chord chord;
+            PitchId pitches[CHORD_MAX_NOTES];
+            for (int i = 0; i < lookups; ++i) {
+                if (parseChord(chart[i % chart.size()], chord))
+                    sum += chordPitches(chord, pitches);
+            }
+            sink = sum;
+        });
+        add("parse_chord_symbol", ms, perSecond(lookups, ms), "symbols/s");
+
+        // Recognition: table lookups over every pitch-class set and bass,
+        // then relabeling an unlabeled copy of the song (copy included).
+        ms = bestOfMs(repeat, [&] {
+            int sum = 0;
+            ChordMatch match;
+            for (int i = 0; i < lookups; ++i) {
+                if (recognizeChord(static_cast<uint16_t>(i & 0xFFF), i % 12, match))
+                    sum += match.root;
+            }
+            sink = sum;
+        });
+        add("recognize_chord", ms, perSecond(lookups, ms), "sets/s");
+        size_t measureCount = 0;
+        for (const auto& section : song)
+            measureCount += section.measures.size();
+        vector<MusicSection> unlabeled = song, relabeled;
+        for (auto& section : unlabeled) {
+            for (auto& measure : section.measures)
+                measure.chord.clear();
+        }
+        ms = bestOfMs(repeat, [&] {
+            relabeled = unlabeled;
+            relabelChords(relabeled, notes);
+        });
+        add("relabel_song_chords", ms, perSecond(measureCount, ms), "measures/s");
+    }
+
+    // Section lookup by name in a song of many stems: the registry's hash
+    // index versus the linear scan it replaced.
+    {
+        const int stems = 5000, stemLookups = 1 << 14;
+        vector<MusicSection> stemSections(stems);
+        for (int i = 0; i < stems; ++i)
+            stemSections[i].name = "STEM" + to_string(i);
+        SectionRegistry registry(stemSections);
+        ms = bestOfMs(repeat, [&] { registry.reindex(); });
+        add("section_registry_index", ms, perSecond(stems, ms), "sections/s");
+        ms = bestOfMs(repeat, [&] {
+            size_t sum = 0;
+            for (int i = 0; i < stemLookups; ++i)
+                sum += registry.find(stemSections[(i * 7919) % stems].name);
+            sink = static_cast<int>(sum);
+        });
+        add("section_registry_find", ms, perSecond(stemLookups, ms), "lookups/s");
+        ms = bestOfMs(repeat, [&] {
+            size_t sum = 0;
+            for (int i = 0; i < stemLookups; ++i) {
+                const string& name = stemSections[(i * 7919) % stems].name;
+                size_t s = 0;
+                while (s < stemSections.size() && stemSections[s].name != name)
+                    ++s;
+                sum += s;
+            }
+            sink = static_cast<int>(sum);
+        });
+        add("section_linear_find", ms, perSecond(stemLookups, ms), "lookups/s");
+    }
+
+    // Timeline
+    Timeline timeline;
+    ms = bestOfMs(repeat, [&] { timeline = compileTimeline(song, notes); });
+    add("compile_timeline", ms, perSecond(timeline.events.size(), ms), "events/s");
+
+    mt19937_64 rng(spec.seed);
+    uniform_int_distribution<int64_t> anyTime(0, max<int64_t>(0, timeline.lengthUs));
+    vector<int64_t> seekTimes(lookups);
+    for (auto& t : seekTimes)
+        t = anyTime(rng);
+    ms = bestOfMs(repeat, [&] {
+        size_t sum = 0;
+        for (int64_t t : seekTimes)
+            sum += findEventAt(timeline, t);
+        sink = static_cast<int>(sum);
+    });
+    add("find_event", ms, perSecond(lookups, ms), "lookups/s");
+    ms = bestOfMs(repeat, [&] {
+        size_t sum = 0;
+        for (int64_t t : seekTimes)
+            sum += findMeasureAt(timeline, t);
+        sink = static_cast<int>(sum);
+    });
+    add("find_measure", ms, perSecond(lookups, ms), "lookups/s");
+
+    // Full seek state (programs and held notes) at random times, and at the
+    // start of the last section, the "play from the last chorus" case.
+    const int seeks = 1 << 14;
+    TimelineSeek seekState;
+    ms = bestOfMs(repeat, [&] {
+        size_t sum = 0;
+        for (int i = 0; i < seeks; ++i) {
+            seekTimeline(timeline, seekTimes[i], seekState);
+            sum += seekState.event + seekState.held.size();
+        }
+        sink = static_cast<int>(sum);
+    });
+    add("seek_timeline", ms, perSecond(seeks, ms), "seeks/s");
+    if (timeline.partFirstMeasure.size() > 1) {
+        size_t lastSection = timeline.partFirstMeasure[timeline.partFirstMeasure.size() - 2];
+        int64_t lastSectionUs = lastSection < timeline.measures.size() ? timeline.measures[lastSection].startUs : 0;
+        ms = bestOfMs(repeat, [&] { seekTimeline(timeline, lastSectionUs, seekState); });
+        add("seek_last_section", ms, ms * 1000.0, "us");
+    }
+
+    // Tempo map: a change rebuilds the segment list (O(changes)); the notes
+    // keep their tick durations. Lookups are binary searches over segments.
+    TempoTrack tempoTrack;
+    const int tempoChanges = 1000;
+    for (int i = 0; i < tempoChanges; ++i)
+        tempoTrack.tempos.push_back({int64_t(i) * TICKS_PER_QUARTER * 16, 300000 + uint32_t(i % 7) * 50000});
+    TempoMap tempoMap;
+    ms = bestOfMs(repeat, [&] {
+        tempoTrack.tempos[tempoChanges / 2].usPerQuarter += 1;
+        tempoMap = TempoMap(tempoTrack);
+    });
+    add("tempo_map_build", ms, perSecond(tempoChanges, ms), "changes/s");
+    ms = bestOfMs(repeat, [&] {
+        int64_t sum = 0;
+        for (int i = 0; i < lookups; ++i)
+            sum += tempoMap.tickToUs(int64_t(i) * 31);
+        sink = static_cast<int>(sum);
+    });
+    add("tempo_tick_to_us", ms, perSecond(lookups, ms), "lookups/s");
+
+    // Note storage: a transpose pass over the arena's pitch and channel
+    // columns versus over a vector<Note> per measure (the layout the arena
+    // replaced), then releasing each. Both work on copies of the song.
+    {
+        NoteArena columns(notes);
+        vector<vector<Note>> perMeasure;
+        for (const auto& section : song) {
+            for (const auto& measure : section.measures) {
+                perMeasure.emplace_back();
+                for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row)
+                    perMeasure.back().push_back(notes.row(row));
+            }
+        }
+        ms = bestOfMs(repeat, [&] {
+            PitchId* pitches = columns.pitch();
+            const uint8_t* channels = columns.channel();
+            for (size_t row = 0; row < columns.size(); ++row) {
+                if (channels[row] != DRUM_CHANNEL)
+                    pitches[row] = static_cast<PitchId>(pitches[row] ^ 1);
+            }
+        });
+        add("transpose_note_columns", ms, perSecond(noteCount, ms), "notes/s");
+        ms = bestOfMs(repeat, [&] {
+            for (auto& measureNotes : perMeasure) {
+                for (auto& note : measureNotes) {
+                    if (note.channel != DRUM_CHANNEL)
+                        note.midiNote = static_cast<PitchId>(note.midiNote ^ 1);
+                }
+            }
+        });
+        add("transpose_note_vectors", ms, perSecond(noteCount, ms), "notes/s");
+        ms = bestOfMs(1, [&] { columns.clear(); });
+        add("release_note_arena", ms, perSecond(noteCount, ms), "notes/s");
+        ms = bestOfMs(1, [&] { vector<vector<Note>>().swap(perMeasure); });
+        add("release_note_vectors", ms, perSecond(noteCount, ms), "notes/s");
+    }
+
+    // Song form: the whole song repeated four times through an arrangement
+    // versus as four stored copies. Sheet size is reported in bytes.
+    {
+        const uint8_t passes = 4;
+        Arrangement form;
+        form.items.push_back({ARRANGE_REPEAT_START});
+        for (size_t s = 0; s < song.size(); ++s) {
+            ArrangementItem item;
+            item.section = static_cast<uint32_t>(s);
+            form.items.push_back(item);
+        }
+        form.items.push_back({ARRANGE_REPEAT_END, passes});
+        vector<MusicSection> copies;
+        copies.reserve(song.size() * passes);
+        for (int pass = 0; pass < passes; ++pass)
+            copies.insert(copies.end(), song.begin(), song.end());
+
+        ostringstream arranged, flat;
+        writeSongSheet(arranged, song, notes, TempoTrack(), form);
+        writeSongSheet(flat, copies, notes);
+        add("arranged_sheet_bytes", 0, arranged.str().size(), "bytes");
+        add("copied_sheet_bytes", 0, flat.str().size(), "bytes");
+
+        Timeline arrangedTimeline;
+        ms = bestOfMs(repeat, [&] { arrangedTimeline = compileTimeline(song, notes, TempoTrack(), form); });
+        add("compile_arranged_timeline", ms, perSecond(arrangedTimeline.events.size(), ms), "events/s");
+    }
+
+    // Edit history: append a measure and record it, 1000 times round the
+    // sections, then undo and redo every step. Versions share all untouched
+    // nodes, so each step costs the edit, not the song.
+    if (!song.empty() && !song.front().measures.empty()) {
+        vector<MusicSection> edited = song;
+        map<int, int> editedChannels = channelInstruments;
+        TempoTrack editedTempo;
+        Arrangement editedArrangement;
+        SongState state{edited, editedChannels, editedTempo, editedArrangement};
+        SongHistory history;
+        ms = bestOfMs(1, [&] { history.reset(state); });
+        add("history_reset", ms, perSecond(noteCount, ms), "notes/s");
+
+        const int edits = 1000;
+        const Measure extra = song.front().measures.front();
+        ms = bestOfMs(1, [&] {
+            for (int i = 0; i < edits; ++i) {
+                size_t s = i % edited.size();
+                edited[s].measures.push_back(extra);
+                history.commit("add measure", state, s, edited[s].measures.size() - 1);
+            }
+        });
+        add("history_commit", ms, ms * 1000.0 / edits, "us/edit");
+        ms = bestOfMs(1, [&] {
+            while (history.undo(state)) {
+            }
+        });
+        add("history_undo_all", ms, ms * 1000.0 / edits, "us/step");
+        ms = bestOfMs(1, [&] {
+            while (history.redo(state)) {
+            }
+        });
+        add("history_redo_all", ms, ms * 1000.0 / edits, "us/step");
+    }
+
+    // Silencing: a note-off for every note in the song (the old stop/pause path)
+    // versus only the notes an ActiveNotes bitmap saw start and not stop
+    struct CountingSink : EventSink {
+        size_t sent = 0;
+        void send(const MidiEvent&) override { ++sent; }
+    };
+    vector<MidiEvent> messages;
+    for (const auto& ev : timeline.events) {
+        if (ev.type == EVENT_NOTE_ON)
+            messages.push_back(noteOnEvent(ev.channel, ev.data1, ev.data2));
+        else if (ev.type == EVENT_NOTE_OFF)
+            messages.push_back(noteOffEvent(ev.channel, ev.data1));
+    }
+    // Stop mid-song, just after a measure's note-ons.
+    size_t cut = messages.size() / 2;
+    while (cut < messages.size() && (cut == 0 || (messages[cut - 1].status & 0xF0) != 0x90))
+        ++cut;
+    while (cut < messages.size() && (messages[cut].status & 0xF0) == 0x90)
+        ++cut;
+    ActiveNotes midSong;
+    ms = bestOfMs(repeat, [&] {
+        midSong.clear();
+        for (size_t i = 0; i < cut; ++i)
+            midSong.track(messages[i]);
+    });
+    add("active_notes_track", ms, perSecond(cut, ms), "events/s");
+    CountingSink counter;
+    ms = bestOfMs(repeat, [&] {
+        counter.sent = 0;
+        for (size_t row = 0; row < noteCount; ++row)
+            counter.send(noteOffEvent(notes.channel()[row], notes.pitch()[row]));
+    });
+    add("silence_every_song_note", ms, double(counter.sent), "messages");
+    ms = bestOfMs(repeat, [&] {
+        counter.sent = 0;
+        ActiveNotes sounding = midSong;
+        sounding.releaseAll(counter);
+    });
+    add("silence_active_notes", ms, double(counter.sent), "messages");
+
+    // Standard MIDI Files
+    ms = bestOfMs(repeat, [&] { exportMidiFile(song, timeline, channelInstruments, midiPath, error); });
+    add("export_midi", ms, perSecond(noteCount, ms), "notes/s");
+    ms = bestOfMs(repeat, [&] {
+        ParsedSong parsed;
+        importMidiFile(midiPath, parsed, error);
+    });
+    add("import_midi", ms, perSecond(noteCount, ms), "notes/s");
+
+    // Oscillators: voices one core can keep running in real time, per kernel level
+    const SimdLevel bestLevel = detectSimdLevel();
+    for (int level = SIMD_SCALAR; level <= bestLevel; ++level) {
+        setSimdLevel(static_cast<SimdLevel>(level));
+        const int voiceCount = 256, block = 256, sampleRate = 44100;
+        vector<Oscillator> oscillators(voiceCount);
+        for (int v = 0; v < voiceCount; ++v)
+            setupOscillator(oscillators[v], static_cast<OscillatorShape>(v % 4),
+                            55.0 * pow(2.0, (v % 60) / 12.0), sampleRate);
+        const int blocks = sampleRate / block;
+        const double seconds = double(blocks) * block / sampleRate;
+        float buffer[block];
+        ms = bestOfMs(repeat, [&] {
+            float sum = 0;
+            for (int b = 0; b < blocks; ++b) {
+                for (auto& osc : oscillators) {
+                    renderOscillator(osc, buffer, block);
+                    sum += buffer[block - 1];
+                }
+            }
+            sink = static_cast<int>(sum);
+        });
+        add(string("oscillator_") + simdLevelName(static_cast<SimdLevel>(level)), ms,
+            perSecond(voiceCount * seconds, ms), "voices/core");
+    }
+    setSimdLevel(bestLevel);
+
+    // Mix bus: cost of summing N busy channels, per second of stereo output
+    for (int channelCount : {1, 4, 16}) {
+        MixBus bus;
+        const int blocks = 44100 / MIX_BLOCK_FRAMES;
+        float stereo[MIX_BLOCK_FRAMES * 2];
+        ms = bestOfMs(repeat, [&] {
+            float sum = 0;
+            for (int b = 0; b < blocks; ++b) {
+                for (int ch = 0; ch < channelCount; ++ch) {
+                    float* in = bus.channelBuffer(ch, MIX_BLOCK_FRAMES);
+                    for (int i = 0; i < MIX_BLOCK_FRAMES; ++i)
+                        in[i] += 0.001f * i;
+                }
+                bus.mix(stereo, MIX_BLOCK_FRAMES, 0.5f);
+                sum += stereo[1];
+            }
+            sink = static_cast<int>(sum);
+        });
+        add("mix_bus_" + to_string(channelCount) + "_channels", ms,
+            perSecond(double(blocks) * MIX_BLOCK_FRAMES / 44100, ms), "x realtime");
+    }
+
+    // Offline render of whole measures covering the first renderSeconds
+    vector<MusicSection> opening;
+    int64_t openingMs = 0;
+    for (const auto& section : song) {
+        if (openingMs >= int64_t(renderSeconds) * 1000)
+            break;
+        opening.push_back({section.name, {}});
+        for (const auto& measure : section.measures) {
+            if (openingMs >= int64_t(renderSeconds) * 1000)
+                break;
+            opening.back().measures.push_back(measure);
+            openingMs += measure.duration;
+        }
+    }
+    Timeline excerpt = compileTimeline(opening, notes);
+    RenderSettings settings;
+    int64_t frames = 0;
+    ms = bestOfMs(repeat, [&] { frames = renderTimeline(excerpt, settings, [](const float*, int) {}); });
+    add("render", ms, perSecond(double(frames) / settings.sampleRate, ms), "x realtime");
+
+    if (!soundFontPath.empty()) {
+        SoundFont font;
+        ms = bestOfMs(repeat, [&] {
+            if (!font.open(soundFontPath, error))
+                cerr << error << "\n";
+        });
+        add("open_soundfont", ms, perSecond(font.presets().size(), ms), "presets/s");
+        settings.soundFont = &font;
+        ms = bestOfMs(repeat, [&] { frames = renderTimeline(excerpt, settings, [](const float*, int) {}); });
+        add("render_soundfont", ms, perSecond(double(frames) / settings.sampleRate, ms), "x realtime");
+        settings.soundFont = nullptr;
+    }
+
+    // Scheduler: lateness of a train of 2 ms deadlines
+    const int ticks = 250;
+    double totalLate = 0, maxLate = 0;
+    ms = bestOfMs(1, [&] {
+        PlaybackClock clock;
+        clock.start();
+        for (int i = 1; i <= ticks; ++i) {
+            auto deadline = clock.deadline(int64_t(i) * 2000);
+            sleepUntil(deadline, chrono::microseconds(20000), [] { return false; });
+            double late = chrono::duration<double, micro>(PlaybackClockType::now() - deadline).count();
+            totalLate += late;
+            maxLate = max(maxLate, late);
+        }
+    });
+    add("scheduler_late_mean", ms, totalLate / ticks, "us");
+    add("scheduler_late_max", ms, maxLate, "us");
+
+    // Transport: delay from a pause command to the published paused state
+    {
+        NullSink sink;
+        Transport transport(sink, nullptr);
+        transport.play(excerpt, 0, excerpt.events.size());
+        while (transport.state() != TRANSPORT_PLAYING)
+            this_thread::yield();
+        const int pauses = 40;
+        int measured = 0;
+        double totalDelay = 0, maxDelay = 0;
+        ms = bestOfMs(1, [&] {
+            for (int i = 0; i < pauses && transport.state() == TRANSPORT_PLAYING; ++i) {
+                this_thread::sleep_for(chrono::microseconds(1000 + (i * 677) % 9000));
+                auto sent = PlaybackClockType::now();
+                transport.pause();
+                while (transport.state() == TRANSPORT_PLAYING)
+                    this_thread::yield();
+                if (transport.state() != TRANSPORT_PAUSED)
+                    break;   // Reached the end of the excerpt
+                ++measured;
+                double delay = chrono::duration<double, micro>(PlaybackClockType::now() - sent).count();
+                totalDelay += delay;
+                maxDelay = max(maxDelay, delay);
+                transport.resume();
+                while (transport.state() == TRANSPORT_PAUSED)
+                    this_thread::yield();
+            }
+        });
+        add("transport_pause_delay_mean", ms, measured ? totalDelay / measured : 0, "us");
+        add("transport_pause_delay_max", ms, maxDelay, "us");
+    }
+
+    remove(textPath.c_str());
+    remove(binaryPath.c_str());
+    remove(midiPath.c_str());
+
+    if (outPath.empty()) {
+        writeJson(cout, spec, noteCount, renderSeconds, results);
+    } else {
+        ofstream out(outPath);
+        if (!out) {
+            cerr << "cannot write " << outPath << "\n";
+            return 1;
+        }
+        writeJson(out, spec, noteCount, renderSeconds, results);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+// chord.cpp
+// Chord names for measures.
+
+#include "chord.h"
+
+#include <algorithm>
+
+using namespace std;
+
+bool recognizeMeasureChord(const Measure& measure, const NoteArena& notes, ChordMatch& match)
+{
+    const PitchId* pitches = notes.pitch();
+    const uint8_t* channels = notes.channel();
+    uint16_t pitchClasses = 0;
+    int bass = PITCH_COUNT;
+    for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row) {
+        if (channels[row] == DRUM_CHANNEL)
+            continue;
+        pitchClasses |= static_cast<uint16_t>(1 << (pitches[row] % 12));
+        bass = min<int>(bass, pitches[row]);
+    }
+    return pitchClasses && recognizeChord(pitchClasses, bass, match);
+}
+
+string measureChordName(const Measure& measure, const NoteArena& notes)
+{
+    ChordMatch match;
+    if (!recognizeMeasureChord(measure, notes, match))
+        return string();
+    char name[16];
+    return string(name, formatChord(match, name));
+}
+
+size_t relabelChords(vector<MusicSection>& sections, const NoteArena& notes)
+{
+    size_t relabeled = 0;
+    Chord chord;
+    for (auto& section : sections) {
+        for (auto& measure : section.measures) {
+            if (parseChord(measure.chord, chord))
+                continue;
+            string name = measureChordName(measure, notes);
+            if (!name.empty()) {
+                measure.chord = move(name);
+                ++relabeled;
+            }
+        }
+    }
+    return relabeled;
+}
@@ -0,0 +1,511 @@
+#pragma once
+#ifndef CHORD_H
+#define CHORD_H
+
+// Chord symbols.
+// A symbol is parsed from left to right against constexpr interval tables,
+// so resolving one neither allocates nor touches a map:
+//
+//   root        C D E F G A B, optionally followed by # or b (Eb, F#, BB)
+//   triad       MAJ or M (major), MIN, m or - (minor), DIM or o, AUG or +;
+//               none means major
+//   extension   5 (power chord), 6, 69, 7, 9, 11, 13; MAJ before it (CMAJ7,
+//               CMINMAJ7) makes the seventh major
+//   modifiers   SUS2 SUS4 SUS, B5 #5, B9 #9 #11 B13, ADD2 ADD4 ADD6 ADD9
+//               ADD11 ADD13, in any order, parentheses ignored (C7(#9))
+//   /bass       slash bass; a chord tone inverts the chord onto it, any
+//               other note is added below
+//   ^N          Nth inversion (the N lowest tones move up an octave)
+//   @N          octave the root sits in, -1 to 9 (default 4)
+//
+// Words are matched case-insensitively, except that a lone m means minor
+// and a lone M major. Examples: CMAJ7, EbMIN7, F#DIM, Bbm7b5, G7(b9)/B,
+// AMIN^1@3.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "note_arena.h"
+#include "pitch.h"
+#include "song.h"
+
+using namespace std;
+
+// At most one note per interval bit plus a slash bass.
+const int CHORD_MAX_NOTES = 25;
+
+// A parsed symbol. tones: bit i set = a chord tone i semitones above the
+// root (0-23).
+struct Chord {
+    uint8_t root = 0;         // Pitch class, C = 0
+    int8_t bass = -1;         // Pitch class of the slash bass, -1 = none
+    uint32_t tones = 0;
+    uint8_t inversion = 0;
+    int8_t octave = 4;
+};
+
+constexpr uint32_t chordTone(int semitones)
+{
+    return uint32_t(1) << semitones;
+}
+
+// A word that changes the chord: clear the tones in remove, then set add.
+struct ChordWord {
+    string_view word;
+    uint32_t remove;
+    uint32_t add;
+};
+
+const uint32_t CHORD_THIRDS = chordTone(3) | chordTone(4);
+
+// Modifiers. A word that is a prefix of another comes after it.
+constexpr ChordWord CHORD_MODIFIERS[] = {
+    {"SUS2", CHORD_THIRDS, chordTone(2)},
+    {"SUS4", CHORD_THIRDS, chordTone(5)},
+    {"SUS", CHORD_THIRDS, chordTone(5)},
+    {"ADD2", 0, chordTone(2)},
+    {"ADD4", 0, chordTone(5)},
+    {"ADD6", 0, chordTone(9)},
+    {"ADD9", 0, chordTone(14)},
+    {"ADD11", 0, chordTone(17)},
+    {"ADD13", 0, chordTone(21)},
+    {"B5", chordTone(7), chordTone(6)},
+    {"#5", chordTone(7), chordTone(8)},
+    {"B9", chordTone(14), chordTone(13)},
+    {"#9", chordTone(14), chordTone(15)},
+    {"#11", chordTone(17), chordTone(18)},
+    {"B13", chordTone(21), chordTone(20)},
+};
+
+// Named chord qualities, for listing and naming chords. Every suffix
+// parses back to its tones.
+struct ChordQuality {
+    string_view suffix;
+    uint32_t tones;
+};
+
+constexpr ChordQuality CHORD_QUALITIES[] = {
+    {"MAJ", chordTone(0) | chordTone(4) | chordTone(7)},
+    {"MIN", chordTone(0) | chordTone(3) | chordTone(7)},
+    {"DIM", chordTone(0) | chordTone(3) | chordTone(6)},
+    {"AUG", chordTone(0) | chordTone(4) | chordTone(8)},
+    {"SUS2", chordTone(0) | chordTone(2) | chordTone(7)},
+    {"SUS4", chordTone(0) | chordTone(5) | chordTone(7)},
+    {"5", chordTone(0) | chordTone(7)},
+    {"6", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(9)},
+    {"MIN6", chordTone(0) | chordTone(3) | chordTone(7) | chordTone(9)},
+    {"7", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(10)},
+    {"MAJ7", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(11)},
+    {"MIN7", chordTone(0) | chordTone(3) | chordTone(7) | chordTone(10)},
+    {"MINMAJ7", chordTone(0) | chordTone(3) | chordTone(7) | chordTone(11)},
+    {"MIN7B5", chordTone(0) | chordTone(3) | chordTone(6) | chordTone(10)},
+    {"DIM7", chordTone(0) | chordTone(3) | chordTone(6) | chordTone(9)},
+    {"AUG7", chordTone(0) | chordTone(4) | chordTone(8) | chordTone(10)},
+    {"7SUS4", chordTone(0) | chordTone(5) | chordTone(7) | chordTone(10)},
+    {"ADD9", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(14)},
+    {"9", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(10) | chordTone(14)},
+    {"MAJ9", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(11) | chordTone(14)},
+    {"MIN9", chordTone(0) | chordTone(3) | chordTone(7) | chordTone(10) | chordTone(14)},
+    {"11", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(10) | chordTone(14) | chordTone(17)},
+    {"13", chordTone(0) | chordTone(4) | chordTone(7) | chordTone(10) | chordTone(14) | chordTone(21)},
+};
+
+// Number of tones in a tone mask.
+constexpr int chordToneCount(uint32_t tones)
+{
+    int count = 0;
+    for (; tones; tones &= tones - 1)
+        ++count;
+    return count;
+}
+
+constexpr char chordUpper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+// Consumes word at symbol[i] (case-insensitive) if it is there.
+constexpr bool chordWord(string_view symbol, size_t& i, string_view word)
+{
+    if (symbol.size() - i < word.size())
+        return false;
+    for (size_t k = 0; k < word.size(); ++k) {
+        if (chordUpper(symbol[i + k]) != word[k])
+            return false;
+    }
+    i += word.size();
+    return true;
+}
+
+// Letter and accidental at symbol[i]; returns the pitch class or -1.
+constexpr int chordPitchClass(string_view symbol, size_t& i)
+{
+    const int letterClasses[7] = {9, 11, 0, 2, 4, 5, 7};   // A B C D E F G
+    if (i >= symbol.size())
+        return -1;
+    char letter = chordUpper(symbol[i]);
+    if (letter < 'A' || letter > 'G')
+        return -1;
+    int pitchClass = letterClasses[letter - 'A'];
+    ++i;
+    // No quality word starts with B, so a B right after the letter is a flat.
+    if (i < symbol.size() && symbol[i] == '#') {
+        ++pitchClass;
+        ++i;
+    } else if (i < symbol.size() && chordUpper(symbol[i]) == 'B') {
+        --pitchClass;
+        ++i;
+    }
+    return (pitchClass + 12) % 12;
+}
+
+// Reads an unsigned number of up to two digits at symbol[i]; -1 if none.
+constexpr int chordNumber(string_view symbol, size_t& i)
+{
+    int value = -1;
+    for (int digits = 0; digits < 2 && i < symbol.size() && symbol[i] >= '0' && symbol[i] <= '9'; ++digits)
+        value = (value < 0 ? 0 : value * 10) + (symbol[i++] - '0');
+    return value;
+}
+
+// Parses a chord symbol. Returns false for anything that is not one (free
+// text labels such as "RAND3" included).
+constexpr bool parseChord(string_view symbol, Chord& chord)
+{
+    chord = Chord();
+    size_t i = 0;
+    int root = chordPitchClass(symbol, i);
+    if (root < 0)
+        return false;
+    chord.root = static_cast<uint8_t>(root);
+
+    // Triad. The seventh is major after MAJ/M, diminished in a DIM chord.
+    const uint32_t triad = chordTone(0) | chordTone(7);
+    uint32_t tones = triad | chordTone(4);
+    int seventh = 10;
+    bool named = true;
+    if (chordWord(symbol, i, "MAJ")) {
+        seventh = 11;
+    } else if (chordWord(symbol, i, "MIN")) {
+        tones = triad | chordTone(3);
+    } else if (chordWord(symbol, i, "DIM")) {
+        tones = chordTone(0) | chordTone(3) | chordTone(6);
+        seventh = 9;
+    } else if (chordWord(symbol, i, "AUG")) {
+        tones = chordTone(0) | chordTone(4) | chordTone(8);
+    } else if (i < symbol.size() && (symbol[i] == 'm' || symbol[i] == '-')) {
+        tones = triad | chordTone(3);
+        ++i;
+    } else if (i < symbol.size() && symbol[i] == 'M') {
+        seventh = 11;
+        ++i;
+    } else if (i < symbol.size() && symbol[i] == 'o') {
+        tones = chordTone(0) | chordTone(3) | chordTone(6);
+        seventh = 9;
+        ++i;
+    } else if (i < symbol.size() && symbol[i] == '+') {
+        tones = chordTone(0) | chordTone(4) | chordTone(8);
+        ++i;
+    } else {
+        named = false;
+    }
+    // Minor-major seventh: CMINMAJ7, CmM7.
+    if (seventh == 10 && (tones & chordTone(3)) && (chordWord(symbol, i, "MAJ") || chordWord(symbol, i, "M")))
+        seventh = 11;
+
+    int extension = chordNumber(symbol, i);
+    switch (extension) {
+    case -1:
+        break;
+    case 5:
+        if (named)
+            return false;
+        tones = triad;
+        break;
+    case 6:
+        tones |= chordTone(9);
+        break;
+    case 69:
+        tones |= chordTone(9) | chordTone(14);
+        break;
+    case 7:
+        tones |= chordTone(seventh);
+        break;
+    case 9:
+        tones |= chordTone(seventh) | chordTone(14);
+        break;
+    case 11:
+        tones |= chordTone(seventh) | chordTone(14) | chordTone(17);
+        break;
+    case 13:
+        tones |= chordTone(seventh) | chordTone(14) | chordTone(21);
+        break;
+    default:
+        return false;
+    }
+
+    bool inverted = false;
+    while (i < symbol.size()) {
+        char c = symbol[i];
+        if (c == '(' || c == ')') {
+            ++i;
+            continue;
+        }
+        if (c == '/') {
+            ++i;
+            int bass = chordPitchClass(symbol, i);
+            if (bass < 0 || chord.bass >= 0)
+                return false;
+            chord.bass = static_cast<int8_t>(bass);
+            continue;
+        }
+        if (c == '^') {
+            ++i;
+            int inversion = chordNumber(symbol, i);
+            if (inversion < 0 || inverted)
+                return false;
+            chord.inversion = static_cast<uint8_t>(inversion);
+            inverted = true;
+            continue;
+        }
+        if (c == '@') {
+            ++i;
+            bool negative = i < symbol.size() && symbol[i] == '-';
+            if (negative)
+                ++i;
+            int octave = chordNumber(symbol, i);
+            if (octave < 0 || octave > 9 || (negative && octave != 1))
+                return false;
+            chord.octave = static_cast<int8_t>(negative ? -octave : octave);
+            continue;
+        }
+        bool matched = false;
+        for (const ChordWord& modifier : CHORD_MODIFIERS) {
+            if (chordWord(symbol, i, modifier.word)) {
+                tones = (tones & ~modifier.remove) | modifier.add;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched)
+            return false;
+    }
+
+    // A slash bass on a chord tone already picks the inversion.
+    if (chord.inversion >= chordToneCount(tones) || (inverted && chord.bass >= 0))
+        return false;
+    chord.tones = tones;
+    return true;
+}
+
+// Spells a chord as MIDI pitches, lowest first, in close position from the
+// root's octave. Returns the number of pitches written (at most
+// CHORD_MAX_NOTES), or 0 if any of them falls outside the MIDI range.
+constexpr int chordPitches(const Chord& chord, PitchId* pitches)
+{
+    int notes[CHORD_MAX_NOTES] = {};
+    int count = 0;
+    const int base = (chord.octave + 1) * 12 + chord.root;
+    for (int i = 0; i < 24; ++i) {
+        if (chord.tones & chordTone(i))
+            notes[count++] = base + i;
+    }
+
+    int inversion = chord.inversion;
+    bool bassBelow = false;
+    if (chord.bass >= 0) {
+        bassBelow = true;
+        for (int k = 0; k < count; ++k) {
+            if (notes[k] % 12 == chord.bass) {
+                inversion = k;
+                bassBelow = false;
+                break;
+            }
+        }
+    }
+    for (int k = 0; k < inversion; ++k)
+        notes[k] += 12;
+    // Extensions above the octave can now sit above raised tones: re-sort.
+    for (int k = 1; k < count; ++k) {
+        int note = notes[k], j = k;
+        for (; j > 0 && notes[j - 1] > note; --j)
+            notes[j] = notes[j - 1];
+        notes[j] = note;
+    }
+    if (bassBelow && count > 0) {
+        for (int k = count; k > 0; --k)
+            notes[k] = notes[k - 1];
+        notes[0] = notes[1] - ((notes[1] - chord.bass) % 12 + 12) % 12;
+        ++count;
+    }
+
+    for (int k = 0; k < count; ++k) {
+        if (notes[k] < 0 || notes[k] >= PITCH_COUNT)
+            return 0;
+        pitches[k] = static_cast<PitchId>(notes[k]);
+    }
+    return count;
+}
+
+// ===== Recognition =====
+// A set of sounding notes is reduced to its 12-bit pitch-class set (bit
+// pitch % 12) and named through two 4096-entry tables built at compile time
+// from CHORD_QUALITIES: one for sets read from a given root, one for any
+// set. Four-tone and larger chords also match with their fifth left out.
+// When two qualities spell the same set (C6 and AMIN7), the bass picks the
+// root, and otherwise the quality listed first wins.
+
+const uint8_t NO_CHORD_QUALITY = 0xFF;
+
+// Pitch-class set of a tone mask on a root.
+constexpr uint16_t chordPitchClasses(uint32_t tones, int root)
+{
+    uint16_t set = 0;
+    for (int i = 0; i < 24; ++i) {
+        if (tones & chordTone(i))
+            set |= static_cast<uint16_t>(1 << ((root + i) % 12));
+    }
+    return set;
+}
+
+struct ChordTable {
+    uint8_t quality[4096];      // Set read with bit 0 as the root -> quality index
+    uint8_t anyQuality[4096];   // Any set -> quality index,
+    uint8_t root[4096];         // read from this root
+};
+
+constexpr ChordTable buildChordTable()
+{
+    ChordTable table = {};
+    for (int set = 0; set < 4096; ++set)
+        table.quality[set] = table.anyQuality[set] = NO_CHORD_QUALITY;
+    const size_t qualityCount = sizeof(CHORD_QUALITIES) / sizeof(CHORD_QUALITIES[0]);
+    for (int omitFifth = 0; omitFifth < 2; ++omitFifth) {
+        for (size_t q = 0; q < qualityCount; ++q) {
+            uint32_t tones = CHORD_QUALITIES[q].tones;
+            if (omitFifth) {
+                if (!(tones & chordTone(7)) || chordToneCount(tones) < 4)
+                    continue;
+                tones &= ~chordTone(7);
+            }
+            for (int root = 0; root < 12; ++root) {
+                uint16_t set = chordPitchClasses(tones, root);
+                if (root == 0 && table.quality[set] == NO_CHORD_QUALITY)
+                    table.quality[set] = static_cast<uint8_t>(q);
+                if (table.anyQuality[set] == NO_CHORD_QUALITY) {
+                    table.anyQuality[set] = static_cast<uint8_t>(q);
+                    table.root[set] = static_cast<uint8_t>(root);
+                }
+            }
+        }
+    }
+    return table;
+}
+
+constexpr ChordTable CHORD_TABLE = buildChordTable();
+
+// A recognized chord: pitch classes of root and bass, index into
+// CHORD_QUALITIES, and which chord tone is in the bass (0 = root position).
+struct ChordMatch {
+    uint8_t root;
+    uint8_t quality;
+    uint8_t bass;
+    uint8_t inversion;
+};
+
+// Names a pitch-class set whose lowest note has pitch class bass. Returns
+// false if the set is no chord in CHORD_QUALITIES. O(1).
+constexpr bool recognizeChord(uint16_t pitchClasses, int bass, ChordMatch& match)
+{
+    pitchClasses &= 0xFFF;
+    bass %= 12;
+    const uint16_t fromBass = static_cast<uint16_t>(((pitchClasses >> bass) | (pitchClasses << (12 - bass))) & 0xFFF);
+    int root = bass, quality = CHORD_TABLE.quality[fromBass];
+    if (quality == NO_CHORD_QUALITY) {
+        quality = CHORD_TABLE.anyQuality[pitchClasses];
+        root = CHORD_TABLE.root[pitchClasses];
+        if (quality == NO_CHORD_QUALITY)
+            return false;
+    }
+    // Inversion: the bass's place among the tones in stacking order. Only
+    // tones that sound count, so an omitted fifth does not.
+    const uint32_t tones = CHORD_QUALITIES[quality].tones;
+    const int interval = (bass - root + 12) % 12;
+    int inversion = 0;
+    for (int i = 0; i < 24 && (i % 12) != interval; ++i) {
+        if ((tones & chordTone(i)) && (pitchClasses & (1 << ((root + i) % 12))))
+            ++inversion;
+    }
+    match = {static_cast<uint8_t>(root), static_cast<uint8_t>(quality), static_cast<uint8_t>(bass),
+             static_cast<uint8_t>(inversion)};
+    return true;
+}
+
+// Writes a symbol for match that parseChord() reads back, e.g. "EbMIN7" or
+// "CMAJ/E" for an inversion. Returns its length; out needs 16 bytes.
+constexpr size_t formatChord(const ChordMatch& match, char* out)
+{
+    const char* classNames[12] = {"C", "C#", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"};
+    size_t len = 0;
+    for (const char* c = classNames[match.root % 12]; *c; ++c)
+        out[len++] = *c;
+    for (char c : CHORD_QUALITIES[match.quality].suffix)
+        out[len++] = c;
+    if (match.inversion) {
+        out[len++] = '/';
+        for (const char* c = classNames[match.bass % 12]; *c; ++c)
+            out[len++] = *c;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Recognizes the chord a measure's pitched notes (drums excluded) sound,
+// with the lowest of them as the bass. One pass over its rows.
+bool recognizeMeasureChord(const Measure& measure, const NoteArena& notes, ChordMatch& match);
+
+// Symbol for the chord a measure sounds, or "" if it is none.
+string measureChordName(const Measure& measure, const NoteArena& notes);
+
+// Replaces every label that is not a chord symbol (e.g. "RAND3", or empty)
+// with the chord the measure sounds, where there is one. Returns the number
+// of measures relabeled.
+size_t relabelChords(vector<MusicSection>& sections, const NoteArena& notes);
+
+static_assert([] {
+    Chord c;
+    PitchId p[CHORD_MAX_NOTES] = {};
+    return parseChord("CMAJ7", c) && chordPitches(c, p) == 4 && p[0] == 60 && p[3] == 71 &&
+           parseChord("EbMIN7@3", c) && chordPitches(c, p) == 4 && p[0] == 51 && p[1] == 54 &&
+           parseChord("C/E", c) && chordPitches(c, p) == 3 && p[0] == 64 && p[2] == 72 &&
+           parseChord("F#DIM", c) && c.root == 6 && c.tones == (chordTone(0) | chordTone(3) | chordTone(6)) &&
+           !parseChord("RAND3", c) && !parseChord("CMAJ7^4", c);
+}(), "chord parser disagrees with the interval tables");
+
+static_assert([] {
+    for (const ChordQuality& quality : CHORD_QUALITIES) {
+        char symbol[16] = {'C'};
+        for (size_t k = 0; k < quality.suffix.size(); ++k)
+            symbol[k + 1] = quality.suffix[k];
+        Chord c;
+        if (!parseChord(string_view(symbol, quality.suffix.size() + 1), c) || c.tones != quality.tones)
+            return false;
+    }
+    return true;
+}(), "a chord quality does not parse back to its tones");
+
+static_assert([] {
+    ChordMatch m = {};
+    const uint16_t c6 = chordPitchClasses(CHORD_QUALITIES[7].tones, 0);   // C E G A
+    return recognizeChord(c6, 0, m) && m.root == 0 && CHORD_QUALITIES[m.quality].suffix == "6" &&
+           recognizeChord(c6, 9, m) && m.root == 9 && CHORD_QUALITIES[m.quality].suffix == "MIN7" &&
+           recognizeChord(chordPitchClasses(CHORD_QUALITIES[0].tones, 0), 4, m) && m.root == 0 && m.inversion == 1 &&
+           // C E Bb: a seventh chord without its fifth, seventh in the bass
+           recognizeChord(chordPitchClasses(chordTone(0) | chordTone(4) | chordTone(10), 0), 10, m) &&
+           m.root == 0 && CHORD_QUALITIES[m.quality].suffix == "7" && m.inversion == 2 &&
+           !recognizeChord(0x7, 0, m);
+}(), "chord recognition disagrees with the quality table");
+
+#endif // CHORD_H
@@ -0,0 +1,157 @@
+// history.cpp
+// Versions of the song as shared immutable nodes; undo/redo by patching the
+// live sections with the nodes that differ.
+
+#include "history.h"
+
+using namespace std;
+
+namespace {
+
+shared_ptr<const Measure> measureNode(const Measure& measure)
+{
+    return make_shared<const Measure>(measure);
+}
+
+bool sameTempo(const TempoTrack& a, const TempoTrack& b)
+{
+    return equal(a.tempos.begin(), a.tempos.end(), b.tempos.begin(), b.tempos.end(),
+                 [](const TempoChange& x, const TempoChange& y) {
+                     return x.tick == y.tick && x.usPerQuarter == y.usPerQuarter;
+                 }) &&
+           equal(a.timeSignatures.begin(), a.timeSignatures.end(), b.timeSignatures.begin(),
+                 b.timeSignatures.end(), [](const TimeSignatureChange& x, const TimeSignatureChange& y) {
+                     return x.tick == y.tick && x.beats == y.beats && x.beatUnit == y.beatUnit;
+                 });
+}
+
+bool sameArrangement(const Arrangement& a, const Arrangement& b)
+{
+    return equal(a.items.begin(), a.items.end(), b.items.begin(), b.items.end(),
+                 [](const ArrangementItem& x, const ArrangementItem& y) {
+                     return x.type == y.type && x.count == y.count && x.passes == y.passes &&
+                            x.section == y.section;
+                 });
+}
+
+} // namespace
+
+void SongHistory::reset(const SongState& song)
+{
+    versions.clear();
+    current = 0;
+    commitAll(string(), song);
+}
+
+void SongHistory::commit(const string& label, const SongState& song, size_t section, size_t firstMeasure)
+{
+    if (versions.empty()) {
+        commitAll(label, song);
+        return;
+    }
+    const vector<MusicSection>& sections = song.sections;
+    const size_t previousCount = versions[current].sections.size();
+    Version next = versions[current];
+    next.label = label;
+
+    // Sections added or dropped at the end.
+    next.sections.truncate(sections.size());
+    for (size_t s = previousCount; s < sections.size(); ++s)
+        next.sections.set(s, sectionNode(sections[s]));
+
+    // The edited section keeps its measures before firstMeasure.
+    if (section < sections.size() && section < previousCount) {
+        const vector<Measure>& measures = sections[section].measures;
+        auto node = make_shared<SectionNode>(*next.sections.at(section));
+        node->name = sections[section].name;
+        node->measures.truncate(min(firstMeasure, measures.size()));
+        for (size_t m = node->measures.size(); m < measures.size(); ++m)
+            node->measures.set(m, measureNode(measures[m]));
+        next.sections.set(section, move(node));
+    }
+
+    next.settings = settingsOf(song, next.settings);
+    append(move(next));
+}
+
+void SongHistory::commitAll(const string& label, const SongState& song)
+{
+    Version next;
+    next.label = label;
+    vector<shared_ptr<const SectionNode>> nodes;
+    nodes.reserve(song.sections.size());
+    for (const auto& section : song.sections)
+        nodes.push_back(sectionNode(section));
+    next.sections = SharedList<SectionNode>(nodes);
+    next.settings = settingsOf(song, nullptr);
+    append(move(next));
+}
+
+shared_ptr<const SongHistory::SectionNode> SongHistory::sectionNode(const MusicSection& section)
+{
+    auto node = make_shared<SectionNode>();
+    node->name = section.name;
+    vector<shared_ptr<const Measure>> measures;
+    measures.reserve(section.measures.size());
+    for (const auto& measure : section.measures)
+        measures.push_back(measureNode(measure));
+    node->measures = SharedList<Measure>(measures);
+    return node;
+}
+
+void SongHistory::append(Version version)
+{
+    if (!versions.empty())
+        versions.resize(current + 1);   // A new edit drops the redo list
+    versions.push_back(move(version));
+    current = versions.size() - 1;
+}
+
+shared_ptr<const SongHistory::Settings> SongHistory::settingsOf(const SongState& song,
+                                                                const shared_ptr<const Settings>& previous) const
+{
+    if (previous && previous->channelInstruments == song.channelInstruments &&
+        sameTempo(previous->tempo, song.tempo) && sameArrangement(previous->arrangement, song.arrangement))
+        return previous;
+    return make_shared<const Settings>(Settings{song.channelInstruments, song.tempo, song.arrangement});
+}
+
+bool SongHistory::undo(const SongState& song)
+{
+    if (!canUndo())
+        return false;
+    restore(current - 1, song);
+    return true;
+}
+
+bool SongHistory::redo(const SongState& song)
+{
+    if (!canRedo())
+        return false;
+    restore(current + 1, song);
+    return true;
+}
+
+void SongHistory::restore(size_t target, const SongState& song)
+{
+    const Version& from = versions[current];
+    const Version& to = versions[target];
+    const SharedList<Measure> none;
+
+    song.sections.resize(to.sections.size());
+    to.sections.forEachChanged(from.sections, [&](size_t s) {
+        const SectionNode& node = *to.sections.at(s);
+        MusicSection& live = song.sections[s];
+        live.name = node.name;
+        live.measures.resize(node.measures.size());
+        const SharedList<Measure>& before = s < from.sections.size() ? from.sections.at(s)->measures : none;
+        node.measures.forEachChanged(before, [&](size_t m) { live.measures[m] = *node.measures.at(m); });
+    });
+
+    if (to.settings != from.settings) {
+        song.channelInstruments = to.settings->channelInstruments;
+        song.tempo = to.settings->tempo;
+        song.arrangement = to.settings->arrangement;
+    }
+    current = target;
+}
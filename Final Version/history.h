@@ -0,0 +1,167 @@
+#pragma once
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// Undo/redo history.
+// Every committed edit becomes a version of the song built from immutable,
+// reference-counted nodes: a version lists its sections, a section node lists
+// its measures. A commit makes new nodes only for what the edit touched and
+// shares everything else with the previous version, so a snapshot costs
+// O(edit size) instead of a deep copy of the song. Lists are cut into chunks
+// of shared nodes, so changing one item of a long list copies one chunk plus
+// one chunk pointer per CHUNK items.
+//
+// The live song stays a plain vector<MusicSection> that the rest of the
+// program edits in place. Undo and redo compare the node pointers of two
+// versions and copy back only the measures that differ, so jumping between
+// versions touches the edit, not the song.
+//
+// Measures keep only ranges into the song's NoteArena, so the arena must not
+// drop or move rows while versions that index them are kept.
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "arrangement.h"
+#include "song.h"
+#include "tempo.h"
+
+using namespace std;
+
+// Persistent list: copying it copies chunk pointers only; set() and
+// truncate() copy the one chunk they change.
+template <typename T>
+class SharedList {
+public:
+    static const size_t CHUNK = 32;
+
+    SharedList() = default;
+    explicit SharedList(const vector<shared_ptr<const T>>& items)
+    {
+        for (size_t i = 0; i < items.size(); i += CHUNK) {
+            size_t end = min(items.size(), i + CHUNK);
+            chunks.push_back(make_shared<const Chunk>(items.begin() + i, items.begin() + end));
+        }
+        count = items.size();
+    }
+
+    size_t size() const { return count; }
+    const shared_ptr<const T>& at(size_t i) const { return (*chunks[i / CHUNK])[i % CHUNK]; }
+
+    // Replaces item i, or appends when i == size().
+    void set(size_t i, shared_ptr<const T> item)
+    {
+        size_t c = i / CHUNK;
+        Chunk chunk = c < chunks.size() ? *chunks[c] : Chunk();
+        if (i % CHUNK < chunk.size())
+            chunk[i % CHUNK] = move(item);
+        else
+            chunk.push_back(move(item));
+        if (c < chunks.size())
+            chunks[c] = make_shared<const Chunk>(move(chunk));
+        else
+            chunks.push_back(make_shared<const Chunk>(move(chunk)));
+        count = max(count, i + 1);
+    }
+
+    // Drops items from n on (n <= size()).
+    void truncate(size_t n)
+    {
+        if (n >= count)
+            return;
+        chunks.resize((n + CHUNK - 1) / CHUNK);
+        if (n % CHUNK)
+            chunks.back() = make_shared<const Chunk>(chunks.back()->begin(), chunks.back()->begin() + n % CHUNK);
+        count = n;
+    }
+
+    // Calls f(i) for every index of this list whose node is not the one
+    // other holds there. Shared chunks are skipped whole.
+    template <typename F>
+    void forEachChanged(const SharedList& other, F f) const
+    {
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            if (c < other.chunks.size() && chunks[c] == other.chunks[c])
+                continue;
+            size_t first = c * CHUNK, last = min(count, first + CHUNK);
+            for (size_t i = first; i < last; ++i) {
+                if (i >= other.count || at(i) != other.at(i))
+                    f(i);
+            }
+        }
+    }
+
+private:
+    using Chunk = vector<shared_ptr<const T>>;
+    vector<shared_ptr<const Chunk>> chunks;
+    size_t count = 0;
+};
+
+// The editable parts of a song, by reference to where they live.
+struct SongState {
+    vector<MusicSection>& sections;
+    map<int, int>& channelInstruments;
+    TempoTrack& tempo;
+    Arrangement& arrangement;
+};
+
+class SongHistory {
+public:
+    // commit() without a section: only settings or trailing sections changed.
+    static const size_t NO_SECTION = SIZE_MAX;
+
+    // Forgets all versions; song becomes the only one.
+    void reset(const SongState& song);
+
+    // Records song as a new version after an edit and drops the redo list.
+    // Measures of section from firstMeasure on are taken from song; sections
+    // appended or removed at the end and changed channels, tempo or
+    // arrangement are picked up too. Everything else must be unchanged since
+    // the last commit, undo or redo.
+    void commit(const string& label, const SongState& song, size_t section = NO_SECTION,
+                size_t firstMeasure = 0);
+    // Records a version that may differ anywhere (a loaded file). O(song).
+    void commitAll(const string& label, const SongState& song);
+
+    bool canUndo() const { return current > 0; }
+    bool canRedo() const { return current + 1 < versions.size(); }
+    // Label of the edit that undo would revert / redo would repeat.
+    const string& undoLabel() const { return versions[current].label; }
+    const string& redoLabel() const { return versions[current + 1].label; }
+    size_t versionCount() const { return versions.size(); }
+
+    // Moves one version back or forward and patches song to match. Returns
+    // false if there is nothing to undo or redo.
+    bool undo(const SongState& song);
+    bool redo(const SongState& song);
+
+private:
+    struct SectionNode {
+        string name;
+        SharedList<Measure> measures;
+    };
+    struct Settings {
+        map<int, int> channelInstruments;
+        TempoTrack tempo;
+        Arrangement arrangement;
+    };
+    struct Version {
+        SharedList<SectionNode> sections;
+        shared_ptr<const Settings> settings;
+        string label;   // The edit that produced this version
+    };
+
+    static shared_ptr<const SectionNode> sectionNode(const MusicSection& section);
+    void append(Version version);
+    shared_ptr<const Settings> settingsOf(const SongState& song, const shared_ptr<const Settings>& previous) const;
+    void restore(size_t target, const SongState& song);
+
+    vector<Version> versions;
+    size_t current = 0;
+};
+
+#endif // HISTORY_H
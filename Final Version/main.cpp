@@ -4,6 +4,7 @@ using namespace std;
 
 int main() {
     initMIDI();
+    resetHistory();
     
     cout << "=== C++ Terminal Music Composer (Multi-Instrument) ===\n";
     cout << "Now with full multi-instrument support for orchestral arrangements!\n";
@@ -34,11 +35,18 @@ int main() {
             case 17: stopPlaybackCommand(); break;
             case 18: addMultiInstrumentMeasure(); break;
             case 19: showChannelStatus(); break;
-            case 20: setupChannelInstruments(); cout << "Channels reset to default\n"; break;
-            case 21: cout << "Goodbye!\n"; break;
+            case 20: resetChannelInstruments(); break;
+            case 21: renderSongToWav(); break;
+            case 22: exportSongToMidi(); break;
+            case 23: playFromMeasure(); break;
+            case 24: setSongTempo(); break;
+            case 25: editArrangement(); break;
+            case 26: undoEdit(); break;
+            case 27: redoEdit(); break;
+            case 28: cout << "Goodbye!\n"; break;
             default: cout << "Invalid choice!\n";
         }
-    } while (choice != 21);
+    } while (choice != 28);
     
     closeMIDI();
     return 0;
@@ -0,0 +1,153 @@
+// mapped_file.cpp
+// Platform-specific file mapping (Win32 file mappings or POSIX mmap).
+
+#include "mapped_file.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : bytes(nullptr), length(0), fileHandle(nullptr), mappingHandle(nullptr)
+{
+}
+
+bool MappedFile::open(const string& path, string& error, MappedAccess access)
+{
+    close();
+    DWORD hint = (access == ACCESS_RANDOM) ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | hint, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "cannot open " + path;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        error = "cannot stat " + path;
+        return false;
+    }
+    fileHandle = file;
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length == 0)
+        return true;   // Nothing to map; data() stays null
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        close();
+        error = "cannot map " + path;
+        return false;
+    }
+    mappingHandle = mapping;
+    bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (bytes == nullptr) {
+        close();
+        error = "cannot map " + path;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes)
+        UnmapViewOfFile(bytes);
+    if (mappingHandle)
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+    if (fileHandle)
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+    bytes = nullptr;
+    length = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+void MappedFile::prefetch(size_t offset, size_t count) const
+{
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+    if (!bytes || offset >= length)
+        return;
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<char*>(bytes + offset);
+    range.NumberOfBytes = min(count, length - offset);
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    (void)offset;
+    (void)count;
+#endif
+}
+
+#else
+
+MappedFile::MappedFile() : bytes(nullptr), length(0)
+{
+}
+
+bool MappedFile::open(const string& path, string& error, MappedAccess access)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        error = "cannot stat " + path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            error = "cannot map " + path + ": " + strerror(errno);
+            length = 0;
+            ::close(fd);
+            return false;
+        }
+        madvise(p, length, access == ACCESS_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(p);
+    }
+    ::close(fd);   // The mapping keeps the file referenced
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes)
+        munmap(const_cast<char*>(bytes), length);
+    bytes = nullptr;
+    length = 0;
+}
+
+void MappedFile::prefetch(size_t offset, size_t count) const
+{
+    if (!bytes || offset >= length)
+        return;
+    // madvise needs a page-aligned start.
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset - offset % page;
+    size_t end = offset + min(count, length - offset);
+    madvise(const_cast<char*>(bytes + start), end - start, MADV_WILLNEED);
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+// Read-only memory-mapped file.
+// Parsers work directly on the mapped bytes; pages are only read from disk
+// when they are touched.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// How the caller will read the mapping; tunes the OS read-ahead.
+enum MappedAccess { ACCESS_SEQUENTIAL, ACCESS_RANDOM };
+
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps path into memory. On failure returns false and sets error.
+    bool open(const string& path, string& error, MappedAccess access = ACCESS_SEQUENTIAL);
+    void close();
+
+    // Asks the OS to start reading [offset, offset + count) in the background,
+    // ahead of the first access. Only a hint; does nothing where unsupported.
+    void prefetch(size_t offset, size_t count) const;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    string_view view() const { return string_view(bytes, length); }
+
+private:
+    const char* bytes;
+    size_t length;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif // MAPPED_FILE_H
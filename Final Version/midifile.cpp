@@ -0,0 +1,549 @@
+// midifile.cpp
+// Standard MIDI File writer and importer.
+
+#include "midifile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "mapped_file.h"
+
+using namespace std;
+
+namespace {
+
+// Buffered writer for one MTrk chunk. The chunk length is patched in when the
+// track ends, so only one small buffer is ever held in memory.
+class TrackWriter {
+public:
+    explicit TrackWriter(ofstream& file) : file(file)
+    {
+        file.write("MTrk\0\0\0\0", 8);
+        lengthPos = file.tellp() - streamoff(4);
+    }
+
+    void midi(int64_t tick, uint8_t status, uint8_t data1, uint8_t data2)
+    {
+        delta(tick);
+        if (status != runningStatus) {
+            buffer += static_cast<char>(status);
+            runningStatus = status;
+        }
+        buffer += static_cast<char>(data1);
+        if ((status & 0xF0) != 0xC0 && (status & 0xF0) != 0xD0)
+            buffer += static_cast<char>(data2);
+        flushIfFull();
+    }
+
+    void meta(int64_t tick, uint8_t type, const string& data)
+    {
+        delta(tick);
+        buffer += '\xFF';
+        buffer += static_cast<char>(type);
+        varLen(data.size());
+        buffer += data;
+        runningStatus = 0;   // Meta events cancel running status
+        flushIfFull();
+    }
+
+    void end(int64_t tick)
+    {
+        meta(tick, 0x2F, string());
+        write();
+        streampos endPos = file.tellp();
+        file.seekp(lengthPos);
+        char length[4] = {char(written >> 24), char(written >> 16), char(written >> 8), char(written)};
+        file.write(length, 4);
+        file.seekp(endPos);
+    }
+
+private:
+    void varLen(uint64_t value)
+    {
+        char bytes[10];
+        int n = 0;
+        bytes[n++] = static_cast<char>(value & 0x7F);
+        while (value >>= 7)
+            bytes[n++] = static_cast<char>((value & 0x7F) | 0x80);
+        while (n > 0)
+            buffer += bytes[--n];
+    }
+
+    void delta(int64_t tick)
+    {
+        varLen(static_cast<uint64_t>(tick > lastTick ? tick - lastTick : 0));
+        if (tick > lastTick)
+            lastTick = tick;
+    }
+
+    void flushIfFull()
+    {
+        if (buffer.size() >= (1 << 16))
+            write();
+    }
+
+    void write()
+    {
+        file.write(buffer.data(), buffer.size());
+        written += static_cast<uint32_t>(buffer.size());
+        buffer.clear();
+    }
+
+    ofstream& file;
+    streampos lengthPos;
+    string buffer;
+    uint32_t written = 0;
+    int64_t lastTick = 0;
+    uint8_t runningStatus = 0;
+};
+
+// ===== Import =====
+
+const int BARS_PER_SECTION = 8;
+
+struct ImportedNote {
+    int64_t start, end;   // Ticks
+    uint32_t order;       // File order, to keep sorting stable across tracks
+    uint8_t channel, key, velocity;
+};
+
+struct ProgramChange {
+    int64_t tick;
+    uint32_t order;
+    uint8_t channel, program;
+};
+
+struct SectionMarker {
+    int64_t tick;
+    uint32_t order;
+    string name;
+};
+
+// Everything collected from the track chunks, still in ticks.
+struct MidiContents {
+    vector<ImportedNote> notes;
+    vector<ProgramChange> programs;
+    // Meta events in file order, so a stable sort by tick lets the later of
+    // two changes at one tick win, as in TempoMap.
+    TempoTrack tempo;
+    vector<SectionMarker> markers;
+    uint32_t order = 0;
+};
+
+uint32_t readBE(const unsigned char* p, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+bool readVarLen(const unsigned char*& p, const unsigned char* end, uint32_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (p >= end)
+            return false;
+        unsigned char b = *p++;
+        value = (value << 7) | (b & 0x7F);
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Reads one MTrk chunk body. A note-off closes the oldest open note-on of the
+// same channel and key within the track. open is indexed by channel * 128 + key.
+bool readTrack(const unsigned char* p, const unsigned char* end, MidiContents& out,
+               vector<vector<uint32_t>>& open, string& error)
+{
+    int64_t tick = 0;
+    uint8_t status = 0;
+    while (p < end) {
+        uint32_t delta;
+        if (!readVarLen(p, end, delta)) {
+            error = "truncated delta time";
+            return false;
+        }
+        tick += delta;
+        if (p >= end) {
+            error = "truncated event";
+            return false;
+        }
+
+        if (*p == 0xFF) {
+            if (end - p < 2) {
+                error = "truncated meta event";
+                return false;
+            }
+            uint8_t type = p[1];
+            p += 2;
+            uint32_t length;
+            if (!readVarLen(p, end, length) || length > static_cast<uint32_t>(end - p)) {
+                error = "truncated meta event";
+                return false;
+            }
+            if (type == 0x2F)
+                break;
+            if (type == 0x51 && length == 3)
+                out.tempo.tempos.push_back({tick, readBE(p, 3)});
+            else if (type == 0x06)
+                out.markers.push_back({tick, out.order++, string(reinterpret_cast<const char*>(p), length)});
+            else if (type == 0x58 && length >= 2)
+                out.tempo.timeSignatures.push_back(
+                    {tick, static_cast<uint8_t>(max(1, int(p[0]))), static_cast<uint8_t>(1 << min(6, int(p[1])))});
+            p += length;
+            continue;
+        }
+        if (*p == 0xF0 || *p == 0xF7) {
+            ++p;
+            uint32_t length;
+            if (!readVarLen(p, end, length) || length > static_cast<uint32_t>(end - p)) {
+                error = "truncated sysex event";
+                return false;
+            }
+            p += length;
+            continue;
+        }
+
+        if (*p & 0x80)
+            status = *p++;
+        else if (status == 0) {
+            error = "data byte without running status";
+            return false;
+        }
+        if (status >= 0xF0) {
+            error = "unexpected system message in track";
+            return false;
+        }
+        uint8_t kind = status >> 4, channel = status & 0x0F;
+        int dataBytes = (kind == 0xC || kind == 0xD) ? 1 : 2;
+        if (end - p < dataBytes) {
+            error = "truncated channel event";
+            return false;
+        }
+        uint8_t data1 = p[0] & 0x7F, data2 = dataBytes == 2 ? (p[1] & 0x7F) : 0;
+        p += dataBytes;
+
+        if (kind == 0x9 && data2 > 0) {
+            open[channel * 128 + data1].push_back(static_cast<uint32_t>(out.notes.size()));
+            out.notes.push_back({tick, -1, out.order++, channel, data1, data2});
+        } else if (kind == 0x8 || kind == 0x9) {
+            auto& pending = open[channel * 128 + data1];
+            if (!pending.empty()) {
+                out.notes[pending.front()].end = tick;
+                pending.erase(pending.begin());
+            }
+        } else if (kind == 0xC) {
+            out.programs.push_back({tick, out.order++, channel, data1});
+        }
+    }
+
+    // Notes still held when the track ends stop there.
+    for (auto& pending : open) {
+        for (uint32_t index : pending)
+            out.notes[index].end = tick;
+        pending.clear();
+    }
+    return true;
+}
+
+} // namespace
+
+bool exportMidiFile(const vector<MusicSection>& sections, const Timeline& timeline,
+                    const map<int, int>& channelInstruments, const string& path, string& error)
+{
+    ofstream file(path, ios::binary);
+    if (!file) {
+        error = "cannot write " + path;
+        return false;
+    }
+
+    bool used[16] = {};
+    for (const auto& event : timeline.events) {
+        if (event.type != EVENT_MEASURE_START)
+            used[event.channel] = true;
+    }
+    int trackCount = 1;
+    for (int channel = 0; channel < 16; ++channel)
+        trackCount += used[channel];
+
+    const char header[14] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, char(trackCount),
+                             char(SMF_TICKS_PER_QUARTER >> 8), char(SMF_TICKS_PER_QUARTER & 0xFF)};
+    file.write(header, sizeof(header));
+    // The file uses the song's tick resolution, so the song's tempo map turns
+    // event times back into the exact ticks they were compiled from.
+    const TempoMap& tempo = timeline.tempo;
+    int64_t endTick = tempo.usToTick(timeline.lengthUs);
+
+    // Conductor track: tempo and time signature changes, and a marker at the
+    // start of each part, merged into tick order.
+    {
+        struct Meta {
+            int64_t tick;
+            uint8_t type;
+            string data;
+        };
+        vector<Meta> metas;
+        for (const auto& change : tempo.tempos()) {
+            uint32_t us = change.usPerQuarter;
+            metas.push_back({change.tick, 0x51, string{char(us >> 16), char(us >> 8), char(us)}});
+        }
+        for (const auto& change : tempo.timeSignatures()) {
+            int unitPower = 0;
+            while ((2 << unitPower) <= change.beatUnit)
+                ++unitPower;
+            metas.push_back({change.tick, 0x58, string{char(change.beats), char(unitPower), 24, 8}});
+        }
+        for (size_t p = 0; p + 1 < timeline.partFirstMeasure.size(); ++p) {
+            size_t first = timeline.partFirstMeasure[p];
+            uint32_t s = timeline.partSections[p];
+            if (first < timeline.measures.size() && s < sections.size())
+                metas.push_back({tempo.usToTick(timeline.measures[first].startUs), 0x06, sections[s].name});
+        }
+        stable_sort(metas.begin(), metas.end(), [](const Meta& a, const Meta& b) { return a.tick < b.tick; });
+
+        TrackWriter track(file);
+        for (const auto& meta : metas)
+            track.meta(meta.tick, meta.type, meta.data);
+        track.end(endTick);
+    }
+
+    // One pass over the timeline per channel keeps each track's events in order.
+    for (int channel = 0; channel < 16; ++channel) {
+        if (!used[channel])
+            continue;
+        TrackWriter track(file);
+        int program = -1;
+        auto assigned = channelInstruments.find(channel);
+        if (assigned != channelInstruments.end()) {
+            program = assigned->second & 0x7F;
+            track.midi(0, static_cast<uint8_t>(0xC0 | channel), static_cast<uint8_t>(program), 0);
+        }
+        for (const auto& event : timeline.events) {
+            if (event.channel != channel || event.type == EVENT_MEASURE_START)
+                continue;
+            int64_t tick = tempo.usToTick(event.timeUs);
+            switch (event.type) {
+            case EVENT_PROGRAM_CHANGE:
+                if (event.data1 != program) {
+                    program = event.data1;
+                    track.midi(tick, static_cast<uint8_t>(0xC0 | channel), event.data1, 0);
+                }
+                break;
+            case EVENT_NOTE_ON:
+                track.midi(tick, static_cast<uint8_t>(0x90 | channel), event.data1, event.data2);
+                break;
+            case EVENT_NOTE_OFF:
+                track.midi(tick, static_cast<uint8_t>(0x90 | channel), event.data1, 0);
+                break;
+            }
+        }
+        track.end(endTick);
+    }
+
+    if (!file) {
+        error = "error writing " + path;
+        return false;
+    }
+    return true;
+}
+
+bool parseMidiFile(string_view data, ParsedSong& song, string& error)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* end = p + data.size();
+    if (data.size() < 14 || memcmp(p, "MThd", 4) != 0 || readBE(p + 4, 4) < 6) {
+        error = "not a Standard MIDI File";
+        return false;
+    }
+    uint32_t headerLength = readBE(p + 4, 4);
+    int format = readBE(p + 8, 2);
+    int trackCount = readBE(p + 10, 2);
+    int division = readBE(p + 12, 2);
+    if (format > 1) {
+        error = "MIDI format " + to_string(format) + " is not supported (only types 0 and 1)";
+        return false;
+    }
+    if (headerLength > data.size() - 8) {
+        error = "truncated MIDI header";
+        return false;
+    }
+    p += 8 + headerLength;
+
+    MidiContents contents;
+    vector<vector<uint32_t>> open(16 * 128);
+    for (int track = 0; track < trackCount && end - p >= 8; ) {
+        uint32_t length = readBE(p + 4, 4);
+        const unsigned char* body = p + 8;
+        // Tolerate a chunk length that overruns the file; read what is there.
+        const unsigned char* bodyEnd = length > static_cast<uint32_t>(end - body) ? end : body + length;
+        if (memcmp(p, "MTrk", 4) == 0) {
+            if (!readTrack(body, bodyEnd, contents, open, error)) {
+                error = "track " + to_string(track + 1) + ": " + error;
+                return false;
+            }
+            ++track;
+        }
+        p = bodyEnd;   // Unknown chunk types are skipped
+    }
+    if (contents.notes.empty()) {
+        error = "no notes found";
+        return false;
+    }
+
+    // Convert file ticks to song ticks. Metrical files keep their tempo map
+    // (rescaled to TICKS_PER_QUARTER); SMPTE-timed files have no tempo, so
+    // their absolute times become ticks at the default 120 bpm.
+    const bool smpte = (division & 0x8000) != 0;
+    int64_t fileTicksPerSecond = 0;
+    if (smpte)
+        fileTicksPerSecond = max(1, -static_cast<int8_t>(division >> 8) * (division & 0xFF));
+    const int64_t fileTicksPerQuarter = max(1, division);
+    auto toSongTick = [&](int64_t tick) {
+        if (smpte)
+            return (tick * 1000000 / fileTicksPerSecond + 500) / 1000;
+        return (tick * TICKS_PER_QUARTER + fileTicksPerQuarter / 2) / fileTicksPerQuarter;
+    };
+    song.tempo = TempoTrack();
+    if (!smpte) {
+        for (const auto& change : contents.tempo.tempos)
+            song.tempo.tempos.push_back({toSongTick(change.tick), change.usPerQuarter});
+    }
+    for (const auto& change : contents.tempo.timeSignatures)
+        song.tempo.timeSignatures.push_back({toSongTick(change.tick), change.beats, change.beatUnit});
+
+    auto byTime = [](const auto& a, const auto& b) { return a.tick != b.tick ? a.tick < b.tick : a.order < b.order; };
+    sort(contents.notes.begin(), contents.notes.end(), [](const ImportedNote& a, const ImportedNote& b) {
+        return a.start != b.start ? a.start < b.start : a.order < b.order;
+    });
+    sort(contents.programs.begin(), contents.programs.end(), byTime);
+    sort(contents.markers.begin(), contents.markers.end(), byTime);
+
+    int64_t songEndTick = 0;
+    for (const auto& note : contents.notes)
+        songEndTick = max(songEndTick, max(toSongTick(note.end), toSongTick(note.start) + 1));
+
+    const TempoMap songTempo(song.tempo);
+
+    // Section boundaries (song ticks) from markers, or every few bars of the
+    // opening time signature without them.
+    vector<pair<int64_t, string>> boundaries;
+    if (!contents.markers.empty()) {
+        for (const auto& marker : contents.markers) {
+            int64_t tick = toSongTick(marker.tick);
+            string name = marker.name.empty() ? "PART " + to_string(boundaries.size() + 1) : marker.name;
+            if (tick >= songEndTick)
+                break;
+            if (!boundaries.empty() && boundaries.back().first == tick)
+                continue;
+            boundaries.push_back({tick, name});
+        }
+        if (boundaries.empty() || boundaries[0].first > 0)
+            boundaries.insert(boundaries.begin(), {0, "PART 1"});
+    } else {
+        int64_t sectionTicks = max<int64_t>(1, songTempo.barTicks(songTempo.timeSignatureAt(0)) * BARS_PER_SECTION);
+        for (int64_t n = 0; ; ++n) {
+            int64_t tick = n * sectionTicks;
+            if (n > 0 && tick >= songEndTick)
+                break;
+            boundaries.push_back({tick, "PART " + to_string(n + 1)});
+        }
+    }
+
+    // Bar lines run from each time signature change; a change also ends the bar in progress.
+    auto nextBarLine = [&songTempo](int64_t tick) {
+        TimeSignatureChange signature = songTempo.timeSignatureAt(tick);
+        int64_t bar = max<int64_t>(1, songTempo.barTicks(signature));
+        int64_t next = signature.tick + ((tick - signature.tick) / bar + 1) * bar;
+        for (const auto& change : songTempo.timeSignatures()) {
+            if (change.tick > tick)
+                return min(next, change.tick);
+        }
+        return next;
+    };
+
+    int program[16] = {};
+    bool channelUsed[16] = {};
+    size_t nextProgram = 0;
+    size_t nextNote = 0;
+    const auto& notes = contents.notes;
+
+    song.sections.clear();
+    song.sections.reserve(boundaries.size());
+    song.notes.clear();
+    song.notes.reserve(notes.size());
+    for (size_t b = 0; b < boundaries.size(); ++b) {
+        int64_t sectionStart = boundaries[b].first;
+        int64_t sectionEnd = b + 1 < boundaries.size() ? boundaries[b + 1].first : songEndTick;
+        MusicSection section;
+        section.name = boundaries[b].second;
+
+        // One measure per bar; a section that starts or ends mid-bar gets a
+        // short first or last measure.
+        int64_t barStart = sectionStart;
+        while (barStart < sectionEnd) {
+            int64_t barEnd = min(sectionEnd, nextBarLine(barStart));
+            size_t first = nextNote;
+            while (nextNote < notes.size() && toSongTick(notes[nextNote].start) < barEnd)
+                ++nextNote;
+
+            Measure measure;
+            measure.measureNumber = static_cast<int>(section.measures.size()) + 1;
+            measure.section = section.name;
+            measure.duration = static_cast<int>(barEnd - barStart);
+            measure.notes.first = static_cast<uint32_t>(song.notes.size());
+            measure.notes.count = static_cast<uint32_t>(nextNote - first);
+            for (size_t i = first; i < nextNote; ++i) {
+                const ImportedNote& in = notes[i];
+                while (nextProgram < contents.programs.size() && contents.programs[nextProgram].tick <= in.start) {
+                    program[contents.programs[nextProgram].channel] = contents.programs[nextProgram].program;
+                    ++nextProgram;
+                }
+                Note n;
+                n.midiNote = static_cast<PitchId>(in.key);
+                n.channel = in.channel;
+                n.instrument = static_cast<uint8_t>(program[in.channel]);
+                n.velocity = in.velocity;
+                n.duration = static_cast<int>(max<int64_t>(1, toSongTick(in.end) - toSongTick(in.start)));
+                n.onset = static_cast<int>(toSongTick(in.start) - barStart);
+                song.notes.append(n);
+                channelUsed[in.channel] = true;
+            }
+            section.measures.push_back(move(measure));
+            barStart = barEnd;
+        }
+        song.sections.push_back(move(section));
+    }
+
+    // Like the text format, the last program seen on each channel wins.
+    for (const auto& change : contents.programs)
+        program[change.channel] = change.program;
+    song.channelInstruments.clear();
+    for (int channel = 0; channel < 16; ++channel) {
+        if (channelUsed[channel])
+            song.channelInstruments[channel] = program[channel];
+    }
+    return true;
+}
+
+bool importMidiFile(const string& path, ParsedSong& song, string& error)
+{
+    MappedFile file;
+    if (!file.open(path, error))
+        return false;
+    if (!parseMidiFile(file.view(), song, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool isMidiFilePath(const string& path)
+{
+    auto endsWith = [&path](const string& ext) {
+        return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    return endsWith(".mid") || endsWith(".midi");
+}
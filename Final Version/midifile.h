@@ -0,0 +1,44 @@
+#pragma once
+#ifndef MIDIFILE_H
+#define MIDIFILE_H
+
+// Standard MIDI File (.mid) support.
+// Export writes a Type-1 file: track 0 carries tempo, time signature and a
+// marker per section, then one track per used channel with its program
+// changes and notes. Deltas are variable-length and running status is used
+// throughout (note-offs are sent as velocity-0 note-ons so they share the
+// note-on status byte).
+//
+// Import reads Type 0 and Type 1 files from a mapped buffer. Each bar of the
+// time signature becomes a measure, and notes keep their onset within it and
+// their own sounding length; marker events split the song into sections,
+// otherwise a new section starts every 8 bars.
+// Portable: depends only on timeline.h, songio.h and the standard library.
+
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "songio.h"
+#include "timeline.h"
+
+// Exported files use the song's own tick resolution.
+const int SMF_TICKS_PER_QUARTER = TICKS_PER_QUARTER;
+
+// Writes the song as a Type-1 SMF, streaming each track to disk. timeline
+// must be compiled from sections; its tempo map supplies the tempo and time
+// signature changes, and channelInstruments each channel's program at tick 0. Returns false and sets error if the file cannot be written.
+bool exportMidiFile(const vector<MusicSection>& sections, const Timeline& timeline,
+                    const map<int, int>& channelInstruments, const string& path, string& error);
+
+// Converts SMF bytes into sections, channel programs and the tempo track. Returns false and
+// sets error if the data is not a readable Type 0/1 file.
+bool parseMidiFile(string_view data, ParsedSong& song, string& error);
+
+// Maps a .mid file and parses it.
+bool importMidiFile(const string& path, ParsedSong& song, string& error);
+
+// True if path names a Standard MIDI File (by extension).
+bool isMidiFilePath(const string& path);
+
+#endif // MIDIFILE_H
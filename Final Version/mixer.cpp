@@ -0,0 +1,178 @@
+// mixer.cpp
+// Envelopes and the per-channel mix bus. The inner loops are plain indexed
+// loops over contiguous float arrays with no branches, so the compiler turns
+// them into SIMD code.
+
+#include "mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+// ===== Envelopes =====
+
+void startEnvelope(Envelope& env, float attackSec, float decaySec, float sustain, float releaseSec,
+                   int sampleRate)
+{
+    const double sr = sampleRate;
+    env.stage = ENV_ATTACK;
+    env.level = 0.0f;
+    env.attackInc = 1.0f / max(1.0f, static_cast<float>(attackSec * sr));
+    env.sustain = sustain;
+    env.releaseSamples = max(1.0f, static_cast<float>(releaseSec * sr));
+    env.releaseDec = 0.0f;
+    double decayMul = exp(-1.0 / (decaySec * sr));
+    double power = 1.0;
+    for (int k = 0; k < 8; ++k) {
+        power *= decayMul;
+        env.decayPow[k] = static_cast<float>(power);
+    }
+}
+
+void releaseEnvelope(Envelope& env)
+{
+    if (env.stage == ENV_DONE || env.stage == ENV_RELEASE)
+        return;
+    env.stage = ENV_RELEASE;
+    env.releaseDec = env.level / env.releaseSamples;
+}
+
+namespace {
+
+// Steps a linear ramp needs to cover distance (at least one).
+int rampLength(float distance, float step)
+{
+    if (step <= 0.0f)
+        return 1;
+    double n = ceil(static_cast<double>(distance) / step);
+    return n < 1.0 ? 1 : (n > 1e9 ? 1000000000 : static_cast<int>(n));
+}
+
+// Exponential approach to sustain, 8 independent lanes per step:
+// gain[i + k] = sustain + d * mul^(k + 1), then d *= mul^8.
+float renderDecay(const Envelope& env, float level, float* gain, int frames)
+{
+    const float sustain = env.sustain;
+    float d = level - sustain;
+    int i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        for (int k = 0; k < 8; ++k)
+            gain[i + k] = sustain + d * env.decayPow[k];
+        d *= env.decayPow[7];
+    }
+    int rest = frames - i;
+    for (int k = 0; k < rest; ++k)
+        gain[i + k] = sustain + d * env.decayPow[k];
+    if (rest > 0)
+        d *= env.decayPow[rest - 1];
+    return sustain + d;
+}
+
+} // namespace
+
+int renderEnvelope(Envelope& env, float* gain, int frames)
+{
+    int done = 0;
+    while (done < frames) {
+        float* g = gain + done;
+        int left = frames - done;
+        switch (env.stage) {
+            case ENV_ATTACK: {
+                int n = rampLength(1.0f - env.level, env.attackInc);
+                int run = min(n, left);
+                for (int i = 0; i < run; ++i)
+                    g[i] = env.level + static_cast<float>(i + 1) * env.attackInc;
+                if (run == n) {
+                    g[run - 1] = 1.0f;
+                    env.stage = ENV_DECAY;
+                }
+                env.level = min(1.0f, g[run - 1]);
+                done += run;
+                break;
+            }
+            case ENV_DECAY:
+                env.level = renderDecay(env, env.level, g, left);
+                done = frames;
+                break;
+            case ENV_RELEASE: {
+                int n = rampLength(env.level, env.releaseDec);
+                int run = min(n, left);
+                for (int i = 0; i < run; ++i)
+                    g[i] = env.level - static_cast<float>(i + 1) * env.releaseDec;
+                if (run == n) {
+                    g[run - 1] = 0.0f;
+                    env.stage = ENV_DONE;
+                }
+                env.level = max(0.0f, g[run - 1]);
+                done += run;
+                break;
+            }
+            case ENV_DONE:
+                return done;
+        }
+    }
+    return done;
+}
+
+// ===== Mix bus =====
+
+MixBus::MixBus()
+{
+    for (int ch = 0; ch < MIX_CHANNELS; ++ch)
+        setStrip(ch, ChannelStrip());
+}
+
+void MixBus::setStrip(int channel, const ChannelStrip& strip)
+{
+    // Equal-power law: left^2 + right^2 stays constant across the pan range.
+    float pan = min(1.0f, max(-1.0f, strip.pan));
+    double angle = (pan + 1.0) * 0.25 * 3.14159265358979323846;
+    gainLeft[channel & 0x0F] = static_cast<float>(strip.volume * cos(angle));
+    gainRight[channel & 0x0F] = static_cast<float>(strip.volume * sin(angle));
+}
+
+float* MixBus::channelBuffer(int channel, int frames)
+{
+    channel &= 0x0F;
+    uint32_t bit = 1u << channel;
+    if (!(activeMask & bit)) {
+        memset(channels[channel], 0, sizeof(float) * frames);
+        activeMask |= bit;
+    }
+    return channels[channel];
+}
+
+int MixBus::activeChannels() const
+{
+    int count = 0;
+    for (uint32_t mask = activeMask; mask; mask &= mask - 1)
+        ++count;
+    return count;
+}
+
+void MixBus::mix(float* stereo, int frames, float masterGain)
+{
+    memset(left, 0, sizeof(float) * frames);
+    memset(right, 0, sizeof(float) * frames);
+    for (int ch = 0; ch < MIX_CHANNELS; ++ch) {
+        if (!(activeMask & (1u << ch)))
+            continue;
+        const float* __restrict in = channels[ch];
+        float* __restrict l = left;
+        float* __restrict r = right;
+        const float gl = gainLeft[ch] * masterGain;
+        const float gr = gainRight[ch] * masterGain;
+        for (int i = 0; i < frames; ++i) {
+            l[i] += in[i] * gl;
+            r[i] += in[i] * gr;
+        }
+    }
+    activeMask = 0;
+
+    for (int i = 0; i < frames; ++i) {
+        stereo[2 * i] = left[i];
+        stereo[2 * i + 1] = right[i];
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef MIXER_H
+#define MIXER_H
+
+// Block mixer for the software synth.
+// Audio is processed in blocks of at most MIX_BLOCK_FRAMES frames held in
+// fixed, aligned arrays (16 channels x 256 floats = 16 KB, so a whole block
+// stays in L1/L2).
+//
+//   Envelope    ADSR gain curve written a block at a time, one tight loop
+//               per stage segment instead of a per-sample stage switch
+//   MixBus      one mono buffer per MIDI channel; voices add into their
+//               channel, then mix() applies each channel's volume and
+//               equal-power pan and sums onto the stereo bus
+//
+// Only channels that received audio in the current block are cleared and
+// mixed, so the cost grows with the number of sounding channels, not 16.
+
+#include <cstdint>
+
+const int MIX_BLOCK_FRAMES = 256;
+const int MIX_CHANNELS = 16;
+
+// ===== Envelopes =====
+
+enum EnvelopeStage { ENV_ATTACK, ENV_DECAY, ENV_RELEASE, ENV_DONE };
+
+struct Envelope {
+    EnvelopeStage stage;
+    float level;
+    float attackInc;        // Linear rise per sample
+    float sustain;
+    float releaseSamples;   // Length of a release from full level
+    float releaseDec;       // Linear fall per sample, set on release
+    float decayPow[8];      // decay multiplier ^ 1..8, for 8 samples at a time
+};
+
+// Starts the attack; decaySec is the time constant toward sustain.
+void startEnvelope(Envelope& env, float attackSec, float decaySec, float sustain, float releaseSec,
+                   int sampleRate);
+// Moves to the release stage from the current level.
+void releaseEnvelope(Envelope& env);
+// Writes up to frames gain values and advances the envelope. Returns how many
+// were written; fewer than frames means the envelope finished (ENV_DONE).
+int renderEnvelope(Envelope& env, float* gain, int frames);
+
+// ===== Mix bus =====
+
+struct ChannelStrip {
+    float volume = 1.0f;
+    float pan = 0.0f;       // -1 = hard left, 0 = centre, 1 = hard right
+};
+
+class MixBus {
+public:
+    MixBus();
+
+    void setStrip(int channel, const ChannelStrip& strip);
+
+    // Mono buffer voices on channel add the current block into. The first call
+    // for a channel in a block clears frames samples.
+    float* channelBuffer(int channel, int frames);
+    int activeChannels() const;
+
+    // Pans and sums every channel used this block into interleaved stereo
+    // (frames * 2 floats), scaled by masterGain, and starts the next block.
+    void mix(float* stereo, int frames, float masterGain);
+
+private:
+    alignas(32) float channels[MIX_CHANNELS][MIX_BLOCK_FRAMES];
+    alignas(32) float left[MIX_BLOCK_FRAMES];
+    alignas(32) float right[MIX_BLOCK_FRAMES];
+    float gainLeft[MIX_CHANNELS];
+    float gainRight[MIX_CHANNELS];
+    uint32_t activeMask = 0;   // Bit per channel written this block
+};
+
+#endif // MIXER_H
@@ -2,21 +2,54 @@
 // Implementation for the terminal music composer: data, helpers, UI actions, and playback.
 
 #include "music.h"
+#include "chord.h"
+#include "synth.h"
+#include "transport.h"
+#include "timeline.h"
+#include "songio.h"
+#include "songbin.h"
+#include "midifile.h"
+#include "soundfont.h"
+#include "history.h"
+#include "section_registry.h"
 
 using namespace std;
 
 // ===== Global state =====
 vector<MusicSection> songSections;
 string currentSection = "A";
-PlaybackState playbackState = STATE_STOPPED;
 int currentInstrument = INSTRUMENT_PIANO;
-bool stopPlayback = false;
 
 // MIDI handle
 HMIDIOUT hMidiOut = NULL;
 
-<<<<<<< Updated upstream
-=======
+// Output backend: every MIDI message goes through this sink. Defaults to a
+// null sink until initMIDI() opens the device.
+NullSink nullSink;
+DeviceSink* deviceSink = nullptr;
+EventSink* outputSink = &nullSink;
+// Notes started through playMIDINote and not yet stopped
+static ActiveNotes directNotes;
+
+// Compiled timeline cache, rebuilt lazily when the song revision changes
+uint64_t songRevision = 1;
+static uint64_t timelineRevision = 0;
+static Timeline cachedTimeline;
+
+// Note rows of every measure; append-only, so edit history ranges stay valid
+NoteArena songNotes;
+
+// Tempo and time signature changes, in ticks
+TempoTrack songTempo;
+// Section play order; sections repeated by it are stored once
+Arrangement songArrangement;
+
+// Undo/redo versions of the song, sharing unchanged sections and measures
+static SongHistory songHistory;
+
+// Name -> section handle index over songSections
+static SectionRegistry sectionRegistry(songSections);
+
 // Multi-instrument support
 map<int, int> channelInstruments;  // channel -> instrument
 map<string, int> instrumentNames = {
@@ -26,34 +59,108 @@ map<string, int> instrumentNames = {
     {"ELECTRICBASS", 33}, {"CELLO", 42}, {"DRUMS", 0}
 };
 
->>>>>>> Stashed changes
+// ===== Song revision / compiled timeline =====
+void markSongChanged() {
+    ++songRevision;
+}
+
+const Timeline& songTimeline() {
+    if (timelineRevision != songRevision) {
+        cachedTimeline = compileTimeline(songSections, songNotes, songTempo, songArrangement);
+        timelineRevision = songRevision;
+    }
+    return cachedTimeline;
+}
+
+// ===== Edit history =====
+static SongState liveSong() {
+    return {songSections, channelInstruments, songTempo, songArrangement};
+}
+
+// Records an edit that changed measures of section from firstMeasure on
+// (or, without a section, sections added at the end and song settings).
+static void recordEdit(const string& label, size_t section = SongHistory::NO_SECTION, size_t firstMeasure = 0) {
+    songHistory.commit(label, liveSong(), section, firstMeasure);
+    markSongChanged();
+}
+
+void resetHistory() {
+    songHistory.reset(liveSong());
+}
+
+void undoEdit() {
+    if (!songHistory.canUndo()) {
+        cout << "Nothing to undo.\n";
+        return;
+    }
+    string label = songHistory.undoLabel();
+    songHistory.undo(liveSong());
+    sectionRegistry.reindex();
+    markSongChanged();
+    for (auto& pair : channelInstruments) {
+        setInstrumentOnChannel(pair.second, pair.first);
+    }
+    cout << "Undone: " << label << "\n";
+}
+
+void redoEdit() {
+    if (!songHistory.canRedo()) {
+        cout << "Nothing to redo.\n";
+        return;
+    }
+    songHistory.redo(liveSong());
+    sectionRegistry.reindex();
+    markSongChanged();
+    for (auto& pair : channelInstruments) {
+        setInstrumentOnChannel(pair.second, pair.first);
+    }
+    cout << "Redone: " << songHistory.undoLabel() << "\n";
+}
+
 // ===== MIDI Implementation =====
 void initMIDI() {
     if (hMidiOut == NULL) {
-        midiOutOpen(&hMidiOut, 0, 0, 0, CALLBACK_NULL);
+        // 1 ms system timer so the scheduler's coarse sleeps wake on time.
+        timeBeginPeriod(1);
+        if (midiOutOpen(&hMidiOut, 0, 0, 0, CALLBACK_NULL) == MMSYSERR_NOERROR) {
+            // Device calls run on the sink's own thread, off the playback loop.
+            deviceSink = new DeviceSink([](uint32_t msg) { midiOutShortMsg(hMidiOut, msg); });
+            outputSink = deviceSink;
+        } else {
+            hMidiOut = NULL;
+        }
         setupChannelInstruments();
     }
 }
 
 void closeMIDI() {
+    silenceAllNotes();
     if (hMidiOut != NULL) {
+        if (outputSink == deviceSink)
+            outputSink = &nullSink;
+        delete deviceSink;  // Drains any queued events first
+        deviceSink = nullptr;
         midiOutClose(hMidiOut);
         hMidiOut = NULL;
+        timeEndPeriod(1);
     }
 }
 
+void setOutputSink(EventSink* sink) {
+    silenceAllNotes();
+    outputSink = sink ? sink : &nullSink;
+}
+
+void silenceAllNotes() {
+    directNotes.releaseAll(*outputSink);
+}
+
 void setInstrument(int instrument) {
-    if (hMidiOut != NULL) {
-        midiOutShortMsg(hMidiOut, 0xC0 | (instrument << 8));
-    }
+    outputSink->send(programChangeEvent(0, instrument));
 }
 
-<<<<<<< Updated upstream
-=======
 void setInstrumentOnChannel(int instrument, int channel) {
-    if (hMidiOut != NULL) {
-        midiOutShortMsg(hMidiOut, 0xC0 | channel | (instrument << 8));
-    }
+    outputSink->send(programChangeEvent(channel, instrument));
 }
 
 void setupChannelInstruments() {
@@ -71,17 +178,22 @@ void setupChannelInstruments() {
     }
 }
 
->>>>>>> Stashed changes
+void resetChannelInstruments() {
+    setupChannelInstruments();
+    recordEdit("reset channel instruments");
+    cout << "Channels reset to default\n";
+}
+
 void playMIDINote(int note, int velocity, int channel) {
-    if (hMidiOut != NULL) {
-        midiOutShortMsg(hMidiOut, 0x90 | channel | (note << 8) | (velocity << 16));
-    }
+    MidiEvent event = noteOnEvent(channel, note, velocity);
+    directNotes.track(event);
+    outputSink->send(event);
 }
 
 void stopMIDINote(int note, int channel) {
-    if (hMidiOut != NULL) {
-        midiOutShortMsg(hMidiOut, 0x80 | channel | (note << 8));
-    }
+    MidiEvent event = noteOffEvent(channel, note);
+    directNotes.track(event);
+    outputSink->send(event);
 }
 
 void playMIDIChord(const vector<int>& notes, int velocity, int channel) {
@@ -96,80 +208,10 @@ void stopMIDIChord(const vector<int>& notes, int channel) {
     }
 }
 
-// ===== Notation data (notes and chords) =====
-map<string, int> noteToMidi = {
-    // Octave 0
-    {"C0", 12}, {"C#0", 13}, {"D0", 14}, {"D#0", 15}, {"E0", 16}, {"F0", 17}, {"F#0", 18}, 
-    {"G0", 19}, {"G#0", 20}, {"A0", 21}, {"A#0", 22}, {"B0", 23},
-    // Octave 1
-    {"C1", 24}, {"C#1", 25}, {"D1", 26}, {"D#1", 27}, {"E1", 28}, {"F1", 29}, {"F#1", 30}, 
-    {"G1", 31}, {"G#1", 32}, {"A1", 33}, {"A#1", 34}, {"B1", 35},
-    // Octave 2
-    {"C2", 36}, {"C#2", 37}, {"D2", 38}, {"D#2", 39}, {"E2", 40}, {"F2", 41}, {"F#2", 42}, 
-    {"G2", 43}, {"G#2", 44}, {"A2", 45}, {"A#2", 46}, {"B2", 47},
-    // Octave 3
-    {"C3", 48}, {"C#3", 49}, {"D3", 50}, {"D#3", 51}, {"E3", 52}, {"F3", 53}, {"F#3", 54}, 
-    {"G3", 55}, {"G#3", 56}, {"A3", 57}, {"A#3", 58}, {"B3", 59},
-    // Octave 4
-    {"C4", 60}, {"C#4", 61}, {"D4", 62}, {"D#4", 63}, {"E4", 64}, {"F4", 65}, {"F#4", 66}, 
-    {"G4", 67}, {"G#4", 68}, {"A4", 69}, {"A#4", 70}, {"B4", 71},
-    // Octave 5
-    {"C5", 72}, {"C#5", 73}, {"D5", 74}, {"D#5", 75}, {"E5", 76}, {"F5", 77}, {"F#5", 78}, 
-    {"G5", 79}, {"G#5", 80}, {"A5", 81}, {"A#5", 82}, {"B5", 83},
-    // Octave 6
-    {"C6", 84}, {"C#6", 85}, {"D6", 86}, {"D#6", 87}, {"E6", 88}, {"F6", 89}, {"F#6", 90}, 
-    {"G6", 91}, {"G#6", 92}, {"A6", 93}, {"A#6", 94}, {"B6", 95},
-    // Octave 7
-    {"C7", 96}, {"C#7", 97}, {"D7", 98}, {"D#7", 99}, {"E7", 100}, {"F7", 101}, {"F#7", 102}, 
-    {"G7", 103}, {"G#7", 104}, {"A7", 105}, {"A#7", 106}, {"B7", 107},
-    // Octave 8
-    {"C8", 108}, {"C#8", 109}, {"D8", 110}, {"D#8", 111}, {"E8", 112}, {"F8", 113}, {"F#8", 114}, 
-    {"G8", 115}, {"G#8", 116}, {"A8", 117}, {"A#8", 118}, {"B8", 119}
-};
-
-// Keep frequency mapping for compatibility
-map<string, int> noteFrequencies = {
-    {"C4", 262}, {"C#4", 277}, {"D4", 294}, {"D#4", 311}, {"E4", 330}, {"F4", 349}, 
-    {"F#4", 370}, {"G4", 392}, {"G#4", 415}, {"A4", 440}, {"A#4", 466}, {"B4", 494},
-    {"C5", 523}, {"C#5", 554}, {"D5", 587}, {"D#5", 622}, {"E5", 659}, {"F5", 698}, 
-    {"F#5", 740}, {"G5", 784}, {"G#5", 831}, {"A5", 880}, {"A#5", 932}, {"B5", 988}
-};
-
-<<<<<<< Updated upstream
-// Named chord spellings used to quickly build a measure.
-=======
-// Named chord spellings
->>>>>>> Stashed changes
-map<string, vector<string>> chordDefinitions = {
-    {"CMAJ7", {"C4", "E4", "G4", "B4"}},
-    {"GMAJ7", {"G4", "B4", "D5", "F#5"}},
-    {"D6", {"D4", "F#4", "A4", "B4"}},
-    {"A7", {"A4", "C#5", "E5", "G5"}},
-    {"DMAJ7", {"D4", "F#4", "A4", "C#5"}},
-    {"CMAJ", {"C4", "E4", "G4"}},
-    {"DMIN", {"D4", "F4", "A4"}},
-    {"EMIN", {"E4", "G4", "B4"}},
-    {"FMAJ", {"F4", "A4", "C5"}},
-    {"GMAJ", {"G4", "B4", "D5"}},
-    {"AMIN", {"A4", "C5", "E5"}},
-    {"BMAJ", {"B4", "D#5", "F#5"}},
-    {"C7", {"C4", "E4", "G4", "A#4"}},
-    {"D7", {"D4", "F#4", "A4", "C5"}},
-    {"E7", {"E4", "G#4", "B4", "D5"}},
-    {"F7", {"F4", "A4", "C5", "D#5"}},
-    {"G7", {"G4", "B4", "D5", "F5"}},
-    {"B7", {"B4", "D#5", "F#5", "A5"}}
-};
-
 // ===== UI / Menu =====
 void showMenu()
 {
-<<<<<<< Updated upstream
-    // Displays available operations and current context.
-    cout << "\n==== C++ Terminal Music Composer (MIDI Enhanced) ====\n";
-=======
     cout << "\n==== C++ Terminal Music Composer (Multi-Instrument) ====\n";
->>>>>>> Stashed changes
     cout << "1. Add measure to current section\n";
     cout << "2. Play current section\n";
     cout << "3. Play entire song\n";
@@ -190,7 +232,14 @@ void showMenu()
     cout << "18. Add multi-instrument measure\n";
     cout << "19. Show channel status\n";
     cout << "20. Setup channel instruments\n";
-    cout << "21. Exit\n";
+    cout << "21. Render song to WAV\n";
+    cout << "22. Export MIDI file\n";
+    cout << "23. Play song from measure\n";
+    cout << "24. Set song tempo\n";
+    cout << "25. Edit arrangement\n";
+    cout << "26. Undo\n";
+    cout << "27. Redo\n";
+    cout << "28. Exit\n";
     cout << string(35, '-') << "\n";
     cout << "Current Section: " << currentSection << "\n";
     cout << "Active channels: ";
@@ -201,17 +250,13 @@ void showMenu()
 }
 
 // Returns the active section; creates a new empty one if not present.
-MusicSection *getCurrentSection()
+SectionHandle getCurrentSection()
 {
-    for (auto &section : songSections)
-    {
-        if (section.name == currentSection)
-            return &section;
-    }
-    MusicSection newSection;
-    newSection.name = currentSection;
-    songSections.push_back(newSection);
-    return &songSections.back();
+    bool added = false;
+    SectionHandle handle = sectionRegistry.findOrAdd(currentSection, added);
+    if (added)
+        markSongChanged();
+    return handle;
 }
 
 // ===== Presentation helpers =====
@@ -233,22 +278,26 @@ void printMusicSheet()
     {
         cout << "\nSection " << section.name << "\n";
         cout << string(80, '-') << "\n";
-        cout << left << setw(8) << "Measure" << setw(12) << "Chord" << setw(10) << "Duration" << "Notes (Channel:Instrument)\n";
-        cout << string(80, '-') << "\n";
+        cout << left << setw(8) << "Measure" << setw(12) << "Chord" << setw(12) << "Harmony" << setw(10) << "Ticks"
+             << "Notes (Channel:Instrument)\n";
+        cout << string(92, '-') << "\n";
 
         for (const auto &measure : section.measures)
         {
+            // The chord the notes actually sound, whatever the label says
+            string harmony = measureChordName(measure, songNotes);
             cout << setw(8) << measure.measureNumber
                  << setw(12) << measure.chord
-                 << setw(10) << (to_string(measure.duration) + "ms");
+                 << setw(12) << (harmony.empty() ? "-" : harmony)
+                 << setw(10) << measure.duration;
             
             // Group notes by channel for display
             map<int, vector<string>> notesByChannel;
             map<int, int> instrumentsByChannel;
             
-            for (const auto &note : measure.notes) {
-                notesByChannel[note.channel].push_back(note.name);
-                instrumentsByChannel[note.channel] = note.instrument;
+            for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row) {
+                notesByChannel[songNotes.channel()[row]].emplace_back(pitchName(songNotes.pitch()[row]));
+                instrumentsByChannel[songNotes.channel()[row]] = songNotes.instrument()[row];
             }
             
             bool firstChannel = true;
@@ -279,8 +328,6 @@ void printMusicSheet()
     cout << string(60, '=') << "\n";
 }
 
-<<<<<<< Updated upstream
-=======
 void showChannelStatus() {
     cout << "\n=== Channel Status ===\n";
     cout << string(25, '=') << "\n";
@@ -307,75 +354,81 @@ void showChannelStatus() {
     }
 }
 
->>>>>>> Stashed changes
-// Lists supported chord names for reference.
+// Lists the chord qualities, spelled on C, and the symbol syntax.
 void listCommonChords()
 {
-    cout << "\nCommon Chords Available:\n";
-    cout << string(25,'=') << "\n";
-    int count = 0;
-    for (const auto &chord : chordDefinitions)
+    cout << "\nChord Qualities (shown on C):\n";
+    cout << string(40,'=') << "\n";
+    for (const auto &quality : CHORD_QUALITIES)
     {
-        cout << chord.first << "\t";
-        if (++count % 4 == 0)
-            cout << "\n";
+        string symbol = "C" + string(quality.suffix);
+        Chord chord;
+        PitchId pitches[CHORD_MAX_NOTES];
+        int count = parseChord(symbol, chord) ? chordPitches(chord, pitches) : 0;
+        cout << left << setw(10) << symbol;
+        for (int i = 0; i < count; ++i)
+            cout << pitchName(pitches[i]) << " ";
+        cout << "\n";
     }
-    cout << "\n\nUse these chord names when adding measures.\n";
+    cout << "\nAny root works (C, F#, Eb, Bb...). Add alterations (B5, #9, ADD9, SUS4),\n"
+            "a slash bass (C/E), an inversion (^1) or an octave (@3), e.g. EbMIN7, F#DIM, G7B9/B.\n";
 }
 
-// Adds a measure by selecting a chord name from chordDefinitions.
+// Adds a measure spelled from a chord symbol.
 void addChordByName()
 {
     listCommonChords();
-    cout << "\nEnter chord name (e.g., GMAJ7, AMIN, C7): ";
+    cout << "\nEnter chord symbol (e.g., GMAJ7, EbMIN7, F#DIM, C7/E, AMIN^1@3): ";
     string chordName;
     cin >> chordName;
 
-    for (char &c : chordName)
-        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
-
-    if (chordDefinitions.find(chordName) == chordDefinitions.end())
+    Chord chord;
+    PitchId pitches[CHORD_MAX_NOTES];
+    int count = parseChord(chordName, chord) ? chordPitches(chord, pitches) : 0;
+    if (count == 0)
     {
-        cout << "Chord not found! Available chords:\n";
+        cout << "Unknown chord symbol " << chordName << ". Chord qualities:\n";
         listCommonChords();
         return;
     }
 
     int duration;
-    cout << "Enter duration in milliseconds: ";
+    cout << "Enter duration in ticks (" << TICKS_PER_QUARTER << " per beat): ";
     cin >> duration;
 
-    MusicSection *current = getCurrentSection();
+    const SectionHandle current = getCurrentSection();
     Measure newMeasure;
-    newMeasure.measureNumber = static_cast<int>(current->measures.size()) + 1;
+    newMeasure.measureNumber = static_cast<int>(songSections[current].measures.size()) + 1;
     newMeasure.chord = chordName;
     newMeasure.section = currentSection;
     newMeasure.duration = duration;
 
-    for (const auto &noteName : chordDefinitions[chordName])
+    vector<Note> notes;
+    for (int i = 0; i < count; ++i)
     {
         Note n;
-        n.name = noteName;
-        n.freq = noteFrequencies[noteName];
-        n.midiNote = noteToMidi[noteName];
+        n.midiNote = pitches[i];
         n.duration = duration;
         n.channel = 0;  // Default to channel 0
         n.instrument = channelInstruments[0];
         n.velocity = 100;
-        newMeasure.notes.push_back(n);
+        notes.push_back(n);
     }
+    newMeasure.notes = songNotes.append(notes);
 
-    current->measures.push_back(newMeasure);
+    songSections[current].measures.push_back(newMeasure);
+    recordEdit("add " + chordName + " to Section " + currentSection, current,
+               songSections[current].measures.size() - 1);
     cout << "Added " << chordName << " chord to Section " << currentSection
-         << ", Measure " << newMeasure.measureNumber << " (" << duration << "ms)\n";
+         << ", Measure " << newMeasure.measureNumber << " (" << duration << " ticks)\n";
 }
 
 // Adds a measure by manual entry (free choice of chord label and note list).
 void addMeasure()
 {
-    MusicSection *current = getCurrentSection();
+    const SectionHandle current = getCurrentSection();
     Measure newMeasure;
-    newMeasure.measureNumber = static_cast<int>(current->measures.size()) + 1;
+    newMeasure.measureNumber = static_cast<int>(songSections[current].measures.size()) + 1;
     newMeasure.section = currentSection;
 
     cout << "\nAdding Measure " << newMeasure.measureNumber << " to Section " << currentSection << "\n";
@@ -384,7 +437,7 @@ void addMeasure()
     cin.ignore();
     getline(cin, newMeasure.chord);
 
-    cout << "Enter duration in milliseconds (e.g., 500): ";
+    cout << "Enter duration in ticks, " << TICKS_PER_QUARTER << " per beat (e.g., 500): ";
     cin >> newMeasure.duration;
     cin.ignore();
 
@@ -402,22 +455,22 @@ void addMeasure()
     }
 
     // Split and validate note tokens
+    vector<Note> notes;
     stringstream ss(input);
     string noteName;
     while (getline(ss, noteName, ','))
     {
         noteName.erase(remove_if(noteName.begin(), noteName.end(), ::isspace), noteName.end());
-        if (noteToMidi.find(noteName) != noteToMidi.end())
+        int pitch = parsePitch(noteName);
+        if (pitch != INVALID_PITCH)
         {
             Note n;
-            n.name = noteName;
-            n.freq = noteFrequencies[noteName];
-            n.midiNote = noteToMidi[noteName];
+            n.midiNote = static_cast<PitchId>(pitch);
             n.duration = newMeasure.duration;
             n.channel = 0;  // Default channel
             n.instrument = channelInstruments[0];
             n.velocity = 100;
-            newMeasure.notes.push_back(n);
+            notes.push_back(n);
         }
         else
         {
@@ -425,34 +478,25 @@ void addMeasure()
         }
     }
 
-    if (newMeasure.notes.empty())
+    if (notes.empty())
     {
         cout << "No valid notes entered. Measure not added.\n";
         return;
     }
 
-    current->measures.push_back(newMeasure);
+    newMeasure.notes = songNotes.append(notes);
+    songSections[current].measures.push_back(newMeasure);
+    recordEdit("add measure to Section " + currentSection, current, songSections[current].measures.size() - 1);
     cout << "Added Measure " << newMeasure.measureNumber << " to Section " << currentSection
-         << " (" << newMeasure.duration << "ms)\n";
-}
-
-<<<<<<< Updated upstream
-// Plays a single tone using MIDI; otherwise sleeps for the duration.
-void playNote(int frequency, int duration)
-{
-    // For compatibility, we'll use the MIDI system
-    // This function is kept for backward compatibility
-    Sleep(static_cast<DWORD>(duration));
+         << " (" << newMeasure.duration << " ticks)\n";
 }
 
-// Iterates measures in a named section and plays notes (chord tones in parallel).
-=======
 // ===== Multi-instrument measure creation =====
 void addMultiInstrumentMeasure()
 {
-    MusicSection* current = getCurrentSection();
+    const SectionHandle current = getCurrentSection();
     Measure newMeasure;
-    newMeasure.measureNumber = static_cast<int>(current->measures.size()) + 1;
+    newMeasure.measureNumber = static_cast<int>(songSections[current].measures.size()) + 1;
     newMeasure.section = currentSection;
 
     cout << "\nAdding Multi-Instrument Measure " << newMeasure.measureNumber << "\n";
@@ -461,7 +505,7 @@ void addMultiInstrumentMeasure()
     cin.ignore();
     getline(cin, newMeasure.chord);
     
-    cout << "Enter duration in milliseconds: ";
+    cout << "Enter duration in ticks (" << TICKS_PER_QUARTER << " per beat): ";
     cin >> newMeasure.duration;
     cin.ignore();
     
@@ -470,6 +514,8 @@ void addMultiInstrumentMeasure()
     cin >> parts;
     cin.ignore();
     
+    vector<Note> notes;
+    vector<int> newChannels;   // Assigned here; kept even if no measure is added
     for (int p = 0; p < parts; p++) {
         cout << "\n--- Part " << (p + 1) << " ---\n";
         
@@ -504,6 +550,7 @@ void addMultiInstrumentMeasure()
             
             channelInstruments[channel] = instrument;
             setInstrumentOnChannel(instrument, channel);
+            newChannels.push_back(channel);
         }
         
         // Get instrument if channel exists
@@ -518,150 +565,203 @@ void addMultiInstrumentMeasure()
         string noteName;
         while (getline(ss, noteName, ',')) {
             noteName.erase(remove_if(noteName.begin(), noteName.end(), ::isspace), noteName.end());
-            if (noteToMidi.find(noteName) != noteToMidi.end()) {
+            int pitch = parsePitch(noteName);
+            if (pitch != INVALID_PITCH) {
                 Note n;
-                n.name = noteName;
-                n.freq = noteFrequencies[noteName];
-                n.midiNote = noteToMidi[noteName];
+                n.midiNote = static_cast<PitchId>(pitch);
                 n.duration = newMeasure.duration;
                 n.channel = channel;
                 n.instrument = instrument;
                 n.velocity = 100 + (rand() % 27); // Some dynamics (100-127)
-                newMeasure.notes.push_back(n);
+                notes.push_back(n);
             } else {
                 cout << "Invalid note: " << noteName << " - skipping.\n";
             }
         }
     }
     
-    if (newMeasure.notes.empty()) {
+    if (notes.empty()) {
+        // The new channels stay assigned, so they still need a version of their own.
+        if (!newChannels.empty()) {
+            string label = "assign";
+            for (int channel : newChannels)
+                label += " Ch" + to_string(channel);
+            recordEdit(label + " instrument");
+        }
         cout << "No valid notes entered. Measure not added.\n";
         return;
     }
     
-    current->measures.push_back(newMeasure);
-    cout << "Added multi-instrument measure with " << newMeasure.notes.size() << " notes!\n";
+    newMeasure.notes = songNotes.append(notes);
+    songSections[current].measures.push_back(newMeasure);
+    recordEdit("add multi-instrument measure to Section " + currentSection, current,
+               songSections[current].measures.size() - 1);
+    cout << "Added multi-instrument measure with " << notes.size() << " notes!\n";
 }
 
 // ===== PLAYBACK FUNCTIONS (Updated for multi-instrument) =====
+// How often the keyboard is polled while the transport plays.
+const chrono::milliseconds KEY_POLL_INTERVAL(5);
+// Step for the seek keys.
+const int64_t SEEK_STEP_US = 5000000;
+
+// Transport of the playback in progress; keys and menu commands go to it.
+static Transport* activeTransport = nullptr;
+// Set when the user stops playback, so the caller can report it.
+static bool stopRequested = false;
+// Timeline and range start time of that playback, for the measure keys.
+static const Timeline* activeTimeline = nullptr;
+static int64_t activeRangeStartUs = 0;
+
+static void printPlaybackKeys()
+{
+    cout << "Press 'p' to pause, 'r' to resume, 's' to stop, '[' / ']' to seek 5s, "
+            "',' / '.' for previous/next measure, '-' / '+' for tempo\n";
+}
+
+// Prints the measure header and its notes grouped by channel.
+static void printPlayingMeasure(const Measure &measure)
+{
+    cout << "\nMeasure " << measure.measureNumber << " - " << measure.chord;
+    string harmony = measureChordName(measure, songNotes);
+    if (!harmony.empty() && harmony != measure.chord)
+        cout << " [" << harmony << "]";
+    cout << " (" << measure.duration << " ticks)\n";
+
+    map<int, vector<string>> notesByChannel;
+    for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row) {
+        notesByChannel[songNotes.channel()[row]].emplace_back(pitchName(songNotes.pitch()[row]));
+    }
+
+    for (const auto& channelEntry : notesByChannel) {
+        cout << "  Ch" << channelEntry.first << ": ";
+        for (size_t i = 0; i < channelEntry.second.size(); ++i) {
+            cout << channelEntry.second[i];
+            if (i + 1 < channelEntry.second.size()) cout << ",";
+        }
+        cout << "\n";
+    }
+}
+
+// Plays events [first, last) of a compiled timeline on a transport thread and
+// handles playback keys until it finishes or is stopped. onMeasure runs on the
+// playback thread for every measure marker. Playback starts startUs into the
+// range.
+// Returns false if the user stopped playback.
+static bool playTimelineRange(const Timeline &timeline, size_t first, size_t last,
+                              function<void(const TimelineEvent&)> onMeasure, int64_t startUs = 0)
+{
+    stopRequested = false;
+    Transport transport(*outputSink, move(onMeasure));
+    activeTransport = &transport;
+    activeTimeline = &timeline;
+    activeRangeStartUs = first < last ? timeline.events[first].timeUs : 0;
+    transport.play(timeline, first, last);
+    if (startUs > 0)
+        transport.seek(startUs);
+    while (transport.busy())
+    {
+        checkPlaybackControl();
+        this_thread::sleep_for(KEY_POLL_INTERVAL);
+    }
+    activeTransport = nullptr;
+    activeTimeline = nullptr;
+    return !stopRequested;
+}
+
 void playNote(int frequency, int duration)
 {
     // For compatibility
-    Sleep(static_cast<DWORD>(duration));
+    this_thread::sleep_for(chrono::milliseconds(duration));
 }
 
 // COMPLETE playSection() with multi-instrument support
->>>>>>> Stashed changes
 void playSection(const string &sectionName)
 {
-    MusicSection *section = nullptr;
-    for (auto &s : songSections)
-    {
-        if (s.name == sectionName)
-        {
-            section = &s;
-            break;
-        }
-    }
-
-    if (!section || section->measures.empty())
+    const SectionHandle sectionIndex = sectionRegistry.find(sectionName);
+    if (sectionIndex == NO_SECTION_HANDLE || songSections[sectionIndex].measures.empty())
     {
         cout << "Section " << sectionName << " is empty or doesn't exist!\n";
         return;
     }
 
     cout << "\nPlaying Section " << sectionName << "...\n";
-    cout << "Press 'p' to pause, 'r' to resume, 's' to stop\n";
+    printPlaybackKeys();
     cout << "Active channels: ";
     for (const auto& pair : channelInstruments) {
         cout << pair.first << " ";
     }
     cout << "\n" << string(40, '=') << "\n";
 
-    stopPlayback = false;
-    playbackState = STATE_PLAYING;
-
     // Ensure all channels have their instruments set
     for (auto& pair : channelInstruments) {
         setInstrumentOnChannel(pair.second, pair.first);
     }
 
-    for (const auto &measure : section->measures)
+    // Play the section's first part in the arrangement; a section the
+    // arrangement leaves out gets a timeline of its own.
+    const Timeline *source = &songTimeline();
+    size_t part = findSectionPart(*source, sectionIndex);
+    Timeline single;
+    if (part == SIZE_MAX)
     {
-        if (stopPlayback) break;
-        
-        // Handle pause state
-        while (playbackState == STATE_PAUSED) {
-            Sleep(50);
-            checkPlaybackControl();
-            if (stopPlayback) break;
-        }
-        if (stopPlayback) break;
-
-        // Display measure info
-        cout << "\nMeasure " << measure.measureNumber << " - " << measure.chord 
-             << " (" << measure.duration << "ms)\n";
-        
-        // Group notes by channel for better display
-        map<int, vector<string>> notesByChannel;
-        for (const auto &note : measure.notes) {
-            notesByChannel[note.channel].push_back(note.name);
-        }
-        
-        // Display notes by channel
-        for (const auto& channelEntry : notesByChannel) {
-            int channel = channelEntry.first;
-            cout << "  Ch" << channel << ": ";
-            for (size_t i = 0; i < channelEntry.second.size(); ++i) {
-                cout << channelEntry.second[i];
-                if (i + 1 < channelEntry.second.size()) cout << ",";
-            }
-            cout << "\n";
-        }
+        Arrangement alone;
+        ArrangementItem item;
+        item.section = static_cast<uint32_t>(sectionIndex);
+        alone.items.push_back(item);
+        single = compileTimeline(songSections, songNotes, songTempo, alone);
+        source = &single;
+        part = 0;
+    }
+    const Timeline &timeline = *source;
+    size_t first, last;
+    partEventRange(timeline, part, first, last);
+    bool finished = playTimelineRange(timeline, first, last, [&timeline](const TimelineEvent &ev) {
+        const TimelineMeasure &tm = timeline.measures[ev.measure];
+        printPlayingMeasure(songSections[tm.section].measures[tm.measure]);
+    });
+
+    if (finished) {
+        cout << "\n" << string(25, '=') << "\n";
+        cout << "Finished Section " << sectionName << "!\n";
+    } else {
+        cout << "\nPlayback stopped!\n";
+    }
+}
 
-        // Play all notes in the measure (each on its own channel)
-        for (const auto &note : measure.notes) {
-            playMIDINote(note.midiNote, note.velocity, note.channel);
-        }
+// Plays the whole song, starting startUs into it.
+static void playSongFrom(int64_t startUs)
+{
+    printPlaybackKeys();
+    cout << "Active channels: ";
+    for (const auto& pair : channelInstruments) {
+        cout << pair.first << " ";
+    }
+    cout << "\n" << string(40, '=') << "\n";
 
-        // Wait for the duration while checking for user input
-        DWORD startTime = GetTickCount();
-        while ((GetTickCount() - startTime) < static_cast<DWORD>(measure.duration)) {
-            checkPlaybackControl();
-            if (stopPlayback || playbackState == STATE_PAUSED) break;
-            Sleep(50);
-        }
+    // Ensure all channels have their instruments set
+    for (auto& pair : channelInstruments) {
+        setInstrumentOnChannel(pair.second, pair.first);
+    }
 
-        // Stop all notes in the measure
-        for (const auto &note : measure.notes) {
-            stopMIDINote(note.midiNote, note.channel);
-        }
+    const Timeline &timeline = songTimeline();
+    bool finished = playTimelineRange(timeline, 0, timeline.events.size(), [&timeline](const TimelineEvent &ev) {
+        // Markers sort after same-time note-ons, so printing never delays them.
+        const TimelineMeasure &tm = timeline.measures[ev.measure];
+        if (tm.measure == 0)
+            cout << "\n>>> SECTION " << songSections[tm.section].name << " <<<\n";
+        printPlayingMeasure(songSections[tm.section].measures[tm.measure]);
+    }, startUs);
 
-        // Small gap between measures
-        Sleep(50);
-    }
-    
-    // Turn off any lingering notes
-    for (const auto &measure : section->measures) {
-        for (const auto &note : measure.notes) {
-            stopMIDINote(note.midiNote, note.channel);
-        }
-    }
-    
-    playbackState = STATE_STOPPED;
-    if (!stopPlayback) {
+    if (finished) {
         cout << "\n" << string(25, '=') << "\n";
-        cout << "Finished Section " << sectionName << "!\n";
+        cout << "Song finished!\n";
     } else {
         cout << "\nPlayback stopped!\n";
     }
 }
 
-<<<<<<< Updated upstream
-// Plays all sections in stored order.
-=======
 // COMPLETE playEntireSong() with multi-instrument support
->>>>>>> Stashed changes
 void playEntireSong()
 {
     if (songSections.empty())
@@ -671,98 +771,174 @@ void playEntireSong()
     }
 
     cout << "\nPlaying Entire Song...\n";
-    cout << "Press 'p' to pause, 'r' to resume, 's' to stop\n";
-    cout << "Active channels: ";
-    for (const auto& pair : channelInstruments) {
-        cout << pair.first << " ";
+    playSongFrom(0);
+}
+
+// Plays the song from a chosen measure of a section. The start time comes
+// from the timeline's measure index, so long songs start without delay.
+void playFromMeasure()
+{
+    if (songSections.empty())
+    {
+        cout << "No song to play!\n";
+        return;
     }
-    cout << "\n" << string(40, '=') << "\n";
 
-    stopPlayback = false;
-    playbackState = STATE_PLAYING;
+    cout << "Available sections: ";
+    for (const auto &section : songSections)
+        cout << section.name << " ";
+    cout << "\nEnter section to start in: ";
 
-    // Ensure all channels have their instruments set
-    for (auto& pair : channelInstruments) {
-        setInstrumentOnChannel(pair.second, pair.first);
+    string sectionName;
+    cin >> sectionName;
+    for (char &c : sectionName) {
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
     }
 
-    for (const auto &section : songSections)
+    const SectionHandle sectionIndex = sectionRegistry.find(sectionName);
+    if (sectionIndex == NO_SECTION_HANDLE || songSections[sectionIndex].measures.empty())
     {
-        if (stopPlayback) break;
-        
-        cout << "\n>>> SECTION " << section.name << " <<<\n";
-        
-        for (const auto &measure : section.measures)
-        {
-            if (stopPlayback) break;
-            
-            while (playbackState == STATE_PAUSED) {
-                Sleep(50);
-                checkPlaybackControl();
-                if (stopPlayback) break;
-            }
-            if (stopPlayback) break;
+        cout << "Section " << sectionName << " is empty or doesn't exist!\n";
+        return;
+    }
 
-            // Display measure info
-            cout << "\nMeasure " << measure.measureNumber << " - " << measure.chord 
-                 << " (" << measure.duration << "ms)\n";
-            
-            // Group notes by channel for better display
-            map<int, vector<string>> notesByChannel;
-            for (const auto &note : measure.notes) {
-                notesByChannel[note.channel].push_back(note.name);
-            }
-            
-            // Display notes by channel
-            for (const auto& channelEntry : notesByChannel) {
-                int channel = channelEntry.first;
-                cout << "  Ch" << channel << ": ";
-                for (size_t i = 0; i < channelEntry.second.size(); ++i) {
-                    cout << channelEntry.second[i];
-                    if (i + 1 < channelEntry.second.size()) cout << ",";
-                }
-                cout << "\n";
-            }
+    size_t measureCount = songSections[sectionIndex].measures.size();
+    cout << "Enter measure number (1-" << measureCount << "): ";
+    int measureNumber = 0;
+    cin >> measureNumber;
+    if (measureNumber < 1 || static_cast<size_t>(measureNumber) > measureCount)
+    {
+        cout << "Invalid measure number!\n";
+        return;
+    }
 
-            // Play all notes in the measure (each on its own channel)
-            for (const auto &note : measure.notes) {
-                playMIDINote(note.midiNote, note.velocity, note.channel);
-            }
+    // Start at the section's first pass in the arrangement.
+    const Timeline &timeline = songTimeline();
+    size_t part = findSectionPart(timeline, sectionIndex);
+    if (part == SIZE_MAX)
+    {
+        cout << "Section " << sectionName << " is not in the arrangement!\n";
+        return;
+    }
+    const TimelineMeasure &start = timeline.measures[timeline.partFirstMeasure[part] + measureNumber - 1];
+    cout << "\nPlaying from Section " << sectionName << ", measure " << measureNumber << "...\n";
+    playSongFrom(start.startUs);
+}
 
-            // Wait for the duration while checking for user input
-            DWORD startTime = GetTickCount();
-            while ((GetTickCount() - startTime) < static_cast<DWORD>(measure.duration)) {
-                checkPlaybackControl();
-                if (stopPlayback || playbackState == STATE_PAUSED) break;
-                Sleep(50);
-            }
+// Sets the tempo from the start of a section, or for the whole song. Only the
+// tempo track changes; measures and notes keep their durations in ticks.
+void setSongTempo()
+{
+    TempoMap current(songTempo);
+    cout << "Tempo at the start: " << usPerQuarterToBpm(current.usPerQuarterAt(0)) << " BPM ("
+         << current.tempos().size() << " tempo change(s))\n";
+    cout << "Enter new tempo in BPM: ";
+    double bpm = 0;
+    cin >> bpm;
+    if (!(bpm > 0))
+    {
+        cout << "Invalid tempo!\n";
+        return;
+    }
 
-            // Stop all notes in the measure
-            for (const auto &note : measure.notes) {
-                stopMIDINote(note.midiNote, note.channel);
-            }
+    cout << "Apply from section (or ALL for the whole song): ";
+    string sectionName;
+    cin >> sectionName;
+    for (char &c : sectionName) {
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    }
 
-            // Small gap between measures
-            Sleep(50);
+    uint32_t usPerQuarter = bpmToUsPerQuarter(bpm);
+    if (sectionName == "ALL")
+    {
+        songTempo.tempos.assign(1, TempoChange{0, usPerQuarter});
+    }
+    else
+    {
+        // The change lands where the section is first played.
+        const Timeline &timeline = songTimeline();
+        const SectionHandle section = sectionRegistry.find(sectionName);
+        size_t part = section == NO_SECTION_HANDLE ? SIZE_MAX : findSectionPart(timeline, section);
+        if (part == SIZE_MAX || timeline.partFirstMeasure[part] == timeline.partFirstMeasure[part + 1])
+        {
+            cout << "Section " << sectionName << " not found in the song.\n";
+            return;
         }
+        int64_t tick = timeline.tempo.usToTick(timeline.measures[timeline.partFirstMeasure[part]].startUs);
+        auto &tempos = songTempo.tempos;
+        tempos.erase(remove_if(tempos.begin(), tempos.end(), [tick](const TempoChange &c) { return c.tick == tick; }),
+                     tempos.end());
+        tempos.push_back({tick, usPerQuarter});
     }
-    
-    // Turn off any lingering notes
-    for (const auto &section : songSections) {
-        for (const auto &measure : section.measures) {
-            for (const auto &note : measure.notes) {
-                stopMIDINote(note.midiNote, note.channel);
+    recordEdit(sectionName == "ALL" ? "set tempo" : "set tempo from Section " + sectionName);
+    cout << "Tempo set to " << bpm << " BPM" << (sectionName == "ALL" ? "" : " from Section " + sectionName) << "\n";
+}
+
+// Replaces the arrangement with items typed one per line. Sections are
+// referenced, not copied, so repeating a chorus costs one line.
+void editArrangement()
+{
+    if (songSections.empty())
+    {
+        cout << "No sections exist yet. Create one first.\n";
+        return;
+    }
+
+    cout << "Current arrangement:";
+    if (songArrangement.items.empty())
+        cout << " every section once, in order";
+    cout << "\n";
+    for (const auto &item : songArrangement.items)
+    {
+        bool named = item.type == ARRANGE_SECTION && item.section < songSections.size();
+        cout << "  " << formatArrangementItem(item, named ? songSections[item.section].name : string()) << "\n";
+    }
+    cout << "Enter items one per line: NAME [xN] [@1,2], |:, :| N, (D.C.), (TO CODA), (CODA), (FINE)\n";
+    cout << "End with an empty line; CLEAR plays every section in order.\n";
+
+    cin.ignore();
+    Arrangement arrangement;
+    string line;
+    while (getline(cin, line) && !line.empty())
+    {
+        for (char &c : line) {
+            c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        }
+        if (line == "CLEAR")
+        {
+            arrangement.items.clear();
+            break;
+        }
+        ArrangementItem item;
+        string name, error;
+        if (!parseArrangementLine(line, item, name, error))
+        {
+            cout << "Skipped: " << error << "\n";
+            continue;
+        }
+        if (item.type == ARRANGE_SECTION)
+        {
+            SectionHandle section = sectionRegistry.find(name);
+            if (section == NO_SECTION_HANDLE)
+            {
+                cout << "Skipped: no section " << name << "\n";
+                continue;
             }
+            item.section = section;
         }
+        arrangement.items.push_back(item);
     }
-    
-    playbackState = STATE_STOPPED;
-    if (!stopPlayback) {
-        cout << "\n" << string(25, '=') << "\n";
-        cout << "Song finished!\n";
-    } else {
-        cout << "\nPlayback stopped!\n";
+
+    string error;
+    if (!checkArrangement(arrangement, songSections.size(), error))
+    {
+        cout << "Arrangement not changed: " << error << "\n";
+        return;
     }
+    songArrangement = move(arrangement);
+    recordEdit("edit arrangement");
+    cout << "Arrangement set: " << songTimeline().partSections.size() << " parts from "
+         << songSections.size() << " sections.\n";
 }
 
 // Creates a new labeled section and switches context to it.
@@ -785,18 +961,14 @@ void addNewSection()
     
     currentSection = newSection;
 
-    for (const auto &section : songSections)
+    bool added = false;
+    sectionRegistry.findOrAdd(newSection, added);
+    if (!added)
     {
-        if (section.name == newSection)
-        {
-            cout << "Switched to existing Section " << newSection << "\n";
-            return;
-        }
+        cout << "Switched to existing Section " << newSection << "\n";
+        return;
     }
-
-    MusicSection newSec;
-    newSec.name = newSection;
-    songSections.push_back(newSec);
+    recordEdit("new Section " + newSection);
     cout << "Created and switched to Section " << newSection << "\n";
 }
 
@@ -822,23 +994,16 @@ void switchSection()
         c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
     }
 
-    for (const auto &section : songSections)
+    if (sectionRegistry.find(sectionName) != NO_SECTION_HANDLE)
     {
-        if (section.name == sectionName)
-        {
-            currentSection = sectionName;
-            cout << "Switched to Section " << sectionName << "\n";
-            return;
-        }
+        currentSection = sectionName;
+        cout << "Switched to Section " << sectionName << "\n";
+        return;
     }
     cout << "Section " << sectionName << " not found.\n";
 }
 
-<<<<<<< Updated upstream
-// Serializes all sections/measures to a simple line format.
-=======
-// Serializes all sections/measures to multi-instrument format
->>>>>>> Stashed changes
+// Serializes all sections/measures to multi-instrument format (.mmsb for binary)
 void saveSong()
 {
     string filename;
@@ -851,6 +1016,18 @@ void saveSong()
         filename = "song_sheet.txt";
     }
 
+    if (isBinarySongPath(filename))
+    {
+        string error;
+        if (!saveSongBinary(filename, songSections, songNotes, channelInstruments, songTempo, songArrangement, error))
+        {
+            cout << "Error saving song: " << error << "\n";
+            return;
+        }
+        cout << "Song saved to " << filename << " (binary format)\n";
+        return;
+    }
+
     ofstream file(filename);
     if (!file)
     {
@@ -858,36 +1035,7 @@ void saveSong()
         return;
     }
 
-    for (const auto &section : songSections)
-    {
-        file << "[SECTION " << section.name << "]\n";
-        for (const auto &measure : section.measures)
-        {
-            file << measure.measureNumber << "|" << measure.chord << "|";
-            
-            // Group notes by channel and instrument
-            map<pair<int, int>, vector<string>> channelNotes;
-            for (const auto &note : measure.notes) {
-                pair<int, int> key = {note.channel, note.instrument};
-                channelNotes[key].push_back(note.name);
-            }
-            
-            // Write each channel's notes
-            bool firstChannel = true;
-            for (const auto &entry : channelNotes) {
-                if (!firstChannel) file << ";";
-                file << entry.first.first << ":" << entry.first.second << ":";
-                for (size_t i = 0; i < entry.second.size(); ++i) {
-                    file << entry.second[i];
-                    if (i + 1 < entry.second.size())
-                        file << ",";
-                }
-                firstChannel = false;
-            }
-            
-            file << "|" << measure.duration << "\n";
-        }
-    }
+    writeSongSheet(file, songSections, songNotes, songTempo, songArrangement);
     cout << "Song saved to " << filename << " (multi-instrument format)\n";
 }
 
@@ -903,106 +1051,53 @@ void loadSong()
         filename = "song_sheet.txt";
     }
 
-    ifstream file(filename);
-    if (!file)
+    ParsedSong song;
+    vector<SongParseError> errors;
+    if (isBinarySongPath(filename) || isMidiFilePath(filename))
+    {
+        string error;
+        bool loaded = isBinarySongPath(filename) ? loadSongBinary(filename, song, error)
+                                                 : importMidiFile(filename, song, error);
+        if (!loaded)
+        {
+            cout << "Error loading song: " << error << "\n";
+            return;
+        }
+    }
+    else if (!loadSongSheet(filename, song, errors))
     {
         cout << "Error loading " << filename << "\n";
         return;
     }
 
-    songSections.clear();
-    channelInstruments.clear(); // Clear old channel assignments
-    string line;
-    MusicSection *currentSectionPtr = nullptr;
-
-    while (getline(file, line))
+    // Bad records are skipped; show where they are instead of aborting the load.
+    const size_t maxShown = 10;
+    for (size_t i = 0; i < errors.size() && i < maxShown; ++i)
     {
-        if (line.find("[SECTION") == 0)
-        {
-            // Extract section name (supports multi-character names)
-            size_t start = line.find(' ') + 1;
-            size_t end = line.find(']');
-            string sectionName = line.substr(start, end - start);
-            
-            MusicSection newSection;
-            newSection.name = sectionName;
-            songSections.push_back(newSection);
-            currentSectionPtr = &songSections.back();
-        }
-        else if (currentSectionPtr && !line.empty())
-        {
-            stringstream ss(line);
-            string part;
-            vector<string> parts;
-            
-            // Split by '|'
-            while (getline(ss, part, '|')) {
-                parts.push_back(part);
-            }
-            
-            if (parts.size() >= 4)
-            {
-                Measure measure;
-                measure.measureNumber = stoi(parts[0]);
-                measure.chord = parts[1];
-                measure.section = currentSectionPtr->name;
-                measure.duration = stoi(parts[3]);
-                
-                // Parse multi-channel instrument data
-                stringstream channelStream(parts[2]);
-                string channelPart;
-                
-                while (getline(channelStream, channelPart, ';'))
-                {
-                    // Each channelPart format: channel:instrument:notes
-                    stringstream channelDetail(channelPart);
-                    string channelStr, instrumentStr, notesStr;
-                    
-                    getline(channelDetail, channelStr, ':');
-                    getline(channelDetail, instrumentStr, ':');
-                    getline(channelDetail, notesStr, ':');
-                    
-                    int channel = stoi(channelStr);
-                    int instrument = stoi(instrumentStr);
-                    
-                    // Store instrument for this channel
-                    channelInstruments[channel] = instrument;
-                    
-                    // Parse notes for this channel
-                    stringstream noteStream(notesStr);
-                    string noteName;
-                    
-                    while (getline(noteStream, noteName, ','))
-                    {
-<<<<<<< Updated upstream
-                        Note n;
-                        n.name = noteName;
-                        n.freq = noteFrequencies[noteName];
-                        n.midiNote = noteToMidi[noteName];
-                        n.duration = measure.duration;
-                        measure.notes.push_back(n);
-=======
-                        if (noteToMidi.find(noteName) != noteToMidi.end())
-                        {
-                            Note n;
-                            n.name = noteName;
-                            n.freq = noteFrequencies[noteName];
-                            n.midiNote = noteToMidi[noteName];
-                            n.duration = measure.duration;
-                            n.channel = channel;
-                            n.instrument = instrument;
-                            n.velocity = 100; // Default velocity
-                            measure.notes.push_back(n);
-                        }
->>>>>>> Stashed changes
-                    }
-                }
-                
-                currentSectionPtr->measures.push_back(measure);
-            }
-        }
+        cout << filename << ":" << errors[i].line << ": " << errors[i].message << "\n";
     }
-    
+    if (errors.size() > maxShown)
+    {
+        cout << "... " << (errors.size() - maxShown) << " more problems skipped\n";
+    }
+
+    // The loaded rows go after the live ones: earlier versions in the edit
+    // history still index the rows before them.
+    const uint32_t rowOffset = songNotes.append(song.notes);
+    for (auto& section : song.sections)
+        for (auto& measure : section.measures)
+            measure.notes.first += rowOffset;
+    // Labels that are not chord symbols are replaced by the chord played.
+    const size_t relabeled = relabelChords(song.sections, songNotes);
+    songSections = move(song.sections);
+    channelInstruments = move(song.channelInstruments); // Replaces old channel assignments
+    songTempo = move(song.tempo);
+    songArrangement = move(song.arrangement);
+    // The whole song changed; loading is undoable like any other edit.
+    songHistory.commitAll("load " + filename, liveSong());
+    sectionRegistry.reindex();
+    markSongChanged();
+
     // Set instruments on all loaded channels
     for (auto& pair : channelInstruments) {
         setInstrumentOnChannel(pair.second, pair.first);
@@ -1010,6 +1105,10 @@ void loadSong()
     
     cout << "Song loaded from " << filename << "! " << songSections.size() << " sections.\n";
     cout << "Instruments loaded on " << channelInstruments.size() << " channels.\n";
+    if (relabeled)
+    {
+        cout << relabeled << " measures relabeled with the chord they play.\n";
+    }
 }
 
 // Prints selected octaves/notes with frequency values for reference.
@@ -1017,22 +1116,16 @@ void listAllNotes()
 {
     cout << "\nAll Available Notes (Octaves 0-8, format: NoteOctave, e.g., C#4, A5):\n";
     cout << string(70, '=') << "\n";
-    vector<string> octaves = {"0", "1", "2", "3", "4", "5", "6", "7", "8"};
-    vector<string> noteNames = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
-
-    for (const auto &octave : octaves)
+    for (int octave = 0; octave <= 8; ++octave)
     {
         cout << "\nOctave " << octave << ":\n";
         cout << "---------\n";
-        for (const auto &noteName : noteNames)
+        for (int pitch = (octave + 1) * 12; pitch < (octave + 2) * 12; ++pitch)
         {
-            string fullNote = noteName + octave;
-            if (noteToMidi.find(fullNote) != noteToMidi.end())
-            {
-                cout << fullNote << " (MIDI: " << noteToMidi[fullNote] << ")\t";
-                if (noteName == "D#" || noteName == "F#" || noteName == "A#")
-                    cout << "\n";
-            }
+            cout << pitchName(pitch) << " (MIDI: " << pitch << ")\t";
+            int pitchClass = pitch % 12;
+            if (pitchClass == 3 || pitchClass == 6 || pitchClass == 10)  // after D#, F#, A#
+                cout << "\n";
         }
         cout << "\n";
     }
@@ -1041,7 +1134,7 @@ void listAllNotes()
 // Creates a batch of measures with randomized content in the active section.
 void generateRandomSection()
 {
-    MusicSection *current = getCurrentSection();
+    const SectionHandle current = getCurrentSection();
 
     int measureCount;
     cout << "How many measures to generate? (1-20): ";
@@ -1054,29 +1147,22 @@ void generateRandomSection()
     }
 
     srand(static_cast<unsigned>(time(nullptr)));
-    vector<string> commonNotes = {"C4", "D4", "E4", "F4", "G4", "A4", "B4", "C5", "D5", "E5"};
+    const size_t firstNew = songSections[current].measures.size();
+    const PitchId commonNotes[] = {60, 62, 64, 65, 67, 69, 71, 72, 74, 76};  // C4..E5, white keys
 
     for (int i = 0; i < measureCount; ++i)
     {
         Measure newMeasure;
-        newMeasure.measureNumber = static_cast<int>(current->measures.size()) + 1;
+        newMeasure.measureNumber = static_cast<int>(songSections[current].measures.size()) + 1;
         newMeasure.section = currentSection;
         newMeasure.chord = "RAND" + to_string(i + 1);
         newMeasure.duration = 300 + (rand() % 400);
 
         // Randomly assign 1-3 channels
+        newMeasure.notes.first = static_cast<uint32_t>(songNotes.size());
         int channelCount = 1 + (rand() % 3);
         for (int ch = 0; ch < channelCount; ++ch)
         {
-<<<<<<< Updated upstream
-            Note n;
-            string noteName = commonNotes[rand() % commonNotes.size()];
-            n.name = noteName;
-            n.freq = noteFrequencies[noteName];
-            n.midiNote = noteToMidi[noteName];
-            n.duration = newMeasure.duration;
-            newMeasure.notes.push_back(n);
-=======
             int channel = ch;
             if (channel == 9) channel = 10; // Skip drum channel
             
@@ -1084,20 +1170,24 @@ void generateRandomSection()
             for (int j = 0; j < noteCount; ++j)
             {
                 Note n;
-                string noteName = commonNotes[rand() % commonNotes.size()];
-                n.name = noteName;
-                n.freq = noteFrequencies[noteName];
-                n.midiNote = noteToMidi[noteName];
+                n.midiNote = commonNotes[rand() % (sizeof(commonNotes) / sizeof(commonNotes[0]))];
                 n.duration = newMeasure.duration;
                 n.channel = channel;
                 n.instrument = channelInstruments[channel];
                 n.velocity = 80 + (rand() % 47);
-                newMeasure.notes.push_back(n);
+                songNotes.append(n);
+                ++newMeasure.notes.count;
             }
->>>>>>> Stashed changes
         }
-        current->measures.push_back(newMeasure);
+        // Name the measure after its chord when the notes happen to form one.
+        string harmony = measureChordName(newMeasure, songNotes);
+        if (!harmony.empty())
+            newMeasure.chord = harmony;
+        songSections[current].measures.push_back(newMeasure);
     }
+    // One undo step for the whole batch.
+    recordEdit("generate " + to_string(measureCount) + " measures in Section " + currentSection,
+               current, firstNew);
     cout << "Generated " << measureCount << " random multi-instrument measures in Section " << currentSection << "!\n";
 }
 
@@ -1105,7 +1195,7 @@ void generateRandomSection()
 void playHappyBirthday()
 {
     cout << "\nPlaying Happy Birthday...\n";
-    cout << "Press 'p' to pause, 'r' to resume, 's' to stop\n";
+    printPlaybackKeys();
     cout << string(25, '=') << "\n";
 
     // Happy Birthday melody notes with MIDI note numbers
@@ -1116,50 +1206,116 @@ void playHappyBirthday()
         {77, 250}, {77, 250}, {76, 500}, {72, 500}, {74, 500}, {72, 500}
     };
 
-    stopPlayback = false;
-    playbackState = STATE_PLAYING;
-
+    // One measure per note on channel 0, with the channel's current instrument,
+    // so the melody plays through the same transport as a song.
+    int instrument = channelInstruments.count(0) ? channelInstruments[0] : INSTRUMENT_PIANO;
+    vector<MusicSection> tune(1);
+    NoteArena tuneNotes;
+    tune[0].name = "HAPPY BIRTHDAY";
     for (const auto &note : melody)
     {
-        if (stopPlayback) break;
-        
-        while (playbackState == STATE_PAUSED) {
-            Sleep(50);
-            checkPlaybackControl();
-            if (stopPlayback) break;
-        }
-        if (stopPlayback) break;
+        Measure measure;
+        measure.measureNumber = static_cast<int>(tune[0].measures.size()) + 1;
+        measure.section = tune[0].name;
+        measure.duration = note.second;
+        Note n;
+        n.midiNote = static_cast<PitchId>(note.first);
+        n.channel = 0;
+        n.instrument = static_cast<uint8_t>(instrument);
+        n.velocity = 100;
+        n.duration = note.second;
+        measure.notes = {tuneNotes.append(n), 1};
+        tune[0].measures.push_back(measure);
+    }
 
-        int midiNote = note.first;
-        int duration = note.second;
+    Timeline timeline = compileTimeline(tune, tuneNotes);
+    bool finished = playTimelineRange(timeline, 0, timeline.events.size(), [&tune, &tuneNotes](const TimelineEvent &ev) {
+        const Measure &measure = tune[0].measures[ev.measure];
+        cout << "Playing: MIDI Note " << int(tuneNotes.pitch()[measure.notes.first]) << " (" << measure.duration << " ticks)\n";
+    });
 
-        cout << "Playing: MIDI Note " << midiNote << " (" << duration << "ms)\n";
-        
-        // Play the note on channel 0 (piano)
-        playMIDINote(midiNote, 100, 0);
-        
-        // Wait for the duration while checking for user input
-        DWORD startTime = GetTickCount();
-        while ((GetTickCount() - startTime) < static_cast<DWORD>(duration)) {
-            checkPlaybackControl();
-            if (stopPlayback || playbackState == STATE_PAUSED) break;
-            Sleep(50);
-        }
-        
-        // Stop the note
-        stopMIDINote(midiNote, 0);
-        
-        Sleep(1); // brief pause between notes
-    }
-    
-    playbackState = STATE_STOPPED;
-    if (!stopPlayback) {
+    if (finished) {
         cout << "Finished playing Happy Birthday!\n";
     } else {
         cout << "Playback stopped!\n";
     }
 }
 
+// Renders every section offline with the built-in synth or a SoundFont; no
+// MIDI device needed.
+void renderSongToWav()
+{
+    if (songSections.empty())
+    {
+        cout << "No song to render!\n";
+        return;
+    }
+
+    string filename;
+    cout << "Enter filename (or press Enter for song.wav): ";
+    cin.ignore();
+    getline(cin, filename);
+
+    if (filename.empty())
+    {
+        filename = "song.wav";
+    }
+
+    string soundFontPath;
+    cout << "SoundFont (.sf2) to play, or press Enter for the built-in synth: ";
+    getline(cin, soundFontPath);
+
+    RenderSettings settings;
+    SoundFont soundFont;
+    if (!soundFontPath.empty())
+    {
+        string error;
+        if (!soundFont.open(soundFontPath, error))
+        {
+            cout << "Error loading SoundFont: " << error << "\n";
+            return;
+        }
+        settings.soundFont = &soundFont;
+    }
+
+    clock_t start = clock();
+    if (!renderTimelineToWavFile(songTimeline(), filename, settings))
+    {
+        cout << "Error writing " << filename << "\n";
+        return;
+    }
+    double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    cout << "Rendered song to " << filename << " in " << fixed << setprecision(2)
+         << seconds << "s\n";
+}
+
+void exportSongToMidi()
+{
+    if (songSections.empty())
+    {
+        cout << "No song to export!\n";
+        return;
+    }
+
+    string filename;
+    cout << "Enter filename (or press Enter for song.mid): ";
+    cin.ignore();
+    getline(cin, filename);
+
+    if (filename.empty())
+    {
+        filename = "song.mid";
+    }
+
+    string error;
+    if (!exportMidiFile(songSections, songTimeline(), channelInstruments, filename, error))
+    {
+        cout << "Error exporting MIDI: " << error << "\n";
+        return;
+    }
+    cout << "Song exported to " << filename << " (Standard MIDI File, type 1)\n";
+}
+
 // New functions for enhanced features
 void showInstruments() {
     cout << "\nAvailable Instruments:\n";
@@ -1201,6 +1357,7 @@ void changeInstrument() {
     if (instrument >= 0 && instrument <= 127) {
         channelInstruments[channel] = instrument;
         setInstrumentOnChannel(instrument, channel);
+        recordEdit("set Ch" + to_string(channel) + " instrument");
         cout << "Channel " << channel << " changed to instrument " << instrument << "\n";
     } else {
         cout << "Invalid instrument number (0-127)\n";
@@ -1208,26 +1365,18 @@ void changeInstrument() {
 }
 
 void pausePlayback() {
-    if (playbackState == STATE_PLAYING) {
-        playbackState = STATE_PAUSED;
+    if (activeTransport && activeTransport->state() == TRANSPORT_PLAYING) {
+        // The transport silences the sounding notes itself.
+        activeTransport->pause();
         cout << "Playback paused\n";
-        
-        // Stop all notes when pausing
-        for (const auto& section : songSections) {
-            for (const auto& measure : section.measures) {
-                for (const auto& note : measure.notes) {
-                    stopMIDINote(note.midiNote, note.channel);
-                }
-            }
-        }
     } else {
         cout << "No playback to pause\n";
     }
 }
 
 void resumePlayback() {
-    if (playbackState == STATE_PAUSED) {
-        playbackState = STATE_PLAYING;
+    if (activeTransport && activeTransport->state() == TRANSPORT_PAUSED) {
+        activeTransport->resume();
         cout << "Playback resumed\n";
     } else {
         cout << "No playback to resume\n";
@@ -1235,37 +1384,81 @@ void resumePlayback() {
 }
 
 void stopPlaybackCommand() {
-    stopPlayback = true;
-    playbackState = STATE_STOPPED;
-    
-    // Stop all notes immediately
-    for (const auto& section : songSections) {
-        for (const auto& measure : section.measures) {
-            for (const auto& note : measure.notes) {
-                stopMIDINote(note.midiNote, note.channel);
-            }
-        }
+    if (!activeTransport) {
+        // Nothing is playing, but notes started directly may still hang.
+        silenceAllNotes();
+        cout << "No playback to stop\n";
+        return;
     }
-    
+    stopRequested = true;
+    activeTransport->stop();
     cout << "Playback stopped\n";
 }
 
+// Moves the playhead by deltaUs (negative seeks backwards).
+static void seekPlayback(int64_t deltaUs) {
+    if (!activeTransport) return;
+    int64_t target = max<int64_t>(0, activeTransport->positionUs() + deltaUs);
+    activeTransport->seek(target);
+    cout << "Seek to " << fixed << setprecision(1) << target / 1e6 << "s\n";
+}
+
+// Jumps delta measures from the one at the playhead (negative jumps back).
+static void jumpMeasures(int delta) {
+    if (!activeTransport || !activeTimeline || activeTimeline->measures.empty()) return;
+    const Timeline &timeline = *activeTimeline;
+    int64_t target = static_cast<int64_t>(findMeasureAt(timeline, activeRangeStartUs + activeTransport->positionUs())) + delta;
+    target = max<int64_t>(0, min<int64_t>(target, static_cast<int64_t>(timeline.measures.size()) - 1));
+    const TimelineMeasure &tm = timeline.measures[static_cast<size_t>(target)];
+    activeTransport->seek(max<int64_t>(0, tm.startUs - activeRangeStartUs));
+    cout << "Jump to " << songSections[tm.section].name << " measure " << tm.measure + 1 << "\n";
+}
+
+static void changeTempo(int deltaPercent) {
+    if (!activeTransport) return;
+    int percent = max(10, min(400, activeTransport->tempoPercent() + deltaPercent));
+    activeTransport->setTempo(percent);
+    cout << "Tempo " << percent << "%\n";
+}
+
+void handlePlaybackKey(char ch) {
+    switch(ch) {
+        case 'p': 
+        case 'P':
+            pausePlayback();
+            break;
+        case 'r':
+        case 'R':
+            resumePlayback();
+            break;
+        case 's':
+        case 'S':
+            stopPlaybackCommand();
+            break;
+        case '[':
+            seekPlayback(-SEEK_STEP_US);
+            break;
+        case ']':
+            seekPlayback(SEEK_STEP_US);
+            break;
+        case ',':
+            jumpMeasures(-1);
+            break;
+        case '.':
+            jumpMeasures(1);
+            break;
+        case '-':
+            changeTempo(-10);
+            break;
+        case '+':
+        case '=':
+            changeTempo(10);
+            break;
+    }
+}
+
 void checkPlaybackControl() {
     if (_kbhit()) {
-        char ch = _getch();
-        switch(ch) {
-            case 'p': 
-            case 'P':
-                pausePlayback();
-                break;
-            case 'r':
-            case 'R':
-                resumePlayback();
-                break;
-            case 's':
-            case 'S':
-                stopPlaybackCommand();
-                break;
-        }
+        handlePlaybackKey(static_cast<char>(_getch()));
     }
-}
\ No newline at end of file
+}
@@ -2,9 +2,10 @@
 #ifndef MUSIC_H
 #define MUSIC_H
 
-// Public interface and core data types for the terminal music composer.
-// Split into: (1) data structures, (2) globals (declared here, defined in music.cpp),
-// and (3) function declarations used by main.cpp and other translation units.
+// Public interface for the terminal music composer.
+// Split into: (1) globals (declared here, defined in music.cpp) and
+// (2) function declarations used by main.cpp and other translation units.
+// The song data structures themselves live in song.h.
 
 #include <iostream>
 #include <vector>
@@ -21,115 +22,65 @@
 #include <mmsystem.h>
 #include <conio.h>
 
+#include "song.h"
+#include "output.h"
+#include "section_registry.h"
+#include "timeline.h"
+
 #pragma comment(lib, "winmm.lib")
 
 using namespace std;
 
-// MIDI Instrument Constants
-enum MIDIInstruments {
-    INSTRUMENT_PIANO = 0,
-    INSTRUMENT_SYNTH = 80,
-    INSTRUMENT_ORGAN = 16,
-    INSTRUMENT_GUITAR = 24,
-    INSTRUMENT_BASS = 32,
-    INSTRUMENT_STRINGS = 48,
-    INSTRUMENT_TRUMPET = 56,
-    INSTRUMENT_SAXOPHONE = 65,
-    INSTRUMENT_FLUTE = 73,
-<<<<<<< Updated upstream
-    INSTRUMENT_DRUM_KIT = 0  // Channel 10 for drums
-=======
-    INSTRUMENT_DRUM_KIT = 0,  // Channel 10 for drums
-    INSTRUMENT_CHOIR = 52,
-    INSTRUMENT_FRENCH_HORN = 60,
-    INSTRUMENT_ORCHESTRA_HIT = 55,
-    INSTRUMENT_ELECTRIC_BASS = 33,
-    INSTRUMENT_CELLO = 42
->>>>>>> Stashed changes
-};
-
-// Playback control states
-enum PlaybackState {
-    STATE_STOPPED,
-    STATE_PLAYING,
-    STATE_PAUSED
-};
-
-<<<<<<< Updated upstream
-// Represents a single tone.
-// name: symbolic note (e.g., "A4"); freq: frequency in Hz; duration: milliseconds.
-=======
-// Represents a single tone with channel assignment
->>>>>>> Stashed changes
-struct Note {
-    string name;
-    int freq;
-    int duration;
-<<<<<<< Updated upstream
-    int midiNote;  // MIDI note number (0-127)
-};
-
-// Represents a musical measure.
-// chord: label for the harmony; notes: tones played in the measure;
-// measureNumber: order within the section; section: owning section label;
-// duration: default duration for notes in this measure (ms).
-=======
-    int midiNote;
-    int channel;      // MIDI channel (0-15)
-    int instrument;   // Instrument for this channel
-    int velocity;     // Note volume (0-127)
-};
-
-// Represents a musical measure.
->>>>>>> Stashed changes
-struct Measure {
-    string chord;
-    vector<Note> notes;
-    int measureNumber;
-    string section;
-    int duration;
-};
-
-<<<<<<< Updated upstream
-// A labeled section of a song (e.g., "A", "B") containing ordered measures.
-=======
-// A labeled section of a song
->>>>>>> Stashed changes
-struct MusicSection {
-    string name;
-    vector<Measure> measures;
-};
-
 // ===== Global state (defined in music.cpp) =====
-<<<<<<< Updated upstream
-// Mapping from note names (e.g., "C#4") to frequencies in Hz.
-extern map<string, int> noteFrequencies;
-// Mapping from note names to MIDI note numbers
-extern map<string, int> noteToMidi;
-// Named chord → list of note names that form the chord.
-extern map<string, vector<string>> chordDefinitions;
 // Ordered collection of all sections in the song.
 extern vector<MusicSection> songSections;
+// Column-wise note rows the measures' note ranges point into.
+extern NoteArena songNotes;
 // Name of the active section (e.g., "A").
 extern string currentSection;
-// Current playback state
-extern PlaybackState playbackState;
 // Current instrument
 extern int currentInstrument;
-// Flag to stop playback
-extern bool stopPlayback;
+// Tempo and time signature changes of the song (ticks, see tempo.h)
+extern TempoTrack songTempo;
+// Play order of the sections (repeats, endings, D.C./coda); empty = file order
+extern Arrangement songArrangement;
+// Instrument assigned to each channel in use (channel -> instrument)
+extern map<int, int> channelInstruments;
+// Incremented on every edit; cached derived data compares against it
+extern uint64_t songRevision;
+// Destination for all MIDI messages (device, capture or null sink)
+extern EventSink* outputSink;
+
+// ===== Song revision / compiled timeline =====
+// Must be called after any change to songSections.
+void markSongChanged();
+// Compiled event timeline for songSections; recompiled only after markSongChanged().
+const Timeline& songTimeline();
+
+// ===== Edit history =====
+// Makes the current song the first version (call once at start-up).
+void resetHistory();
+// Steps back / forward through the edits made since; loading a song is one of them.
+void undoEdit();
+void redoEdit();
 
 // ===== MIDI Functions =====
 // Initialize MIDI
 void initMIDI();
 // Close MIDI
 void closeMIDI();
+// Route MIDI messages to another sink (nullptr restores the null sink)
+void setOutputSink(EventSink* sink);
 // Set MIDI instrument
 void setInstrument(int instrument);
+// Set MIDI instrument on a specific channel
+void setInstrumentOnChannel(int instrument, int channel);
 // Play a MIDI note
 void playMIDINote(int note, int velocity = 127, int channel = 0);
 // Stop a MIDI note
 void stopMIDINote(int note, int channel = 0);
+// Panic: note-off for every note started with playMIDINote that is still on
+void silenceAllNotes();
 // Play multiple MIDI notes simultaneously
 void playMIDIChord(const vector<int>& notes, int velocity = 127, int channel = 0);
 // Stop multiple MIDI notes simultaneously
@@ -139,16 +90,17 @@ void stopMIDIChord(const vector<int>& notes, int channel = 0);
 // Prints the text menu and shows current section.
 void showMenu();
 
-// Returns pointer to the active section; creates it if missing.
-MusicSection* getCurrentSection();
+// Returns the handle of the active section; creates it if missing. Index
+// songSections with it where needed rather than keeping a pointer.
+SectionHandle getCurrentSection();
 
 // Pretty-prints all sections and measures to stdout.
 void printMusicSheet();
 
-// Lists supported chord names available for quick entry.
+// Lists the chord qualities and the chord symbol syntax (chord.h).
 void listCommonChords();
 
-// Adds a full measure by selecting a known chord name.
+// Adds a full measure spelled from a chord symbol such as EbMIN7 or C7/E.
 void addChordByName();
 
 // Adds a measure by manually entering chord, duration, and notes.
@@ -160,9 +112,18 @@ void playNote(int frequency, int duration);
 // Plays all measures in the requested section by name.
 void playSection(const string& sectionName);
 
-// Plays all sections in order.
+// Plays the song in arrangement order.
 void playEntireSong();
 
+// Plays the song starting at a chosen section and measure.
+void playFromMeasure();
+
+// Sets the song tempo from a section on, or for the whole song.
+void setSongTempo();
+
+// Shows and replaces the song's arrangement (see arrangement.h for the form).
+void editArrangement();
+
 // Creates a new section (e.g., "B") and switches to it.
 void addNewSection();
 
@@ -172,7 +133,7 @@ void switchSection();
 // Saves all sections/measures to a simple text file.
 void saveSong();
 
-// Loads sections/measures from a previously saved text file.
+// Loads sections/measures from a song sheet, a .mmsb binary song or a .mid file.
 void loadSong();
 
 // Lists a curated range of notes with their frequencies.
@@ -183,46 +144,12 @@ void generateRandomSection();
 
 void playHappyBirthday();
 
-=======
-extern map<string, int> noteFrequencies;
-extern map<string, int> noteToMidi;
-extern map<string, vector<string>> chordDefinitions;
-extern vector<MusicSection> songSections;
-extern string currentSection;
-extern PlaybackState playbackState;
-extern int currentInstrument;
-extern bool stopPlayback;
-extern map<int, int> channelInstruments;  // channel -> instrument
+// Renders the whole song offline with the built-in synth and writes a WAV file.
+void renderSongToWav();
 
-// ===== MIDI Functions =====
-void initMIDI();
-void closeMIDI();
-void setInstrument(int instrument);
-void setInstrumentOnChannel(int instrument, int channel);
-void playMIDINote(int note, int velocity = 127, int channel = 0);
-void stopMIDINote(int note, int channel = 0);
-void playMIDIChord(const vector<int>& notes, int velocity = 127, int channel = 0);
-void stopMIDIChord(const vector<int>& notes, int channel = 0);
-
-// ===== UI / Control =====
-void showMenu();
-MusicSection* getCurrentSection();
-void printMusicSheet();
-void listCommonChords();
-void addChordByName();
-void addMeasure();
-void playNote(int frequency, int duration);
-void playSection(const string& sectionName);
-void playEntireSong();
-void addNewSection();
-void switchSection();
-void saveSong();
-void loadSong();
-void listAllNotes();
-void generateRandomSection();
-void playHappyBirthday();
+// Exports the whole song as a Standard MIDI File.
+void exportSongToMidi();
 
->>>>>>> Stashed changes
 // New functions for enhanced features
 void changeInstrument();
 void showInstruments();
@@ -230,11 +157,10 @@ void pausePlayback();
 void resumePlayback();
 void stopPlaybackCommand();
 void checkPlaybackControl();
-<<<<<<< Updated upstream
-=======
+void handlePlaybackKey(char key);
 void setupChannelInstruments();
+void resetChannelInstruments();   // Menu: defaults again, as one undoable edit
 void showChannelStatus();
 void addMultiInstrumentMeasure();
->>>>>>> Stashed changes
 
-#endif // MUSIC_H
\ No newline at end of file
+#endif // MUSIC_H
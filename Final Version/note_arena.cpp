@@ -0,0 +1,126 @@
+// note_arena.cpp
+// Growth and row access for the column-wise note store.
+
+#include "note_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+NoteArena::NoteArena(const NoteArena& other)
+{
+    *this = other;
+}
+
+NoteArena& NoteArena::operator=(const NoteArena& other)
+{
+    if (this == &other)
+        return *this;
+    clear();
+    if (other.rows) {
+        reserve(other.rows);
+        append(other);
+    }
+    return *this;
+}
+
+NoteArena::NoteArena(NoteArena&& other) noexcept
+    : block(move(other.block)), rows(other.rows), capacity(other.capacity)
+{
+    other.rows = other.capacity = 0;
+}
+
+NoteArena& NoteArena::operator=(NoteArena&& other) noexcept
+{
+    block = move(other.block);
+    rows = other.rows;
+    capacity = other.capacity;
+    other.rows = other.capacity = 0;
+    return *this;
+}
+
+void NoteArena::reserve(size_t rowCount)
+{
+    if (rowCount > capacity)
+        grow(rowCount);
+}
+
+void NoteArena::clear()
+{
+    block.reset();
+    rows = capacity = 0;
+}
+
+void NoteArena::grow(size_t rowCount)
+{
+    size_t newCapacity = max<size_t>(rowCount, max<size_t>(64, capacity * 2));
+    unique_ptr<int32_t[]> newBlock(new int32_t[newCapacity * 3]);
+    if (rows) {
+        memcpy(newBlock.get(), onset(), rows * sizeof(int32_t));
+        memcpy(newBlock.get() + newCapacity, duration(), rows * sizeof(int32_t));
+        uint8_t* newBytes = reinterpret_cast<uint8_t*>(newBlock.get() + 2 * newCapacity);
+        for (size_t k = 0; k < 4; ++k)
+            memcpy(newBytes + k * newCapacity, bytes(k), rows);
+    }
+    block = move(newBlock);
+    capacity = newCapacity;
+}
+
+uint32_t NoteArena::append(const Note& note)
+{
+    if (rows == capacity)
+        grow(rows + 1);
+    onset()[rows] = note.onset;
+    duration()[rows] = note.duration;
+    pitch()[rows] = note.midiNote;
+    velocity()[rows] = note.velocity;
+    channel()[rows] = note.channel;
+    instrument()[rows] = note.instrument;
+    return static_cast<uint32_t>(rows++);
+}
+
+NoteRange NoteArena::append(const vector<Note>& notes)
+{
+    NoteRange range;
+    range.first = static_cast<uint32_t>(rows);
+    range.count = static_cast<uint32_t>(notes.size());
+    reserve(rows + notes.size());
+    for (const Note& note : notes)
+        append(note);
+    return range;
+}
+
+uint32_t NoteArena::append(const NoteArena& other)
+{
+    uint32_t first = static_cast<uint32_t>(rows);
+    if (!other.rows)
+        return first;
+    reserve(rows + other.rows);
+    memcpy(onset() + rows, other.onset(), other.rows * sizeof(int32_t));
+    memcpy(duration() + rows, other.duration(), other.rows * sizeof(int32_t));
+    for (size_t k = 0; k < 4; ++k)
+        memcpy(bytes(k) + rows, other.bytes(k), other.rows);
+    rows += other.rows;
+    return first;
+}
+
+Note NoteArena::row(size_t i) const
+{
+    Note note;
+    note.midiNote = pitch()[i];
+    note.channel = channel()[i];
+    note.instrument = instrument()[i];
+    note.velocity = velocity()[i];
+    note.duration = duration()[i];
+    note.onset = onset()[i];
+    return note;
+}
+
+void NoteArena::copyRow(size_t from, size_t to)
+{
+    onset()[to] = onset()[from];
+    duration()[to] = duration()[from];
+    for (size_t k = 0; k < 4; ++k)
+        bytes(k)[to] = bytes(k)[from];
+}
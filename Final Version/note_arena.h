@@ -0,0 +1,75 @@
+#pragma once
+#ifndef NOTE_ARENA_H
+#define NOTE_ARENA_H
+
+// Column-wise note storage.
+// A song's notes live in one NoteArena as a structure of arrays: onset,
+// duration, pitch, velocity, channel and instrument each form a contiguous
+// column, and all six columns share a single allocation. Measures hold only a
+// NoteRange of rows, so playback, transpose and export walk memory linearly
+// instead of chasing a vector per measure, and dropping a song is one
+// release. Rows are appended and never reordered, so a range stays valid
+// for the arena's lifetime.
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "song.h"
+
+using namespace std;
+
+class NoteArena {
+public:
+    NoteArena() = default;
+    NoteArena(const NoteArena& other);
+    NoteArena& operator=(const NoteArena& other);
+    NoteArena(NoteArena&& other) noexcept;
+    NoteArena& operator=(NoteArena&& other) noexcept;
+
+    size_t size() const { return rows; }
+    void reserve(size_t rowCount);
+    // Frees the block; every range into the arena becomes invalid.
+    void clear();
+
+    // Appends rows and returns where they landed.
+    uint32_t append(const Note& note);
+    NoteRange append(const vector<Note>& notes);
+    // Appends all rows of other; returns the index other's row 0 now has.
+    uint32_t append(const NoteArena& other);
+
+    // Row i gathered into a Note.
+    Note row(size_t i) const;
+    // Overwrites row to with row from (used to compact a range in place).
+    void copyRow(size_t from, size_t to);
+
+    // Columns, size() entries each.
+    int32_t* onset() { return block.get(); }
+    int32_t* duration() { return block.get() + capacity; }
+    PitchId* pitch() { return bytes(0); }
+    uint8_t* velocity() { return bytes(1); }
+    uint8_t* channel() { return bytes(2); }
+    uint8_t* instrument() { return bytes(3); }
+    const int32_t* onset() const { return block.get(); }
+    const int32_t* duration() const { return block.get() + capacity; }
+    const PitchId* pitch() const { return bytes(0); }
+    const uint8_t* velocity() const { return bytes(1); }
+    const uint8_t* channel() const { return bytes(2); }
+    const uint8_t* instrument() const { return bytes(3); }
+
+private:
+    // Byte column k, after the two int32 columns.
+    uint8_t* bytes(size_t k) const
+    {
+        return reinterpret_cast<uint8_t*>(block.get() + 2 * capacity) + k * capacity;
+    }
+    void grow(size_t rowCount);
+
+    // capacity int32 onsets, capacity int32 durations, then four byte
+    // columns of capacity entries: 12 bytes per row.
+    unique_ptr<int32_t[]> block;
+    size_t rows = 0;
+    size_t capacity = 0;
+};
+
+#endif // NOTE_ARENA_H
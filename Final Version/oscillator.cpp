@@ -0,0 +1,411 @@
+// oscillator.cpp
+// Mipmapped wavetables, PolyBLEP, and the scalar / SSE2 / AVX2 kernels.
+// The vector kernels mirror the scalar code operation for operation; keep
+// them in step when changing any formula. (Bit-identical output also needs
+// the default -ffp-contract behaviour without -mfma, as in the build lines.)
+
+#include "oscillator.h"
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OSC_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const int TABLE_BITS = 11;
+const int TABLE_SIZE = 1 << TABLE_BITS;
+const int FRAC_SHIFT = 32 - TABLE_BITS;
+const uint32_t FRAC_MASK = (1u << FRAC_SHIFT) - 1;
+const float FRAC_SCALE = 1.0f / static_cast<float>(1u << FRAC_SHIFT);
+const float PHASE_SCALE = 1.0f / 16777216.0f;   // 24-bit phase -> [0, 1)
+const float EDGE_LEVEL = 0.85f;                 // Saw/square sit a little below full scale
+const int MIP_LEVELS = 11;                      // Level k keeps harmonics 1 .. 1024 >> k
+const double PI = 3.14159265358979323846;
+
+// One cycle per mip level, each followed by a guard sample so interpolation never wraps.
+struct MipTable {
+    vector<float> samples;
+    int levels;
+
+    const float* level(int k) const { return samples.data() + size_t(k) * (TABLE_SIZE + 1); }
+};
+
+// Sums harmonics with sin(hx) from the Chebyshev recurrence (no per-harmonic sin call).
+MipTable buildMipTable(int levels, double (*amplitude)(int harmonic), double scale)
+{
+    MipTable mip;
+    mip.levels = levels;
+    mip.samples.resize(size_t(levels) * (TABLE_SIZE + 1));
+    for (int k = 0; k < levels; ++k) {
+        int harmonics = (TABLE_SIZE / 2) >> k;
+        float* out = mip.samples.data() + size_t(k) * (TABLE_SIZE + 1);
+        for (int i = 0; i <= TABLE_SIZE; ++i) {
+            double x = 2.0 * PI * i / TABLE_SIZE;
+            double twoCos = 2.0 * cos(x);
+            double prev = 0.0, cur = sin(x), sum = 0.0;
+            for (int h = 1; h <= harmonics; ++h) {
+                sum += amplitude(h) * cur;
+                double next = twoCos * cur - prev;
+                prev = cur;
+                cur = next;
+            }
+            out[i] = static_cast<float>(sum * scale);
+        }
+    }
+    return mip;
+}
+
+double sineHarmonics(int h) { return h == 1 ? 1.0 : 0.0; }
+double triangleHarmonics(int h) { return h % 2 == 1 ? ((h / 2) % 2 == 0 ? 1.0 : -1.0) / (double(h) * h) : 0.0; }
+
+const MipTable& sineTable()
+{
+    static const MipTable table = buildMipTable(1, sineHarmonics, 1.0);
+    return table;
+}
+
+const MipTable& triangleTable()
+{
+    static const MipTable table = buildMipTable(MIP_LEVELS, triangleHarmonics, 8.0 / (PI * PI));
+    return table;
+}
+
+// Lowest mip level whose top harmonic stays under Nyquist (phaseInc = 2^31).
+int mipLevelFor(const MipTable& table, uint32_t phaseInc)
+{
+    for (int k = 0; k < table.levels; ++k) {
+        uint64_t harmonics = uint64_t(TABLE_SIZE / 2) >> k;
+        if (harmonics * phaseInc < (uint64_t(1) << 31))
+            return k;
+    }
+    return table.levels - 1;
+}
+
+// ===== Scalar kernels (reference) =====
+
+// invDt is 1 / dt, computed once per block so no kernel divides per sample.
+float polyBlep(float t, float dt, float invDt)
+{
+    float x;
+    if (t < dt) {
+        x = t * invDt;
+        return x + x - x * x - 1.0f;
+    }
+    if (t > 1.0f - dt) {
+        x = (t - 1.0f) * invDt;
+        return x * x + x + x + 1.0f;
+    }
+    return 0.0f;
+}
+
+void wavetableScalar(const float* table, uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    for (int i = 0; i < frames; ++i) {
+        uint32_t idx = phase >> FRAC_SHIFT;
+        float frac = static_cast<float>(static_cast<int32_t>(phase & FRAC_MASK)) * FRAC_SCALE;
+        float a = table[idx];
+        out[i] = a + (table[idx + 1] - a) * frac;
+        phase += inc;
+    }
+}
+
+void sawScalar(uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    float dt = static_cast<float>(static_cast<int32_t>(inc >> 8)) * PHASE_SCALE;
+    float invDt = dt > 0.0f ? 1.0f / dt : 0.0f;
+    for (int i = 0; i < frames; ++i) {
+        float t = static_cast<float>(static_cast<int32_t>(phase >> 8)) * PHASE_SCALE;
+        float y = t + t - 1.0f;
+        y = y - polyBlep(t, dt, invDt);
+        out[i] = y * EDGE_LEVEL;
+        phase += inc;
+    }
+}
+
+void squareScalar(uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    float dt = static_cast<float>(static_cast<int32_t>(inc >> 8)) * PHASE_SCALE;
+    float invDt = dt > 0.0f ? 1.0f / dt : 0.0f;
+    for (int i = 0; i < frames; ++i) {
+        float t = static_cast<float>(static_cast<int32_t>(phase >> 8)) * PHASE_SCALE;
+        float t2 = static_cast<float>(static_cast<int32_t>((phase + 0x80000000u) >> 8)) * PHASE_SCALE;
+        float y = t < 0.5f ? 1.0f : -1.0f;
+        y = y + polyBlep(t, dt, invDt);
+        y = y - polyBlep(t2, dt, invDt);
+        out[i] = y * EDGE_LEVEL;
+        phase += inc;
+    }
+}
+
+#ifdef OSC_X86
+
+// ===== SSE2 kernels (4 samples per step) =====
+
+__attribute__((target("sse2"))) __m128 polyBlepSSE2(__m128 t, __m128 dt, __m128 invDt)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 x1 = _mm_mul_ps(t, invDt);
+    __m128 b1 = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(x1, x1), _mm_mul_ps(x1, x1)), one);
+    __m128 x2 = _mm_mul_ps(_mm_sub_ps(t, one), invDt);
+    __m128 b2 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x2, x2), x2), x2), one);
+    __m128 m1 = _mm_cmplt_ps(t, dt);
+    __m128 m2 = _mm_andnot_ps(m1, _mm_cmpgt_ps(t, _mm_sub_ps(one, dt)));
+    return _mm_or_ps(_mm_and_ps(m1, b1), _mm_and_ps(m2, b2));
+}
+
+__attribute__((target("sse2"))) __m128 phaseToUnitSSE2(__m128i phase)
+{
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(phase, 8)), _mm_set1_ps(PHASE_SCALE));
+}
+
+__attribute__((target("sse2"))) __m128i phaseLanesSSE2(uint32_t phase, uint32_t inc)
+{
+    return _mm_setr_epi32(int(phase), int(phase + inc), int(phase + 2 * inc), int(phase + 3 * inc));
+}
+
+__attribute__((target("sse2")))
+void wavetableSSE2(const float* table, uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    int vectorFrames = frames & ~3;
+    __m128i ph = phaseLanesSSE2(phase, inc);
+    const __m128i step = _mm_set1_epi32(int(inc * 4));
+    const __m128i mask = _mm_set1_epi32(int(FRAC_MASK));
+    const __m128 scale = _mm_set1_ps(FRAC_SCALE);
+    alignas(16) int32_t idx[4];
+    for (int i = 0; i < vectorFrames; i += 4) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_srli_epi32(ph, FRAC_SHIFT));
+        __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(ph, mask)), scale);
+        __m128 a = _mm_setr_ps(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]);
+        __m128 b = _mm_setr_ps(table[idx[0] + 1], table[idx[1] + 1], table[idx[2] + 1], table[idx[3] + 1]);
+        _mm_storeu_ps(out + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac)));
+        ph = _mm_add_epi32(ph, step);
+    }
+    wavetableScalar(table, phase + uint32_t(vectorFrames) * inc, inc, out + vectorFrames, frames - vectorFrames);
+}
+
+__attribute__((target("sse2")))
+void sawSSE2(uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    int vectorFrames = frames & ~3;
+    __m128i ph = phaseLanesSSE2(phase, inc);
+    const __m128i step = _mm_set1_epi32(int(inc * 4));
+    const float dtScalar = static_cast<float>(static_cast<int32_t>(inc >> 8)) * PHASE_SCALE;
+    const __m128 dt = _mm_set1_ps(dtScalar);
+    const __m128 invDt = _mm_set1_ps(dtScalar > 0.0f ? 1.0f / dtScalar : 0.0f);
+    const __m128 one = _mm_set1_ps(1.0f), level = _mm_set1_ps(EDGE_LEVEL);
+    for (int i = 0; i < vectorFrames; i += 4) {
+        __m128 t = phaseToUnitSSE2(ph);
+        __m128 y = _mm_sub_ps(_mm_add_ps(t, t), one);
+        y = _mm_sub_ps(y, polyBlepSSE2(t, dt, invDt));
+        _mm_storeu_ps(out + i, _mm_mul_ps(y, level));
+        ph = _mm_add_epi32(ph, step);
+    }
+    sawScalar(phase + uint32_t(vectorFrames) * inc, inc, out + vectorFrames, frames - vectorFrames);
+}
+
+__attribute__((target("sse2")))
+void squareSSE2(uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    int vectorFrames = frames & ~3;
+    __m128i ph = phaseLanesSSE2(phase, inc);
+    const __m128i step = _mm_set1_epi32(int(inc * 4));
+    const __m128i half = _mm_set1_epi32(int(0x80000000u));
+    const float dtScalar = static_cast<float>(static_cast<int32_t>(inc >> 8)) * PHASE_SCALE;
+    const __m128 dt = _mm_set1_ps(dtScalar);
+    const __m128 invDt = _mm_set1_ps(dtScalar > 0.0f ? 1.0f / dtScalar : 0.0f);
+    const __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f), halfUnit = _mm_set1_ps(0.5f);
+    const __m128 level = _mm_set1_ps(EDGE_LEVEL);
+    for (int i = 0; i < vectorFrames; i += 4) {
+        __m128 t = phaseToUnitSSE2(ph);
+        __m128 t2 = phaseToUnitSSE2(_mm_add_epi32(ph, half));
+        __m128 low = _mm_cmplt_ps(t, halfUnit);
+        __m128 y = _mm_or_ps(_mm_and_ps(low, one), _mm_andnot_ps(low, minusOne));
+        y = _mm_add_ps(y, polyBlepSSE2(t, dt, invDt));
+        y = _mm_sub_ps(y, polyBlepSSE2(t2, dt, invDt));
+        _mm_storeu_ps(out + i, _mm_mul_ps(y, level));
+        ph = _mm_add_epi32(ph, step);
+    }
+    squareScalar(phase + uint32_t(vectorFrames) * inc, inc, out + vectorFrames, frames - vectorFrames);
+}
+
+// ===== AVX2 kernels (8 samples per step, hardware gathers) =====
+
+__attribute__((target("avx2"))) __m256 polyBlepAVX2(__m256 t, __m256 dt, __m256 invDt)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 x1 = _mm256_mul_ps(t, invDt);
+    __m256 b1 = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(x1, x1), _mm256_mul_ps(x1, x1)), one);
+    __m256 x2 = _mm256_mul_ps(_mm256_sub_ps(t, one), invDt);
+    __m256 b2 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x2, x2), x2), x2), one);
+    __m256 m1 = _mm256_cmp_ps(t, dt, _CMP_LT_OQ);
+    __m256 m2 = _mm256_andnot_ps(m1, _mm256_cmp_ps(t, _mm256_sub_ps(one, dt), _CMP_GT_OQ));
+    return _mm256_or_ps(_mm256_and_ps(m1, b1), _mm256_and_ps(m2, b2));
+}
+
+__attribute__((target("avx2"))) __m256 phaseToUnitAVX2(__m256i phase)
+{
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(phase, 8)), _mm256_set1_ps(PHASE_SCALE));
+}
+
+__attribute__((target("avx2"))) __m256i phaseLanesAVX2(uint32_t phase, uint32_t inc)
+{
+    __m256i lanes = _mm256_mullo_epi32(_mm256_set1_epi32(int(inc)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    return _mm256_add_epi32(_mm256_set1_epi32(int(phase)), lanes);
+}
+
+__attribute__((target("avx2")))
+void wavetableAVX2(const float* table, uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    int vectorFrames = frames & ~7;
+    __m256i ph = phaseLanesAVX2(phase, inc);
+    const __m256i step = _mm256_set1_epi32(int(inc * 8));
+    const __m256i mask = _mm256_set1_epi32(int(FRAC_MASK));
+    const __m256 scale = _mm256_set1_ps(FRAC_SCALE);
+    for (int i = 0; i < vectorFrames; i += 8) {
+        __m256i idx = _mm256_srli_epi32(ph, FRAC_SHIFT);
+        __m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(ph, mask)), scale);
+        __m256 a = _mm256_i32gather_ps(table, idx, 4);
+        __m256 b = _mm256_i32gather_ps(table + 1, idx, 4);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), frac)));
+        ph = _mm256_add_epi32(ph, step);
+    }
+    // Clear the upper YMM halves before running non-VEX scalar code.
+    _mm256_zeroupper();
+    wavetableScalar(table, phase + uint32_t(vectorFrames) * inc, inc, out + vectorFrames, frames - vectorFrames);
+}
+
+__attribute__((target("avx2")))
+void sawAVX2(uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    int vectorFrames = frames & ~7;
+    __m256i ph = phaseLanesAVX2(phase, inc);
+    const __m256i step = _mm256_set1_epi32(int(inc * 8));
+    const float dtScalar = static_cast<float>(static_cast<int32_t>(inc >> 8)) * PHASE_SCALE;
+    const __m256 dt = _mm256_set1_ps(dtScalar);
+    const __m256 invDt = _mm256_set1_ps(dtScalar > 0.0f ? 1.0f / dtScalar : 0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f), level = _mm256_set1_ps(EDGE_LEVEL);
+    for (int i = 0; i < vectorFrames; i += 8) {
+        __m256 t = phaseToUnitAVX2(ph);
+        __m256 y = _mm256_sub_ps(_mm256_add_ps(t, t), one);
+        y = _mm256_sub_ps(y, polyBlepAVX2(t, dt, invDt));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(y, level));
+        ph = _mm256_add_epi32(ph, step);
+    }
+    // Clear the upper YMM halves before running non-VEX scalar code.
+    _mm256_zeroupper();
+    sawScalar(phase + uint32_t(vectorFrames) * inc, inc, out + vectorFrames, frames - vectorFrames);
+}
+
+__attribute__((target("avx2")))
+void squareAVX2(uint32_t phase, uint32_t inc, float* out, int frames)
+{
+    int vectorFrames = frames & ~7;
+    __m256i ph = phaseLanesAVX2(phase, inc);
+    const __m256i step = _mm256_set1_epi32(int(inc * 8));
+    const __m256i half = _mm256_set1_epi32(int(0x80000000u));
+    const float dtScalar = static_cast<float>(static_cast<int32_t>(inc >> 8)) * PHASE_SCALE;
+    const __m256 dt = _mm256_set1_ps(dtScalar);
+    const __m256 invDt = _mm256_set1_ps(dtScalar > 0.0f ? 1.0f / dtScalar : 0.0f);
+    const __m256 one = _mm256_set1_ps(1.0f), minusOne = _mm256_set1_ps(-1.0f), halfUnit = _mm256_set1_ps(0.5f);
+    const __m256 level = _mm256_set1_ps(EDGE_LEVEL);
+    for (int i = 0; i < vectorFrames; i += 8) {
+        __m256 t = phaseToUnitAVX2(ph);
+        __m256 t2 = phaseToUnitAVX2(_mm256_add_epi32(ph, half));
+        __m256 y = _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(t, halfUnit, _CMP_LT_OQ));
+        y = _mm256_add_ps(y, polyBlepAVX2(t, dt, invDt));
+        y = _mm256_sub_ps(y, polyBlepAVX2(t2, dt, invDt));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(y, level));
+        ph = _mm256_add_epi32(ph, step);
+    }
+    // Clear the upper YMM halves before running non-VEX scalar code.
+    _mm256_zeroupper();
+    squareScalar(phase + uint32_t(vectorFrames) * inc, inc, out + vectorFrames, frames - vectorFrames);
+}
+
+#endif // OSC_X86
+
+atomic<int> simdLevel{-1};   // -1 = not chosen yet
+
+} // namespace
+
+SimdLevel detectSimdLevel()
+{
+#ifdef OSC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel activeSimdLevel()
+{
+    int level = simdLevel.load(memory_order_relaxed);
+    if (level < 0) {
+        level = detectSimdLevel();
+        simdLevel.store(level, memory_order_relaxed);
+    }
+    return static_cast<SimdLevel>(level);
+}
+
+void setSimdLevel(SimdLevel level)
+{
+    simdLevel.store(min<int>(level, detectSimdLevel()), memory_order_relaxed);
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void setupOscillator(Oscillator& osc, OscillatorShape shape, double frequency, int sampleRate)
+{
+    osc.shape = shape;
+    osc.phase = 0;
+    double inc = frequency / sampleRate * 4294967296.0;
+    osc.phaseInc = static_cast<uint32_t>(min(inc, 2147483648.0));
+    osc.table = nullptr;
+    if (shape == OSC_SINE)
+        osc.table = sineTable().level(0);
+    else if (shape == OSC_TRIANGLE)
+        osc.table = triangleTable().level(mipLevelFor(triangleTable(), osc.phaseInc));
+}
+
+void renderOscillator(Oscillator& osc, float* out, int frames)
+{
+    SimdLevel level = activeSimdLevel();
+    bool wavetable = (osc.shape == OSC_SINE || osc.shape == OSC_TRIANGLE);
+    switch (level) {
+#ifdef OSC_X86
+        case SIMD_AVX2:
+            if (wavetable) wavetableAVX2(osc.table, osc.phase, osc.phaseInc, out, frames);
+            else if (osc.shape == OSC_SAW) sawAVX2(osc.phase, osc.phaseInc, out, frames);
+            else squareAVX2(osc.phase, osc.phaseInc, out, frames);
+            break;
+        case SIMD_SSE2:
+            if (wavetable) wavetableSSE2(osc.table, osc.phase, osc.phaseInc, out, frames);
+            else if (osc.shape == OSC_SAW) sawSSE2(osc.phase, osc.phaseInc, out, frames);
+            else squareSSE2(osc.phase, osc.phaseInc, out, frames);
+            break;
+#endif
+        default:
+            if (wavetable) wavetableScalar(osc.table, osc.phase, osc.phaseInc, out, frames);
+            else if (osc.shape == OSC_SAW) sawScalar(osc.phase, osc.phaseInc, out, frames);
+            else squareScalar(osc.phase, osc.phaseInc, out, frames);
+            break;
+    }
+    osc.phase += static_cast<uint32_t>(frames) * osc.phaseInc;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef OSCILLATOR_H
+#define OSCILLATOR_H
+
+// Band-limited oscillators for the software synth.
+//
+//   Sine, triangle   mipmapped wavetables: one table per octave band, each
+//                    holding only the harmonics that stay below Nyquist for
+//                    the notes that use it
+//   Saw, square      PolyBLEP: the naive waveform with a two-sample polynomial
+//                    correction at each discontinuity
+//
+// Kernels render one voice many samples at a time. AVX2 (8 lanes) and SSE2
+// (4 lanes) versions are chosen at runtime; the scalar fallback performs the
+// same float operations in the same order, so all paths produce bit-identical
+// output.
+
+#include <cstdint>
+
+enum OscillatorShape { OSC_SINE, OSC_TRIANGLE, OSC_SAW, OSC_SQUARE };
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+struct Oscillator {
+    OscillatorShape shape;
+    const float* table;   // Mip level for wavetable shapes, null otherwise
+    uint32_t phase;       // 0..2^32 is one cycle
+    uint32_t phaseInc;
+};
+
+// Prepares osc for a note; picks the mip level for frequency.
+void setupOscillator(Oscillator& osc, OscillatorShape shape, double frequency, int sampleRate);
+
+// Writes frames samples (range about -1..1) to out and advances the phase.
+void renderOscillator(Oscillator& osc, float* out, int frames);
+
+// Best level the CPU supports.
+SimdLevel detectSimdLevel();
+// Level the kernels currently use (detectSimdLevel() unless overridden).
+SimdLevel activeSimdLevel();
+// Forces a kernel level, e.g. to compare paths; clamped to what the CPU supports.
+void setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+#endif // OSCILLATOR_H
@@ -0,0 +1,184 @@
+// output.cpp
+// Event sink implementations: null, in-memory capture and threaded device output.
+
+#include "output.h"
+
+using namespace std;
+
+// ===== Event helpers =====
+MidiEvent noteOnEvent(int channel, int note, int velocity)
+{
+    return {static_cast<uint8_t>(0x90 | (channel & 0x0F)), static_cast<uint8_t>(note & 0x7F),
+            static_cast<uint8_t>(velocity & 0x7F)};
+}
+
+MidiEvent noteOffEvent(int channel, int note)
+{
+    return {static_cast<uint8_t>(0x80 | (channel & 0x0F)), static_cast<uint8_t>(note & 0x7F), 0};
+}
+
+MidiEvent programChangeEvent(int channel, int program)
+{
+    return {static_cast<uint8_t>(0xC0 | (channel & 0x0F)), static_cast<uint8_t>(program & 0x7F), 0};
+}
+
+MidiEvent controlChangeEvent(int channel, int controller, int value)
+{
+    return {static_cast<uint8_t>(0xB0 | (channel & 0x0F)), static_cast<uint8_t>(controller & 0x7F),
+            static_cast<uint8_t>(value & 0x7F)};
+}
+
+// ===== ActiveNotes =====
+namespace {
+
+int popCount(uint64_t w)
+{
+    int n = 0;
+    for (; w; w &= w - 1)
+        ++n;
+    return n;
+}
+
+} // namespace
+
+void ActiveNotes::track(const MidiEvent& event)
+{
+    int type = event.status & 0xF0;
+    int ch = event.status & 0x0F;
+    int note = event.data1 & 0x7F;
+    uint64_t mask = uint64_t(1) << (note & 63);
+    if (type == 0x90 && event.data2 > 0) {
+        bits[ch][note >> 6] |= mask;
+        channels |= static_cast<uint16_t>(1u << ch);
+    } else if (type == 0x80 || type == 0x90) {
+        bits[ch][note >> 6] &= ~mask;
+        if (!bits[ch][0] && !bits[ch][1])
+            channels &= static_cast<uint16_t>(~(1u << ch));
+    } else if (type == 0xB0 && event.data1 == CC_ALL_NOTES_OFF) {
+        bits[ch][0] = bits[ch][1] = 0;
+        channels &= static_cast<uint16_t>(~(1u << ch));
+    }
+}
+
+bool ActiveNotes::isOn(int channel, int note) const
+{
+    return (bits[channel & 0x0F][(note >> 6) & 1] >> (note & 63)) & 1;
+}
+
+size_t ActiveNotes::count() const
+{
+    size_t n = 0;
+    for (int ch = 0; ch < 16; ++ch)
+        n += popCount(bits[ch][0]) + popCount(bits[ch][1]);
+    return n;
+}
+
+void ActiveNotes::clear()
+{
+    for (auto& channel : bits)
+        channel[0] = channel[1] = 0;
+    channels = 0;
+}
+
+void ActiveNotes::releaseAll(EventSink& sink)
+{
+    uint16_t bulk = 0;   // Channels silenced with one All Notes Off
+    for (int ch = 0; ch < 16; ++ch) {
+        if ((channels & (1u << ch)) && popCount(bits[ch][0]) + popCount(bits[ch][1]) > ALL_NOTES_OFF_THRESHOLD) {
+            sink.send(controlChangeEvent(ch, CC_ALL_NOTES_OFF, 0));
+            bulk |= static_cast<uint16_t>(1u << ch);
+        }
+    }
+    forEach([&](int ch, int note) {
+        if (!(bulk & (1u << ch)))
+            sink.send(noteOffEvent(ch, note));
+    });
+    clear();
+}
+
+// ===== CaptureSink =====
+CaptureSink::CaptureSink() : start(chrono::steady_clock::now())
+{
+}
+
+void CaptureSink::send(const MidiEvent& event)
+{
+    int64_t us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    captured.push_back({event, us});
+}
+
+void CaptureSink::clear()
+{
+    captured.clear();
+    start = chrono::steady_clock::now();
+}
+
+// ===== DeviceSink =====
+DeviceSink::DeviceSink(function<void(uint32_t)> driverFn)
+    : driver(move(driverFn)), workerWaiting(false), stopping(false), delivered(0), sent(0)
+{
+    worker = thread(&DeviceSink::run, this);
+}
+
+DeviceSink::~DeviceSink()
+{
+    flush();
+    stopping.store(true);
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    worker.join();
+}
+
+void DeviceSink::send(const MidiEvent& event)
+{
+    // The ring only fills if the driver stalls for ~1000 events; back off rather than drop
+    // (a lost note-off would leave a note hanging).
+    while (!queue.tryPush(event))
+        this_thread::yield();
+    ++sent;
+
+    // Only pay for the mutex when the device thread is actually asleep. The
+    // fence pairs with the one in run() so the ring's release store and the
+    // flag load cannot pass each other and both sides miss the event.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (workerWaiting.load()) {
+        lock_guard<mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+}
+
+void DeviceSink::flush()
+{
+    while (delivered.load(memory_order_acquire) < sent) {
+        // Wake the worker outright, so waiting here never depends on send()
+        // having won its race with the worker going to sleep.
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+}
+
+void DeviceSink::run()
+{
+    MidiEvent event;
+    while (true) {
+        while (queue.tryPop(event)) {
+            driver(event.packed());
+            delivered.fetch_add(1, memory_order_release);
+        }
+
+        unique_lock<mutex> lock(wakeMutex);
+        workerWaiting.store(true);
+        atomic_thread_fence(memory_order_seq_cst);
+        // Re-check after publishing workerWaiting: either the producer sees the
+        // flag and notifies under the lock, or we see its event here.
+        wake.wait(lock, [this] { return stopping.load() || !queue.empty(); });
+        workerWaiting.store(false);
+        if (stopping.load() && queue.empty())
+            return;
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+// Output backends for MIDI events.
+// The playback code talks to an EventSink instead of a device handle, so the
+// same scheduler can drive a real device, capture events for tests/exports,
+// or discard them entirely.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ring_buffer.h"
+
+using namespace std;
+
+// A three-byte MIDI channel message.
+struct MidiEvent {
+    uint8_t status;   // Message type in the high nibble, channel in the low nibble
+    uint8_t data1;    // Note number or program
+    uint8_t data2;    // Velocity (unused for program change)
+
+    // Packed the way midiOutShortMsg expects: status | data1 << 8 | data2 << 16.
+    uint32_t packed() const { return status | (data1 << 8) | (data2 << 16); }
+};
+
+MidiEvent noteOnEvent(int channel, int note, int velocity);
+MidiEvent noteOffEvent(int channel, int note);
+MidiEvent programChangeEvent(int channel, int program);
+MidiEvent controlChangeEvent(int channel, int controller, int value);
+
+// Controller that silences every note on a channel.
+const int CC_ALL_NOTES_OFF = 123;
+
+// Abstract destination for MIDI events.
+class EventSink {
+public:
+    virtual ~EventSink() {}
+    // Delivers one event. Implementations must not block for long.
+    virtual void send(const MidiEvent& event) = 0;
+    // Waits until every event sent so far has been delivered.
+    virtual void flush() {}
+};
+
+// Which notes are sounding on one output: a 16 x 128 bitmap updated from
+// every note-on and note-off sent to it. Silencing the output then costs one
+// message per sounding note instead of one per note in the song.
+class ActiveNotes {
+public:
+    // Channels with more sounding notes than this get one All Notes Off.
+    static const int ALL_NOTES_OFF_THRESHOLD = 8;
+
+    // Updates the bitmap from a channel message (note on/off, All Notes Off).
+    void track(const MidiEvent& event);
+    bool isOn(int channel, int note) const;
+    size_t count() const;
+    bool empty() const { return channels == 0; }
+    void clear();
+
+    // Calls f(channel, note) for each sounding note, in channel/note order.
+    template <typename F>
+    void forEach(F f) const;
+
+    // Sends a note-off for each sounding note to sink (one All Notes Off for
+    // crowded channels) and clears the bitmap.
+    void releaseAll(EventSink& sink);
+
+private:
+    uint64_t bits[16][2] = {};
+    uint16_t channels = 0;   // Bit per channel with any note on
+};
+
+template <typename F>
+void ActiveNotes::forEach(F f) const
+{
+    for (int ch = 0; ch < 16; ++ch) {
+        if (!(channels & (1u << ch)))
+            continue;
+        for (int word = 0; word < 2; ++word) {
+            for (uint64_t w = bits[ch][word]; w; w &= w - 1) {
+                int bit = 0;
+                while (!((w >> bit) & 1))
+                    ++bit;
+                f(ch, word * 64 + bit);
+            }
+        }
+    }
+}
+
+// Discards every event (no device open, benchmarks).
+class NullSink : public EventSink {
+public:
+    void send(const MidiEvent&) override {}
+};
+
+// An event together with the time it was sent, relative to the capture start.
+struct CapturedEvent {
+    MidiEvent event;
+    int64_t timeUs;
+};
+
+// Records every event in memory with a timestamp.
+class CaptureSink : public EventSink {
+public:
+    CaptureSink();
+    void send(const MidiEvent& event) override;
+    void clear();
+    const vector<CapturedEvent>& events() const { return captured; }
+
+private:
+    chrono::steady_clock::time_point start;
+    vector<CapturedEvent> captured;
+};
+
+// Forwards events to a device driver on a dedicated thread.
+// The caller only pushes into a preallocated SPSC ring buffer, so a slow
+// driver call never delays the next event from the scheduler.
+class DeviceSink : public EventSink {
+public:
+    // driver receives packed short messages on the device thread.
+    explicit DeviceSink(function<void(uint32_t)> driver);
+    ~DeviceSink() override;
+
+    void send(const MidiEvent& event) override;
+    void flush() override;
+
+private:
+    void run();
+
+    function<void(uint32_t)> driver;
+    SPSCRingBuffer<MidiEvent, 1024> queue;
+    mutex wakeMutex;
+    condition_variable wake;
+    atomic<bool> workerWaiting;
+    atomic<bool> stopping;
+    atomic<uint64_t> delivered;
+    uint64_t sent;     // Only touched by the producer thread
+    thread worker;
+};
+
+#endif // OUTPUT_H
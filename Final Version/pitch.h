@@ -0,0 +1,120 @@
+#pragma once
+#ifndef PITCH_H
+#define PITCH_H
+
+// Compact pitch representation.
+// A pitch id is simply the MIDI note number (0-127, C4 = 60). Names and
+// frequencies come from constexpr tables, so resolving or formatting a pitch
+// never allocates and never touches a map. Names are only produced when a
+// note is displayed or saved.
+
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+typedef uint8_t PitchId;
+
+const int PITCH_COUNT = 128;
+const int INVALID_PITCH = -1;
+
+struct PitchTable {
+    char names[PITCH_COUNT][5];     // e.g. "C#-1", "A4"; NUL-terminated
+    uint8_t nameLengths[PITCH_COUNT];
+    double frequencies[PITCH_COUNT];
+};
+
+constexpr PitchTable buildPitchTable()
+{
+    const char* classNames[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    // Equal temperament relative to A4 = 440 Hz, stepped by the twelfth root of two.
+    const double semitone = 1.0594630943592952646;
+    PitchTable table = {};
+    double freq = 440.0;
+    for (int i = 69; i > 0; --i)
+        freq /= semitone;
+    for (int p = 0; p < PITCH_COUNT; ++p) {
+        table.frequencies[p] = freq;
+        freq *= semitone;
+
+        int octave = p / 12 - 1;
+        int len = 0;
+        for (const char* c = classNames[p % 12]; *c; ++c)
+            table.names[p][len++] = *c;
+        if (octave < 0) {
+            table.names[p][len++] = '-';
+            octave = -octave;
+        }
+        table.names[p][len++] = static_cast<char>('0' + octave);
+        table.names[p][len] = '\0';
+        table.nameLengths[p] = static_cast<uint8_t>(len);
+    }
+    return table;
+}
+
+constexpr PitchTable PITCH_TABLE = buildPitchTable();
+
+// Display name for a pitch, e.g. 61 -> "C#4". The view is sized from the
+// table, so callers never scan for the terminator.
+constexpr string_view pitchName(int pitch)
+{
+    if (pitch < 0 || pitch >= PITCH_COUNT)
+        return "?";
+    return string_view(PITCH_TABLE.names[pitch], PITCH_TABLE.nameLengths[pitch]);
+}
+
+// Equal-tempered frequency in Hz.
+constexpr double pitchFrequency(int pitch)
+{
+    return (pitch >= 0 && pitch < PITCH_COUNT) ? PITCH_TABLE.frequencies[pitch] : 0.0;
+}
+
+// Parses a note name such as "C4", "F#5", "Eb3" or "C-1" (case-insensitive
+// letter). Returns the pitch id, or INVALID_PITCH for malformed or
+// out-of-range names.
+constexpr int parsePitch(string_view name)
+{
+    const int letterOffsets[7] = {9, 11, 0, 2, 4, 5, 7};   // A B C D E F G
+    if (name.empty())
+        return INVALID_PITCH;
+
+    char letter = name[0];
+    if (letter >= 'a' && letter <= 'g')
+        letter = static_cast<char>(letter - 'a' + 'A');
+    if (letter < 'A' || letter > 'G')
+        return INVALID_PITCH;
+    int semitone = letterOffsets[letter - 'A'];
+
+    size_t i = 1;
+    if (i < name.size() && name[i] == '#') {
+        ++semitone;
+        ++i;
+    } else if (i < name.size() && name[i] == 'b') {
+        --semitone;
+        ++i;
+    }
+
+    bool negative = false;
+    if (i < name.size() && name[i] == '-') {
+        negative = true;
+        ++i;
+    }
+    if (i >= name.size())
+        return INVALID_PITCH;
+    int octave = 0;
+    for (; i < name.size(); ++i) {
+        if (name[i] < '0' || name[i] > '9' || octave > 10)
+            return INVALID_PITCH;
+        octave = octave * 10 + (name[i] - '0');
+    }
+    if (negative)
+        octave = -octave;
+
+    int pitch = (octave + 1) * 12 + semitone;
+    return (pitch >= 0 && pitch < PITCH_COUNT) ? pitch : INVALID_PITCH;
+}
+
+static_assert(parsePitch("C4") == 60 && parsePitch("A4") == 69 && parsePitch("C-1") == 0,
+              "pitch parser disagrees with MIDI numbering");
+
+#endif // PITCH_H
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+// Fixed-capacity single-producer/single-consumer queue.
+// All storage is allocated up front; push and pop are wait-free and never lock,
+// so the playback thread can hand events to a device thread without blocking.
+
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+template <typename T, size_t Capacity>
+class SPSCRingBuffer {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    SPSCRingBuffer() : head(0), tail(0) {}
+
+    // Producer side. Returns false if the queue is full.
+    bool tryPush(const T& item)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == Capacity)
+            return false;
+        slots[t & (Capacity - 1)] = item;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool tryPop(T& item)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire))
+            return false;
+        item = slots[h & (Capacity - 1)];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+    }
+
+private:
+    // Head and tail live on separate cache lines so producer and consumer
+    // do not invalidate each other's line on every operation.
+    alignas(64) atomic<size_t> head;
+    alignas(64) atomic<size_t> tail;
+    alignas(64) T slots[Capacity];
+};
+
+#endif // RING_BUFFER_H
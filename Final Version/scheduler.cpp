@@ -0,0 +1,60 @@
+// scheduler.cpp
+// Absolute-deadline waits on the monotonic clock.
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+// OS sleeps can overshoot by up to a timer tick (1 ms once timeBeginPeriod(1)
+// is active on Windows); the last stretch before a deadline is spent yielding.
+const chrono::microseconds SPIN_MARGIN(1500);
+
+} // namespace
+
+PlaybackClock::PlaybackClock() : origin(PlaybackClockType::now())
+{
+}
+
+void PlaybackClock::start(int64_t offsetUs)
+{
+    origin = PlaybackClockType::now() - chrono::microseconds(offsetUs);
+}
+
+int64_t PlaybackClock::nowUs() const
+{
+    return chrono::duration_cast<chrono::microseconds>(PlaybackClockType::now() - origin).count();
+}
+
+PlaybackClockType::time_point PlaybackClock::deadline(int64_t offsetUs) const
+{
+    return origin + chrono::microseconds(offsetUs);
+}
+
+bool sleepUntil(PlaybackClockType::time_point deadline, chrono::microseconds pollInterval,
+                const function<bool()>& interrupted)
+{
+    while (true) {
+        if (interrupted && interrupted())
+            return false;
+
+        PlaybackClockType::time_point now = PlaybackClockType::now();
+        if (now >= deadline)
+            return true;
+
+        if (deadline - now > SPIN_MARGIN) {
+            // Coarse sleep: wake for the next poll or just before the deadline.
+            PlaybackClockType::time_point wake = min(deadline - SPIN_MARGIN, now + pollInterval);
+            this_thread::sleep_until(wake);
+        } else {
+            // Fine wait: the remaining time is below the OS sleep granularity.
+            while (PlaybackClockType::now() < deadline)
+                this_thread::yield();
+            return true;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Drift-free playback timing.
+// Every event is scheduled at an absolute offset from a fixed origin on the
+// monotonic clock, so rounding and processing time never accumulate from one
+// measure to the next.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+typedef chrono::steady_clock PlaybackClockType;
+
+// Maps song offsets (microseconds) to points on the monotonic clock.
+class PlaybackClock {
+public:
+    PlaybackClock();
+
+    // Moves the origin so that "now" corresponds to offsetUs (used on start and resume).
+    void start(int64_t offsetUs = 0);
+    // Current song offset in microseconds.
+    int64_t nowUs() const;
+    // Absolute deadline for a song offset.
+    PlaybackClockType::time_point deadline(int64_t offsetUs) const;
+
+private:
+    PlaybackClockType::time_point origin;
+};
+
+// Sleeps until deadline with sub-millisecond accuracy: a coarse OS sleep until
+// shortly before the deadline, then a short yield loop for the remainder.
+// interrupted is polled at most every pollInterval while sleeping; if it
+// returns true the wait ends early and the function returns false.
+bool sleepUntil(PlaybackClockType::time_point deadline, chrono::microseconds pollInterval,
+                const function<bool()>& interrupted);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,59 @@
+// section_registry.cpp
+// Hash index from section name to section handle.
+
+#include "section_registry.h"
+
+using namespace std;
+
+SectionRegistry::SectionRegistry(vector<MusicSection>& sections)
+    : sectionList(sections)
+{
+}
+
+SectionHandle SectionRegistry::find(const string& name)
+{
+    indexNew();
+    auto it = byName.find(name);
+    if (it != byName.end() && sectionList[it->second].name == name)
+        return it->second;
+    if (it == byName.end())
+        return NO_SECTION_HANDLE;
+
+    // The entry points at a section that was replaced; start over.
+    reindex();
+    it = byName.find(name);
+    return it == byName.end() ? NO_SECTION_HANDLE : it->second;
+}
+
+SectionHandle SectionRegistry::findOrAdd(const string& name, bool& added)
+{
+    SectionHandle handle = find(name);
+    added = handle == NO_SECTION_HANDLE;
+    if (added) {
+        handle = static_cast<SectionHandle>(sectionList.size());
+        sectionList.emplace_back();
+        sectionList.back().name = name;
+        byName.emplace(name, handle);
+        indexed = sectionList.size();
+    }
+    return handle;
+}
+
+void SectionRegistry::reindex()
+{
+    byName.clear();
+    indexed = 0;
+    indexNew();
+}
+
+void SectionRegistry::indexNew()
+{
+    if (indexed > sectionList.size()) {
+        // Sections were removed: handles past the end are gone.
+        byName.clear();
+        indexed = 0;
+    }
+    byName.reserve(sectionList.size());
+    for (; indexed < sectionList.size(); ++indexed)
+        byName.emplace(sectionList[indexed].name, static_cast<SectionHandle>(indexed));   // First name wins
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef SECTION_REGISTRY_H
+#define SECTION_REGISTRY_H
+
+// Section lookup by name.
+// The registry indexes a song's section vector with a hash map from name to
+// handle. A handle is the section's position: sections are only ever
+// appended, so a handle stays valid across insertions where a MusicSection*
+// into the vector would dangle after it reallocates. Resolve a handle with
+// sections()[handle] right where it is used, never keep the reference.
+//
+// Sections appended behind the registry's back are indexed on the next
+// lookup. After the vector is replaced wholesale (a load, undo or redo) call
+// reindex(); a lookup that finds a stale entry also rebuilds the index.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "song.h"
+
+using namespace std;
+
+typedef uint32_t SectionHandle;
+const SectionHandle NO_SECTION_HANDLE = UINT32_MAX;
+
+class SectionRegistry {
+public:
+    explicit SectionRegistry(vector<MusicSection>& sections);
+
+    // Handle of the first section with this name, or NO_SECTION_HANDLE.
+    // O(1) on average.
+    SectionHandle find(const string& name);
+    // Like find(), but appends an empty section if there is none; added
+    // tells which happened.
+    SectionHandle findOrAdd(const string& name, bool& added);
+
+    vector<MusicSection>& sections() { return sectionList; }
+    MusicSection& operator[](SectionHandle handle) { return sectionList[handle]; }
+
+    // Rebuilds the index from scratch. O(sections).
+    void reindex();
+
+private:
+    void indexNew();
+
+    vector<MusicSection>& sectionList;
+    unordered_map<string, SectionHandle> byName;
+    size_t indexed = 0;   // sectionList[0, indexed) are in byName
+};
+
+#endif // SECTION_REGISTRY_H
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef SONG_H
+#define SONG_H
+
+// Core song data types shared by the interactive composer (music.cpp) and the
+// platform-independent tools (offline renderer, converters).
+// Nothing in here may depend on Windows headers so it also builds on Linux.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pitch.h"
+
+using namespace std;
+
+// MIDI Instrument Constants
+enum MIDIInstruments {
+    INSTRUMENT_PIANO = 0,
+    INSTRUMENT_SYNTH = 80,
+    INSTRUMENT_ORGAN = 16,
+    INSTRUMENT_GUITAR = 24,
+    INSTRUMENT_BASS = 32,
+    INSTRUMENT_STRINGS = 48,
+    INSTRUMENT_TRUMPET = 56,
+    INSTRUMENT_SAXOPHONE = 65,
+    INSTRUMENT_FLUTE = 73,
+    INSTRUMENT_DRUM_KIT = 0,  // Channel 10 for drums
+    INSTRUMENT_CHOIR = 52,
+    INSTRUMENT_FRENCH_HORN = 60,
+    INSTRUMENT_ORCHESTRA_HIT = 55,
+    INSTRUMENT_ELECTRIC_BASS = 33,
+    INSTRUMENT_CELLO = 42
+};
+
+// MIDI channel reserved for percussion (channel 10 in 1-based numbering).
+const int DRUM_CHANNEL = 9;
+
+// Represents a single tone with channel assignment (no heap data). Songs keep
+// their notes column-wise in a NoteArena (note_arena.h); a Note is one row of
+// it as a value, used to build and inspect rows.
+// The pitch is stored as a MIDI note number; use pitchName()/pitchFrequency()
+// from pitch.h when a name or frequency is needed. duration and onset: ticks
+// (TICKS_PER_QUARTER per quarter note, see tempo.h).
+struct Note {
+    PitchId midiNote;     // MIDI note number (0-127)
+    uint8_t channel;      // MIDI channel (0-15)
+    uint8_t instrument;   // Instrument for this channel
+    uint8_t velocity;     // Note volume (0-127)
+    int duration;
+    int onset = 0;        // Start within the measure (clamped to it)
+};
+
+// Rows [first, first + count) of the song's NoteArena.
+struct NoteRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    uint32_t end() const { return first + count; }
+    bool empty() const { return count == 0; }
+};
+
+// Represents a musical measure.
+// chord: label for the harmony; notes: the tones played in the measure, as
+// rows of the song's NoteArena; measureNumber: order within the section;
+// section: owning section label; duration: length of the measure and
+// default duration for its notes (ticks).
+struct Measure {
+    string chord;
+    NoteRange notes;
+    int measureNumber;
+    string section;
+    int duration;
+};
+
+// A labeled section of a song (e.g., "A", "B") containing ordered measures.
+struct MusicSection {
+    string name;
+    vector<Measure> measures;
+};
+
+#endif // SONG_H
@@ -0,0 +1,384 @@
+// songbin.cpp
+// Binary song format writer and lazily decoding reader.
+
+#include "songbin.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[4] = {'M', 'M', 'S', 'B'};
+const size_t HEADER_SIZE = 80;
+const size_t HEADER_SIZE_V1 = 48;
+const size_t HEADER_SIZE_V2 = 64;
+const size_t TEMPO_RECORD_SIZE = 16;
+const size_t ARRANGEMENT_RECORD_SIZE = 8;
+const size_t TOC_ENTRY_SIZE = 32;
+const size_t MEASURE_RECORD_SIZE = 16;
+const size_t NOTE_RECORD_SIZE = 12;
+const size_t NOTE_RECORD_SIZE_V3 = 8;   // Versions 1-3: no onset
+const uint8_t NO_INSTRUMENT = 0xFF;
+
+void put16(string& out, uint16_t v)
+{
+    out += static_cast<char>(v & 0xFF);
+    out += static_cast<char>(v >> 8);
+}
+
+void put32(string& out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+void put64(string& out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+uint16_t get16(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(b[0] | (b[1] << 8));
+}
+
+uint32_t get32(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+}
+
+uint64_t get64(const char* p)
+{
+    return get32(p) | (static_cast<uint64_t>(get32(p + 4)) << 32);
+}
+
+// Deduplicating string table; offsets are relative to the table start.
+struct StringTable {
+    string bytes;
+    unordered_map<string, uint32_t> offsets;
+
+    uint32_t intern(const string& s)
+    {
+        auto it = offsets.find(s);
+        if (it != offsets.end())
+            return it->second;
+        uint32_t offset = static_cast<uint32_t>(bytes.size());
+        size_t len = min<size_t>(s.size(), 0xFFFF);
+        put16(bytes, static_cast<uint16_t>(len));
+        bytes.append(s, 0, len);
+        offsets.emplace(s, offset);
+        return offset;
+    }
+};
+
+} // namespace
+
+bool isBinarySongPath(const string& path)
+{
+    const string ext = ".mmsb";
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+bool saveSongBinary(const string& path, const vector<MusicSection>& sections, const NoteArena& notes,
+                    const map<int, int>& channelInstruments, const TempoTrack& tempo,
+                    const Arrangement& arrangement, string& error)
+{
+    ofstream file(path, ios::binary);
+    if (!file) {
+        error = "cannot write " + path;
+        return false;
+    }
+
+    // Labels first, so every offset below is known before anything is written.
+    StringTable strings;
+    vector<uint32_t> sectionNames;
+    vector<uint32_t> chordNames;
+    for (const auto& section : sections) {
+        sectionNames.push_back(strings.intern(section.name));
+        for (const auto& measure : section.measures)
+            chordNames.push_back(strings.intern(measure.chord));
+    }
+
+    uint64_t tocOffset = HEADER_SIZE;
+    uint64_t stringTableOffset = tocOffset + sections.size() * TOC_ENTRY_SIZE;
+    uint64_t tempoOffset = stringTableOffset + strings.bytes.size();
+    size_t tempoRecords = tempo.tempos.size() + tempo.timeSignatures.size();
+    uint64_t arrangementOffset = tempoOffset + tempoRecords * TEMPO_RECORD_SIZE;
+    uint64_t dataOffset = arrangementOffset + arrangement.items.size() * ARRANGEMENT_RECORD_SIZE;
+
+    string out;
+    out.append(MAGIC, 4);
+    put16(out, SONG_BINARY_VERSION);
+    put16(out, static_cast<uint16_t>(HEADER_SIZE));
+    put32(out, static_cast<uint32_t>(sections.size()));
+    for (int channel = 0; channel < 16; ++channel) {
+        auto it = channelInstruments.find(channel);
+        out += static_cast<char>(it == channelInstruments.end() ? NO_INSTRUMENT : (it->second & 0x7F));
+    }
+    put32(out, static_cast<uint32_t>(strings.bytes.size()));
+    put64(out, tocOffset);
+    put64(out, stringTableOffset);
+    put64(out, tempoOffset);
+    put32(out, static_cast<uint32_t>(tempo.tempos.size()));
+    put32(out, static_cast<uint32_t>(tempo.timeSignatures.size()));
+    put64(out, arrangementOffset);
+    put32(out, static_cast<uint32_t>(arrangement.items.size()));
+    put32(out, 0);
+
+    uint64_t offset = dataOffset;
+    for (size_t s = 0; s < sections.size(); ++s) {
+        const auto& measures = sections[s].measures;
+        uint32_t noteCount = 0;
+        for (const auto& measure : measures)
+            noteCount += measure.notes.count;
+        put32(out, sectionNames[s]);
+        put32(out, static_cast<uint32_t>(measures.size()));
+        put64(out, offset);
+        put64(out, offset + measures.size() * MEASURE_RECORD_SIZE);
+        put32(out, noteCount);
+        put32(out, 0);
+        offset += measures.size() * MEASURE_RECORD_SIZE + uint64_t(noteCount) * NOTE_RECORD_SIZE;
+    }
+    out += strings.bytes;
+    for (const auto& change : tempo.tempos) {
+        put64(out, static_cast<uint64_t>(change.tick));
+        put32(out, change.usPerQuarter);
+        put32(out, 0);
+    }
+    for (const auto& change : tempo.timeSignatures) {
+        put64(out, static_cast<uint64_t>(change.tick));
+        out += static_cast<char>(change.beats);
+        out += static_cast<char>(change.beatUnit);
+        out.append(6, '\0');
+    }
+    for (const auto& item : arrangement.items) {
+        out += static_cast<char>(item.type);
+        out += static_cast<char>(item.count);
+        put16(out, item.passes);
+        put32(out, item.section);
+    }
+    file.write(out.data(), out.size());
+
+    // Section bodies are streamed one at a time.
+    size_t chordIndex = 0;
+    for (const auto& section : sections) {
+        out.clear();
+        for (const auto& measure : section.measures) {
+            put32(out, static_cast<uint32_t>(measure.measureNumber));
+            put32(out, chordNames[chordIndex++]);
+            put32(out, static_cast<uint32_t>(measure.duration));
+            put32(out, measure.notes.count);
+        }
+        for (const auto& measure : section.measures) {
+            for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row) {
+                out += static_cast<char>(notes.pitch()[row]);
+                out += static_cast<char>(notes.channel()[row]);
+                out += static_cast<char>(notes.instrument()[row]);
+                out += static_cast<char>(notes.velocity()[row]);
+                put32(out, static_cast<uint32_t>(notes.duration()[row]));
+                put32(out, static_cast<uint32_t>(notes.onset()[row]));
+            }
+        }
+        file.write(out.data(), out.size());
+    }
+
+    if (!file) {
+        error = "error writing " + path;
+        return false;
+    }
+    return true;
+}
+
+bool BinarySongFile::open(const string& path, string& error)
+{
+    sections.clear();
+    tempoTrack = TempoTrack();
+    arrangementItems = Arrangement();
+    if (!file.open(path, error))
+        return false;
+
+    const char* p = file.data();
+    size_t size = file.size();
+    if (size < HEADER_SIZE_V1 || memcmp(p, MAGIC, 4) != 0) {
+        error = path + ": not a binary song file";
+        return false;
+    }
+    uint16_t version = get16(p + 4);
+    if (version < 1 || version > SONG_BINARY_VERSION || (version == 2 && size < HEADER_SIZE_V2) ||
+        (version >= 3 && size < HEADER_SIZE)) {
+        error = path + ": unsupported binary song version " + to_string(version);
+        return false;
+    }
+    uint32_t count = get32(p + 8);
+    noteRecordSize = version >= 4 ? NOTE_RECORD_SIZE : NOTE_RECORD_SIZE_V3;
+    memcpy(instruments, p + 12, 16);
+    stringTableSize = get32(p + 28);
+    uint64_t tocOffset = get64(p + 32);
+    stringTableOffset = get64(p + 40);
+    if (tocOffset > size || count > (size - tocOffset) / TOC_ENTRY_SIZE ||
+        stringTableOffset > size || stringTableSize > size - stringTableOffset) {
+        error = path + ": truncated table of contents";
+        return false;
+    }
+
+    sections.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const char* e = p + tocOffset + i * TOC_ENTRY_SIZE;
+        TocEntry entry = {get32(e), get32(e + 4), get64(e + 8), get64(e + 16), get32(e + 24)};
+        if (entry.measureOffset > size || entry.measureCount > (size - entry.measureOffset) / MEASURE_RECORD_SIZE ||
+            entry.noteOffset > size || entry.noteCount > (size - entry.noteOffset) / noteRecordSize) {
+            error = path + ": section " + to_string(i) + " lies outside the file";
+            sections.clear();
+            return false;
+        }
+        sections.push_back(entry);
+    }
+
+    if (version >= 2) {
+        uint64_t tempoOffset = get64(p + 48);
+        uint64_t tempoCount = get32(p + 56), signatureCount = get32(p + 60);
+        if (tempoOffset > size || tempoCount + signatureCount > (size - tempoOffset) / TEMPO_RECORD_SIZE) {
+            error = path + ": truncated tempo track";
+            sections.clear();
+            return false;
+        }
+        const char* t = p + tempoOffset;
+        for (uint64_t i = 0; i < tempoCount; ++i, t += TEMPO_RECORD_SIZE)
+            tempoTrack.tempos.push_back({static_cast<int64_t>(get64(t)), get32(t + 8)});
+        for (uint64_t i = 0; i < signatureCount; ++i, t += TEMPO_RECORD_SIZE)
+            tempoTrack.timeSignatures.push_back(
+                {static_cast<int64_t>(get64(t)), static_cast<uint8_t>(t[8]), static_cast<uint8_t>(t[9])});
+    }
+
+    if (version >= 3) {
+        uint64_t arrangementOffset = get64(p + 64);
+        uint64_t itemCount = get32(p + 72);
+        if (arrangementOffset > size || itemCount > (size - arrangementOffset) / ARRANGEMENT_RECORD_SIZE) {
+            error = path + ": truncated arrangement";
+            sections.clear();
+            return false;
+        }
+        const char* a = p + arrangementOffset;
+        for (uint64_t i = 0; i < itemCount; ++i, a += ARRANGEMENT_RECORD_SIZE) {
+            ArrangementItem item;
+            item.type = static_cast<ArrangementItemType>(a[0]);
+            item.count = static_cast<uint8_t>(a[1]);
+            item.passes = get16(a + 2);
+            item.section = get32(a + 4);
+            arrangementItems.items.push_back(item);
+        }
+        string message;
+        if (!checkArrangement(arrangementItems, count, message)) {
+            error = path + ": " + message;
+            sections.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BinarySongFile::readString(uint32_t offset, string_view& out) const
+{
+    if (uint64_t(offset) + 2 > stringTableSize)
+        return false;
+    const char* s = file.data() + stringTableOffset + offset;
+    uint16_t len = get16(s);
+    if (uint64_t(offset) + 2 + len > stringTableSize)
+        return false;
+    out = string_view(s + 2, len);
+    return true;
+}
+
+string_view BinarySongFile::sectionName(size_t index) const
+{
+    string_view name;
+    return readString(sections[index].name, name) ? name : string_view();
+}
+
+map<int, int> BinarySongFile::channelInstruments() const
+{
+    map<int, int> result;
+    for (int channel = 0; channel < 16; ++channel) {
+        if (instruments[channel] != NO_INSTRUMENT)
+            result[channel] = instruments[channel];
+    }
+    return result;
+}
+
+bool BinarySongFile::loadSection(size_t index, MusicSection& section, NoteArena& notes, string& error) const
+{
+    const TocEntry& entry = sections[index];
+    string_view name;
+    if (!readString(entry.name, name)) {
+        error = "section " + to_string(index) + ": bad name offset";
+        return false;
+    }
+    section.name = string(name);
+    section.measures.clear();
+    section.measures.reserve(entry.measureCount);
+
+    const char* m = file.data() + entry.measureOffset;
+    const char* n = file.data() + entry.noteOffset;
+    uint32_t notesLeft = entry.noteCount;
+    for (uint32_t i = 0; i < entry.measureCount; ++i, m += MEASURE_RECORD_SIZE) {
+        Measure measure;
+        measure.measureNumber = static_cast<int32_t>(get32(m));
+        string_view chord;
+        if (!readString(get32(m + 4), chord)) {
+            error = "section " + section.name + ", measure " + to_string(i + 1) + ": bad chord offset";
+            return false;
+        }
+        measure.chord = string(chord);
+        measure.duration = static_cast<int32_t>(get32(m + 8));
+        measure.section = section.name;
+        uint32_t noteCount = get32(m + 12);
+        if (noteCount > notesLeft) {
+            error = "section " + section.name + ", measure " + to_string(i + 1) + ": note count overflows section";
+            return false;
+        }
+        notesLeft -= noteCount;
+
+        measure.notes.first = static_cast<uint32_t>(notes.size());
+        measure.notes.count = noteCount;
+        notes.reserve(notes.size() + noteCount);
+        for (uint32_t k = 0; k < noteCount; ++k, n += noteRecordSize) {
+            Note note;
+            note.midiNote = static_cast<PitchId>(n[0] & 0x7F);
+            note.channel = static_cast<uint8_t>(n[1] & 0x0F);
+            note.instrument = static_cast<uint8_t>(n[2] & 0x7F);
+            note.velocity = static_cast<uint8_t>(n[3] & 0x7F);
+            note.duration = static_cast<int32_t>(get32(n + 4));
+            note.onset = noteRecordSize == NOTE_RECORD_SIZE ? max(0, static_cast<int32_t>(get32(n + 8))) : 0;
+            notes.append(note);
+        }
+        section.measures.push_back(move(measure));
+    }
+    return true;
+}
+
+bool loadSongBinary(const string& path, ParsedSong& song, string& error)
+{
+    BinarySongFile file;
+    if (!file.open(path, error))
+        return false;
+    song.sections.resize(file.sectionCount());
+    size_t noteCount = 0;
+    for (size_t i = 0; i < file.sectionCount(); ++i)
+        noteCount += file.noteCount(i);
+    song.notes.reserve(song.notes.size() + noteCount);
+    for (size_t i = 0; i < file.sectionCount(); ++i) {
+        if (!file.loadSection(i, song.sections[i], song.notes, error))
+            return false;
+    }
+    song.channelInstruments = file.channelInstruments();
+    song.tempo = file.tempo();
+    song.arrangement = file.arrangement();
+    return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef SONGBIN_H
+#define SONGBIN_H
+
+// Versioned binary song format (.mmsb).
+//
+//   Header       magic "MMSB", version, section count, channel instruments,
+//                offsets of the table of contents, string table and tempo track
+//   TOC          one entry per section: name, measure/note counts and offsets
+//   Strings      interned section names and chord labels (u16 length + bytes)
+//   Tempo        tempo and time signature changes (version 2; version 1 files
+//                have none and still load)
+//   Arrangement  road map items, 8 bytes each (version 3; older files play
+//                their sections in order)
+//   Sections     per section: fixed-width measure records, then note records
+//                (12 bytes with the note's onset in version 4, 8 before)
+//
+// All integers are little-endian. Because every section's records sit at a
+// known offset, a mapped file can be opened in O(sections) and only the
+// sections that are actually played or edited are ever paged in.
+// The text song sheet (songio.h) holds the same notes, labels, tempo and
+// arrangement, but has no channel table of its own: it only keeps the
+// instrument of channels that play notes.
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "mapped_file.h"
+#include "songio.h"
+
+const uint16_t SONG_BINARY_VERSION = 4;
+
+// Writes sections (with the note rows they index), channel assignments,
+// tempo track and arrangement to path. Returns false and sets error if the
+// file cannot be written.
+bool saveSongBinary(const string& path, const vector<MusicSection>& sections, const NoteArena& notes,
+                    const map<int, int>& channelInstruments, const TempoTrack& tempo,
+                    const Arrangement& arrangement, string& error);
+
+// A mapped .mmsb file. Opening validates the header and table of contents;
+// section data is decoded on demand.
+class BinarySongFile {
+public:
+    bool open(const string& path, string& error);
+
+    size_t sectionCount() const { return sections.size(); }
+    string_view sectionName(size_t index) const;
+    size_t measureCount(size_t index) const { return sections[index].measureCount; }
+    size_t noteCount(size_t index) const { return sections[index].noteCount; }
+    map<int, int> channelInstruments() const;
+    const TempoTrack& tempo() const { return tempoTrack; }
+    const Arrangement& arrangement() const { return arrangementItems; }
+
+    // Decodes one section, appending its notes to notes. Returns false and
+    // sets error if its records are corrupt.
+    bool loadSection(size_t index, MusicSection& section, NoteArena& notes, string& error) const;
+
+private:
+    struct TocEntry {
+        uint32_t name;
+        uint32_t measureCount;
+        uint64_t measureOffset;
+        uint64_t noteOffset;
+        uint32_t noteCount;
+    };
+
+    bool readString(uint32_t offset, string_view& out) const;
+
+    MappedFile file;
+    uint8_t instruments[16] = {};
+    size_t noteRecordSize = 0;
+    uint64_t stringTableOffset = 0;
+    uint32_t stringTableSize = 0;
+    vector<TocEntry> sections;
+    TempoTrack tempoTrack;
+    Arrangement arrangementItems;
+};
+
+// Loads every section of a binary song. Returns false and sets error on failure.
+bool loadSongBinary(const string& path, ParsedSong& song, string& error);
+
+// True if path names a binary song file (by extension).
+bool isBinarySongPath(const string& path);
+
+#endif // SONGBIN_H
@@ -0,0 +1,517 @@
+// songio.cpp
+// Zero-copy song sheet parser and writer.
+
+#include "songio.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <thread>
+
+#include "mapped_file.h"
+
+using namespace std;
+
+namespace {
+
+// Below this size the thread start-up cost outweighs the parallel speedup.
+const size_t PARALLEL_THRESHOLD = 1 << 20;
+const string_view SECTION_TAG = "[SECTION";
+const string_view TEMPO_TAG = "[TEMPO ";
+const string_view TIMESIG_TAG = "[TIMESIG ";
+const string_view ARRANGEMENT_TAG = "[ARRANGEMENT]";
+// Notes written without a /velocity field play at this velocity.
+const int DEFAULT_VELOCITY = 100;
+
+string_view trim(string_view s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && (s[b] == ' ' || s[b] == '\t' || s[b] == '\r'))
+        ++b;
+    while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t' || s[e - 1] == '\r'))
+        --e;
+    return s.substr(b, e - b);
+}
+
+// from_chars over the trimmed field (integer or floating point); rejects trailing junk.
+template <typename T>
+bool parseNumber(string_view s, T& value)
+{
+    s = trim(s);
+    if (s.empty())
+        return false;
+    const char* end = s.data() + s.size();
+    auto result = from_chars(s.data(), end, value);
+    return result.ec == errc() && result.ptr == end;
+}
+
+bool parseInt(string_view s, int& value)
+{
+    return parseNumber(s, value);
+}
+
+// Returns the text up to the next delimiter and removes it (and the delimiter) from rest.
+string_view nextField(string_view& rest, char delimiter)
+{
+    size_t pos = rest.find(delimiter);
+    string_view field = rest.substr(0, pos);
+    rest = (pos == string_view::npos) ? string_view() : rest.substr(pos + 1);
+    return field;
+}
+
+// Parser state for one contiguous chunk of the file.
+struct ChunkParser {
+    ParsedSong song;
+    vector<SongParseError> errors;
+    int lines = 0;
+    int channelInstruments[16];   // -1 = not assigned in this chunk
+    // [ARRANGEMENT] block: header line (0 = none), and per item the section
+    // name to resolve once all chunks are in, and its line.
+    int arrangementLine = 0;
+    vector<string> arrangementNames;
+    vector<int> arrangementLines;
+
+    ChunkParser() { fill(channelInstruments, channelInstruments + 16, -1); }
+
+    void error(int line, const string& message) { errors.push_back({line, message}); }
+
+    void parseNotes(string_view list, int channel, int instrument, Measure& measure, int line)
+    {
+        while (!list.empty()) {
+            string_view token = trim(nextField(list, ','));
+            if (token.empty())
+                continue;
+            // NAME[/velocity[/duration[/onset]]]; an empty field keeps the default.
+            string_view name = trim(nextField(token, '/'));
+            string_view velocityField = trim(nextField(token, '/'));
+            string_view durationField = trim(nextField(token, '/'));
+            string_view onsetField = trim(nextField(token, '/'));
+            if (name.empty()) {
+                error(line, "missing note name");
+                continue;
+            }
+            // Drum parts are conventionally written as raw MIDI numbers ("36").
+            int pitch = INVALID_PITCH;
+            if (name[0] >= '0' && name[0] <= '9') {
+                if (!parseInt(name, pitch) || pitch < 0 || pitch >= PITCH_COUNT)
+                    pitch = INVALID_PITCH;
+            } else {
+                pitch = parsePitch(name);
+            }
+            if (pitch == INVALID_PITCH) {
+                error(line, "unknown note '" + string(name) + "'");
+                continue;
+            }
+            int velocity = DEFAULT_VELOCITY;
+            if (!velocityField.empty() && (!parseInt(velocityField, velocity) || velocity < 0 || velocity > 127)) {
+                error(line, "bad velocity '" + string(velocityField) + "'");
+                continue;
+            }
+            int duration = measure.duration;
+            if (!durationField.empty() && (!parseInt(durationField, duration) || duration < 0)) {
+                error(line, "bad note duration '" + string(durationField) + "'");
+                continue;
+            }
+            int onset = 0;
+            if (!onsetField.empty() && (!parseInt(onsetField, onset) || onset < 0)) {
+                error(line, "bad note onset '" + string(onsetField) + "'");
+                continue;
+            }
+            Note n;
+            n.midiNote = static_cast<PitchId>(pitch);
+            n.duration = duration;
+            n.channel = static_cast<uint8_t>(channel);
+            n.instrument = static_cast<uint8_t>(instrument);
+            n.velocity = static_cast<uint8_t>(velocity);
+            n.onset = onset;
+            song.notes.append(n);
+            ++measure.notes.count;
+        }
+    }
+
+    void parseMeasure(string_view text, int line, MusicSection& section)
+    {
+        string_view rest = text;
+        string_view numberField = nextField(rest, '|');
+        string_view chordField = nextField(rest, '|');
+        string_view notesField = nextField(rest, '|');
+        string_view durationField = nextField(rest, '|');
+
+        Measure measure;
+        if (!parseInt(numberField, measure.measureNumber)) {
+            error(line, "expected measure|chord|notes|duration, bad measure number '" +
+                            string(trim(numberField)) + "'");
+            return;
+        }
+        if (!parseInt(durationField, measure.duration) || measure.duration <= 0) {
+            error(line, "bad duration '" + string(trim(durationField)) + "'");
+            return;
+        }
+        measure.chord = string(chordField);
+        measure.section = section.name;
+        measure.notes.first = static_cast<uint32_t>(song.notes.size());
+        song.notes.reserve(song.notes.size() + count(notesField.begin(), notesField.end(), ',') +
+                           count(notesField.begin(), notesField.end(), ';') + 1);
+
+        // Channel groups: "ch:inst:notes;ch:inst:notes", or a bare note list (channel 0).
+        while (!notesField.empty()) {
+            string_view group = nextField(notesField, ';');
+            if (group.find(':') == string_view::npos) {
+                parseNotes(group, 0, INSTRUMENT_PIANO, measure, line);
+                continue;
+            }
+            string_view channelField = nextField(group, ':');
+            string_view instrumentField = nextField(group, ':');
+            int channel, instrument;
+            if (!parseInt(channelField, channel) || channel < 0 || channel > 15) {
+                error(line, "bad channel '" + string(trim(channelField)) + "'");
+                continue;
+            }
+            if (!parseInt(instrumentField, instrument) || instrument < 0 || instrument > 127) {
+                error(line, "bad instrument '" + string(trim(instrumentField)) + "'");
+                continue;
+            }
+            channelInstruments[channel] = instrument;
+            parseNotes(group, channel, instrument, measure, line);
+        }
+
+        section.measures.push_back(move(measure));
+    }
+
+    // "[TEMPO tick bpm]" or "[TIMESIG tick beats/unit]"; tag is the matched prefix.
+    void parseTempoLine(string_view text, string_view tag, int line)
+    {
+        size_t close = text.find(']');
+        if (close == string_view::npos) {
+            error(line, "malformed " + string(tag.substr(1, tag.size() - 2)) + " line");
+            return;
+        }
+        string_view rest = trim(text.substr(tag.size(), close - tag.size()));
+        size_t space = rest.find(' ');
+        string_view tickField = rest.substr(0, space);
+        string_view valueField = space == string_view::npos ? string_view() : rest.substr(space + 1);
+        int64_t tick;
+        if (!parseNumber(tickField, tick) || tick < 0) {
+            error(line, "bad tick '" + string(trim(tickField)) + "'");
+            return;
+        }
+        if (tag == TEMPO_TAG) {
+            double bpm;
+            if (!parseNumber(valueField, bpm) || !(bpm > 0.0)) {
+                error(line, "bad tempo '" + string(trim(valueField)) + "'");
+                return;
+            }
+            song.tempo.tempos.push_back({tick, bpmToUsPerQuarter(bpm)});
+        } else {
+            string_view beatsField = nextField(valueField, '/');
+            int beats, unit;
+            if (!parseInt(beatsField, beats) || beats < 1 || beats > 255 || !parseInt(valueField, unit) ||
+                unit < 1 || unit > 64 || (unit & (unit - 1)) != 0) {
+                error(line, "bad time signature");
+                return;
+            }
+            song.tempo.timeSignatures.push_back({tick, static_cast<uint8_t>(beats), static_cast<uint8_t>(unit)});
+        }
+    }
+
+    void parseArrangementItem(string_view text, int line)
+    {
+        ArrangementItem item;
+        string name, message;
+        if (!parseArrangementLine(text, item, name, message)) {
+            error(line, message);
+            return;
+        }
+        song.arrangement.items.push_back(item);
+        arrangementNames.push_back(move(name));
+        arrangementLines.push_back(line);
+    }
+
+    void parse(string_view text)
+    {
+        MusicSection* section = nullptr;
+        bool inArrangement = false;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            const char* nl = static_cast<const char*>(memchr(text.data() + pos, '\n', text.size() - pos));
+            size_t end = nl ? static_cast<size_t>(nl - text.data()) : text.size();
+            string_view line = text.substr(pos, end - pos);
+            pos = end + 1;
+            ++lines;
+
+            if (line.compare(0, SECTION_TAG.size(), SECTION_TAG) == 0) {
+                // Section name runs from the first space to the closing bracket.
+                size_t start = line.find(' ');
+                size_t close = line.find(']');
+                if (start == string_view::npos || close == string_view::npos || close <= start) {
+                    error(lines, "malformed section header");
+                    section = nullptr;
+                    continue;
+                }
+                song.sections.emplace_back();
+                section = &song.sections.back();
+                section->name = string(trim(line.substr(start + 1, close - start - 1)));
+                inArrangement = false;
+            } else if (line.compare(0, ARRANGEMENT_TAG.size(), ARRANGEMENT_TAG) == 0) {
+                // A later block replaces an earlier one.
+                song.arrangement.items.clear();
+                arrangementNames.clear();
+                arrangementLines.clear();
+                arrangementLine = lines;
+                inArrangement = true;
+                section = nullptr;
+            } else if (line.compare(0, TEMPO_TAG.size(), TEMPO_TAG) == 0) {
+                parseTempoLine(line, TEMPO_TAG, lines);
+                inArrangement = false;
+            } else if (line.compare(0, TIMESIG_TAG.size(), TIMESIG_TAG) == 0) {
+                parseTempoLine(line, TIMESIG_TAG, lines);
+                inArrangement = false;
+            } else if (!trim(line).empty()) {
+                if (inArrangement)
+                    parseArrangementItem(line, lines);
+                else if (section)
+                    parseMeasure(line, lines, *section);
+                else
+                    error(lines, "measure outside of a [SECTION] block");
+            }
+        }
+    }
+};
+
+// Splits text into up to count chunks that each start at a section header
+// (except the first), so sections never straddle two chunks.
+vector<string_view> splitAtSections(string_view text, unsigned count)
+{
+    vector<string_view> chunks;
+    size_t start = 0;
+    for (unsigned i = 1; i < count && start < text.size(); ++i) {
+        size_t target = max(start + 1, text.size() * i / count);
+        if (target >= text.size())
+            break;
+        size_t split = text.find("\n[SECTION", target - 1);
+        if (split == string_view::npos)
+            break;
+        ++split;   // Keep the newline with the previous chunk
+        if (split <= start)
+            continue;
+        chunks.push_back(text.substr(start, split - start));
+        start = split;
+    }
+    chunks.push_back(text.substr(start));
+    return chunks;
+}
+
+} // namespace
+
+void parseSongSheet(string_view text, ParsedSong& song, vector<SongParseError>& errors, unsigned threads)
+{
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    if (text.size() < PARALLEL_THRESHOLD)
+        threads = 1;
+
+    vector<string_view> chunks = splitAtSections(text, threads);
+    vector<ChunkParser> parsers(chunks.size());
+    if (chunks.size() == 1) {
+        parsers[0].parse(chunks[0]);
+    } else {
+        vector<thread> workers;
+        for (size_t i = 0; i < chunks.size(); ++i)
+            workers.emplace_back([&parsers, &chunks, i] { parsers[i].parse(chunks[i]); });
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    // Stitch chunks back together in file order.
+    int lineOffset = 0;
+    ChunkParser* arranged = nullptr;
+    int arrangementOffset = 0;
+    for (auto& parser : parsers) {
+        if (parser.arrangementLine) {
+            arranged = &parser;
+            arrangementOffset = lineOffset;
+        }
+        // Chunk rows land after the rows already stitched.
+        const uint32_t rowOffset = song.notes.append(parser.song.notes);
+        parser.song.notes.clear();
+        for (auto& section : parser.song.sections) {
+            for (auto& measure : section.measures)
+                measure.notes.first += rowOffset;
+            song.sections.push_back(move(section));
+        }
+        for (const auto& change : parser.song.tempo.tempos)
+            song.tempo.tempos.push_back(change);
+        for (const auto& change : parser.song.tempo.timeSignatures)
+            song.tempo.timeSignatures.push_back(change);
+        for (int channel = 0; channel < 16; ++channel) {
+            if (parser.channelInstruments[channel] >= 0)
+                song.channelInstruments[channel] = parser.channelInstruments[channel];
+        }
+        for (auto& err : parser.errors)
+            errors.push_back({err.line + lineOffset, move(err.message)});
+        lineOffset += parser.lines;
+    }
+    if (!arranged)
+        return;
+
+    // Arrangement items name sections; the first section of a name wins.
+    map<string_view, uint32_t> sectionIndex;
+    for (size_t s = song.sections.size(); s-- > 0;)
+        sectionIndex[song.sections[s].name] = static_cast<uint32_t>(s);
+    bool resolved = true;
+    for (size_t i = 0; i < arranged->song.arrangement.items.size(); ++i) {
+        ArrangementItem& item = arranged->song.arrangement.items[i];
+        if (item.type != ARRANGE_SECTION)
+            continue;
+        auto found = sectionIndex.find(arranged->arrangementNames[i]);
+        if (found == sectionIndex.end()) {
+            errors.push_back({arranged->arrangementLines[i] + arrangementOffset,
+                              "arrangement names unknown section '" + arranged->arrangementNames[i] + "'"});
+            resolved = false;
+            continue;
+        }
+        item.section = found->second;
+    }
+    string message;
+    if (resolved && !checkArrangement(arranged->song.arrangement, song.sections.size(), message)) {
+        errors.push_back({arranged->arrangementLine + arrangementOffset, message});
+        resolved = false;
+    }
+    // A broken road map is dropped; the sections still play in file order.
+    if (resolved)
+        song.arrangement = move(arranged->song.arrangement);
+}
+
+bool loadSongSheet(const string& path, ParsedSong& song, vector<SongParseError>& errors, unsigned threads)
+{
+    MappedFile file;
+    string message;
+    if (!file.open(path, message)) {
+        errors.push_back({0, message});
+        return false;
+    }
+    parseSongSheet(file.view(), song, errors, threads);
+    return true;
+}
+
+void writeSongSheet(ostream& out, const vector<MusicSection>& sections, const NoteArena& notes,
+                    const TempoTrack& tempo, const Arrangement& arrangement)
+{
+    string buffer;
+    buffer.reserve(1 << 16);
+    vector<uint32_t> sorted;
+    const PitchId* pitches = notes.pitch();
+    const uint8_t* channels = notes.channel();
+    const uint8_t* instruments = notes.instrument();
+    const uint8_t* velocities = notes.velocity();
+    const int32_t* durations = notes.duration();
+    const int32_t* onsets = notes.onset();
+    char number[24];
+
+    auto appendInt = [&buffer, &number](int value) {
+        auto result = to_chars(number, number + sizeof(number), value);
+        buffer.append(number, result.ptr);
+    };
+
+    for (const auto& change : tempo.tempos) {
+        buffer += "[TEMPO ";
+        buffer.append(number, to_chars(number, number + sizeof(number), change.tick).ptr);
+        buffer += ' ';
+        // Fewest decimals that read back as the same tempo.
+        char bpm[48];
+        const double value = usPerQuarterToBpm(change.usPerQuarter);
+        char* end = bpm;
+        for (int precision = 0; precision <= 12; ++precision) {
+            end = to_chars(bpm, bpm + sizeof(bpm), value, chars_format::fixed, precision).ptr;
+            double parsed;
+            if (from_chars(bpm, end, parsed).ec == errc() && bpmToUsPerQuarter(parsed) == change.usPerQuarter)
+                break;
+        }
+        buffer.append(bpm, end);
+        buffer += "]\n";
+    }
+    for (const auto& change : tempo.timeSignatures) {
+        buffer += "[TIMESIG ";
+        buffer.append(number, to_chars(number, number + sizeof(number), change.tick).ptr);
+        buffer += ' ';
+        appendInt(change.beats);
+        buffer += '/';
+        appendInt(change.beatUnit);
+        buffer += "]\n";
+    }
+    if (!arrangement.items.empty()) {
+        buffer += ARRANGEMENT_TAG;
+        buffer += '\n';
+        for (const auto& item : arrangement.items) {
+            bool named = item.type == ARRANGE_SECTION && item.section < sections.size();
+            buffer += formatArrangementItem(item, named ? sections[item.section].name : string());
+            buffer += '\n';
+        }
+    }
+
+    for (const auto& section : sections) {
+        buffer += "[SECTION ";
+        buffer += section.name;
+        buffer += "]\n";
+        for (const auto& measure : section.measures) {
+            appendInt(measure.measureNumber);
+            buffer += '|';
+            buffer += measure.chord;
+            buffer += '|';
+
+            // Group notes by (channel, instrument), keeping entry order within a group.
+            sorted.clear();
+            for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row)
+                sorted.push_back(row);
+            stable_sort(sorted.begin(), sorted.end(), [channels, instruments](uint32_t a, uint32_t b) {
+                if (channels[a] != channels[b])
+                    return channels[a] < channels[b];
+                return instruments[a] < instruments[b];
+            });
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                const uint32_t row = sorted[i];
+                bool newGroup = (i == 0 || channels[row] != channels[sorted[i - 1]] ||
+                                 instruments[row] != instruments[sorted[i - 1]]);
+                if (newGroup) {
+                    if (i != 0)
+                        buffer += ';';
+                    appendInt(channels[row]);
+                    buffer += ':';
+                    appendInt(instruments[row]);
+                    buffer += ':';
+                } else {
+                    buffer += ',';
+                }
+                if (channels[row] == DRUM_CHANNEL)
+                    appendInt(pitches[row]);   // Drum kits are keyed by MIDI number
+                else
+                    buffer += pitchName(pitches[row]);
+                // Velocity, length and onset only as far as they differ from the defaults.
+                const bool late = onsets[row] != 0;
+                const bool ownDuration = late || durations[row] != measure.duration;
+                if (ownDuration || velocities[row] != DEFAULT_VELOCITY) {
+                    buffer += '/';
+                    appendInt(velocities[row]);
+                }
+                if (ownDuration) {
+                    buffer += '/';
+                    appendInt(durations[row]);
+                }
+                if (late) {
+                    buffer += '/';
+                    appendInt(onsets[row]);
+                }
+            }
+
+            buffer += '|';
+            appendInt(measure.duration);
+            buffer += '\n';
+
+            if (buffer.size() > (1 << 16) - 1024) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+    }
+    out.write(buffer.data(), buffer.size());
+}
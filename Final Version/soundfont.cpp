@@ -0,0 +1,375 @@
+// soundfont.cpp
+// SF2 RIFF parsing and generator resolution. Only the header chunks are read;
+// sample data stays in the mapping until a voice plays it.
+
+#include "soundfont.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+// ===== RIFF helpers =====
+
+uint16_t get16(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(b[0] | (b[1] << 8));
+}
+
+uint32_t get32(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+}
+
+struct Chunk {
+    const char* data = nullptr;
+    uint32_t size = 0;
+};
+
+// Calls f(id, chunk) for each chunk in [p, end). Returns false if a chunk
+// runs past end.
+template <typename F>
+bool forEachChunk(const char* p, const char* end, F f)
+{
+    while (end - p >= 8) {
+        Chunk chunk;
+        chunk.size = get32(p + 4);
+        chunk.data = p + 8;
+        if (chunk.size > static_cast<size_t>(end - chunk.data))
+            return false;
+        f(string(p, 4), chunk);
+        p = chunk.data + chunk.size + (chunk.size & 1);   // Chunks are padded to even sizes
+    }
+    return true;
+}
+
+// ===== Generators =====
+
+enum Generator {
+    GEN_START_OFFSET = 0,
+    GEN_END_OFFSET = 1,
+    GEN_LOOP_START_OFFSET = 2,
+    GEN_LOOP_END_OFFSET = 3,
+    GEN_START_COARSE_OFFSET = 4,
+    GEN_END_COARSE_OFFSET = 12,
+    GEN_ATTACK_VOL_ENV = 34,
+    GEN_DECAY_VOL_ENV = 36,
+    GEN_SUSTAIN_VOL_ENV = 37,
+    GEN_RELEASE_VOL_ENV = 38,
+    GEN_INSTRUMENT = 41,
+    GEN_KEY_RANGE = 43,
+    GEN_VEL_RANGE = 44,
+    GEN_LOOP_START_COARSE_OFFSET = 45,
+    GEN_INITIAL_ATTENUATION = 48,
+    GEN_LOOP_END_COARSE_OFFSET = 50,
+    GEN_COARSE_TUNE = 51,
+    GEN_FINE_TUNE = 52,
+    GEN_SAMPLE_ID = 53,
+    GEN_SAMPLE_MODES = 54,
+    GEN_SCALE_TUNING = 56,
+    GEN_OVERRIDING_ROOT_KEY = 58,
+    GEN_COUNT = 61
+};
+
+// Generator values of one zone; ranges are stored as lo | hi << 8.
+struct ZoneGenerators {
+    int16_t value[GEN_COUNT];
+    bool set[GEN_COUNT];
+};
+
+void clearGenerators(ZoneGenerators& z)
+{
+    memset(z.value, 0, sizeof(z.value));
+    memset(z.set, 0, sizeof(z.set));
+}
+
+void instrumentDefaults(ZoneGenerators& z)
+{
+    clearGenerators(z);
+    z.value[GEN_KEY_RANGE] = static_cast<int16_t>(0x7F00);
+    z.value[GEN_VEL_RANGE] = static_cast<int16_t>(0x7F00);
+    z.value[GEN_ATTACK_VOL_ENV] = -12000;
+    z.value[GEN_DECAY_VOL_ENV] = -12000;
+    z.value[GEN_RELEASE_VOL_ENV] = -12000;
+    z.value[GEN_SCALE_TUNING] = 100;
+    z.value[GEN_OVERRIDING_ROOT_KEY] = -1;
+}
+
+void presetDefaults(ZoneGenerators& z)
+{
+    clearGenerators(z);
+    z.value[GEN_KEY_RANGE] = static_cast<int16_t>(0x7F00);
+    z.value[GEN_VEL_RANGE] = static_cast<int16_t>(0x7F00);
+}
+
+// Applies the gen records [first, last) (4 bytes each) on top of z.
+void applyGenerators(ZoneGenerators& z, const char* gens, uint32_t first, uint32_t last)
+{
+    for (uint32_t g = first; g < last; ++g) {
+        const char* rec = gens + g * 4;
+        uint16_t oper = get16(rec);
+        if (oper >= GEN_COUNT)
+            continue;
+        z.value[oper] = static_cast<int16_t>(get16(rec + 2));
+        z.set[oper] = true;
+    }
+}
+
+// Terminal generator of a zone (instrument or sampleID), or -1 for a global zone.
+int zoneTarget(const char* gens, uint32_t first, uint32_t last, uint16_t terminal)
+{
+    for (uint32_t g = first; g < last; ++g) {
+        if (get16(gens + g * 4) == terminal)
+            return get16(gens + g * 4 + 2);
+    }
+    return -1;
+}
+
+uint8_t rangeLow(int16_t range) { return static_cast<uint8_t>(range & 0xFF); }
+uint8_t rangeHigh(int16_t range) { return static_cast<uint8_t>((range >> 8) & 0xFF); }
+
+float timecentsToSeconds(int timecents)
+{
+    return static_cast<float>(pow(2.0, max(-12000, min(8000, timecents)) / 1200.0));
+}
+
+float centibelsToGain(int centibels)
+{
+    return static_cast<float>(pow(10.0, -max(0, min(1440, centibels)) / 200.0));
+}
+
+// Record arrays of the pdta chunk.
+struct Hydra {
+    Chunk phdr, pbag, pgen, inst, ibag, igen, shdr;
+};
+
+bool recordCount(const Chunk& chunk, uint32_t recordSize, uint32_t& count)
+{
+    if (!chunk.data || chunk.size % recordSize != 0 || chunk.size / recordSize < 2)
+        return false;
+    count = chunk.size / recordSize;
+    return true;
+}
+
+} // namespace
+
+bool SoundFont::open(const string& path, string& error)
+{
+    presetList.clear();
+    regions.clear();
+    presetIndex.clear();
+    sampleData = nullptr;
+    sampleFrames = 0;
+    // Notes jump around the sample data, so read-ahead would only waste memory.
+    if (!file.open(path, error, ACCESS_RANDOM))
+        return false;
+
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    if (file.size() < 12 || memcmp(begin, "RIFF", 4) != 0 || memcmp(begin + 8, "sfbk", 4) != 0) {
+        error = path + ": not a SoundFont 2 file";
+        return false;
+    }
+    end = begin + min<size_t>(file.size(), size_t(8) + get32(begin + 4));
+
+    Chunk smpl;
+    Hydra hydra;
+    bool ok = forEachChunk(begin + 12, end, [&](const string& id, const Chunk& list) {
+        if (id != "LIST" || list.size < 4)
+            return;
+        string type(list.data, 4);
+        forEachChunk(list.data + 4, list.data + list.size, [&](const string& sub, const Chunk& c) {
+            if (type == "sdta" && sub == "smpl") smpl = c;
+            else if (type == "pdta" && sub == "phdr") hydra.phdr = c;
+            else if (type == "pdta" && sub == "pbag") hydra.pbag = c;
+            else if (type == "pdta" && sub == "pgen") hydra.pgen = c;
+            else if (type == "pdta" && sub == "inst") hydra.inst = c;
+            else if (type == "pdta" && sub == "ibag") hydra.ibag = c;
+            else if (type == "pdta" && sub == "igen") hydra.igen = c;
+            else if (type == "pdta" && sub == "shdr") hydra.shdr = c;
+        });
+    });
+
+    uint32_t presetCount, pbagCount, pgenCount, instCount, ibagCount, igenCount, sampleCount;
+    if (!ok || !smpl.data || !recordCount(hydra.phdr, 38, presetCount) || !recordCount(hydra.pbag, 4, pbagCount)
+        || !recordCount(hydra.pgen, 4, pgenCount) || !recordCount(hydra.inst, 22, instCount)
+        || !recordCount(hydra.ibag, 4, ibagCount) || !recordCount(hydra.igen, 4, igenCount)
+        || !recordCount(hydra.shdr, 46, sampleCount)) {
+        error = path + ": missing or malformed SoundFont chunks";
+        return false;
+    }
+    sampleOffset = static_cast<size_t>(smpl.data - begin);
+    if (sampleOffset % 2 != 0) {
+        error = path + ": misaligned sample data";
+        return false;
+    }
+    sampleData = reinterpret_cast<const int16_t*>(smpl.data);
+    sampleFrames = smpl.size / 2;
+
+    // Every bag/gen index must be ascending and inside its array, so the zone
+    // loops below can index without further checks.
+    auto bagRange = [](const Chunk& headers, uint32_t recordSize, uint32_t bagOffset, uint32_t i,
+                       uint32_t bagCount, uint32_t& first, uint32_t& last) {
+        first = get16(headers.data + i * recordSize + bagOffset);
+        last = get16(headers.data + (i + 1) * recordSize + bagOffset);
+        return first <= last && last < bagCount;
+    };
+    auto genRange = [](const Chunk& bags, uint32_t i, uint32_t genCount, uint32_t& first, uint32_t& last) {
+        first = get16(bags.data + i * 4);
+        last = get16(bags.data + (i + 1) * 4);
+        return first <= last && last <= genCount;
+    };
+
+    for (uint32_t p = 0; p + 1 < presetCount; ++p) {
+        const char* header = hydra.phdr.data + p * 38;
+        SoundFontPreset preset;
+        preset.name.assign(header, strnlen(header, 20));
+        preset.program = get16(header + 20);
+        preset.bank = get16(header + 22);
+        preset.firstRegion = static_cast<uint32_t>(regions.size());
+
+        uint32_t bagFirst, bagLast;
+        if (!bagRange(hydra.phdr, 38, 24, p, pbagCount, bagFirst, bagLast)) {
+            error = path + ": preset " + preset.name + " has bad zone indices";
+            return false;
+        }
+        ZoneGenerators presetGlobal;
+        presetDefaults(presetGlobal);
+        for (uint32_t b = bagFirst; b < bagLast; ++b) {
+            uint32_t genFirst, genLast;
+            if (!genRange(hydra.pbag, b, pgenCount, genFirst, genLast)) {
+                error = path + ": preset " + preset.name + " has bad generator indices";
+                return false;
+            }
+            int instrument = zoneTarget(hydra.pgen.data, genFirst, genLast, GEN_INSTRUMENT);
+            if (instrument < 0) {
+                if (b == bagFirst)
+                    applyGenerators(presetGlobal, hydra.pgen.data, genFirst, genLast);
+                continue;
+            }
+            if (static_cast<uint32_t>(instrument) + 1 >= instCount)
+                continue;
+            ZoneGenerators pz = presetGlobal;
+            applyGenerators(pz, hydra.pgen.data, genFirst, genLast);
+
+            uint32_t ibagFirst, ibagLast;
+            if (!bagRange(hydra.inst, 22, 20, instrument, ibagCount, ibagFirst, ibagLast)) {
+                error = path + ": instrument " + to_string(instrument) + " has bad zone indices";
+                return false;
+            }
+            ZoneGenerators instGlobal;
+            instrumentDefaults(instGlobal);
+            for (uint32_t ib = ibagFirst; ib < ibagLast; ++ib) {
+                uint32_t igenFirst, igenLast;
+                if (!genRange(hydra.ibag, ib, igenCount, igenFirst, igenLast)) {
+                    error = path + ": instrument " + to_string(instrument) + " has bad generator indices";
+                    return false;
+                }
+                int sampleId = zoneTarget(hydra.igen.data, igenFirst, igenLast, GEN_SAMPLE_ID);
+                if (sampleId < 0) {
+                    if (ib == ibagFirst)
+                        applyGenerators(instGlobal, hydra.igen.data, igenFirst, igenLast);
+                    continue;
+                }
+                if (static_cast<uint32_t>(sampleId) + 1 >= sampleCount)
+                    continue;
+                ZoneGenerators iz = instGlobal;
+                applyGenerators(iz, hydra.igen.data, igenFirst, igenLast);
+
+                const char* sh = hydra.shdr.data + sampleId * 46;
+                if (get16(sh + 44) & 0x8000)
+                    continue;   // ROM sample, not stored in the file
+
+                // Preset values are offsets on top of the instrument's; key and
+                // velocity ranges are intersected.
+                auto sum = [&](int gen) { return int(iz.value[gen]) + (pz.set[gen] ? pz.value[gen] : 0); };
+                SoundFontRegion r;
+                r.keyLow = max(rangeLow(iz.value[GEN_KEY_RANGE]), rangeLow(pz.value[GEN_KEY_RANGE]));
+                r.keyHigh = min(rangeHigh(iz.value[GEN_KEY_RANGE]), rangeHigh(pz.value[GEN_KEY_RANGE]));
+                r.velocityLow = max(rangeLow(iz.value[GEN_VEL_RANGE]), rangeLow(pz.value[GEN_VEL_RANGE]));
+                r.velocityHigh = min(rangeHigh(iz.value[GEN_VEL_RANGE]), rangeHigh(pz.value[GEN_VEL_RANGE]));
+                if (r.keyLow > r.keyHigh || r.velocityLow > r.velocityHigh)
+                    continue;
+
+                auto offset = [&](int fine, int coarse) {
+                    return int64_t(iz.value[fine]) + int64_t(iz.value[coarse]) * 32768;
+                };
+                int64_t start = get32(sh + 20) + offset(GEN_START_OFFSET, GEN_START_COARSE_OFFSET);
+                int64_t stop = get32(sh + 24) + offset(GEN_END_OFFSET, GEN_END_COARSE_OFFSET);
+                int64_t loopStart = get32(sh + 28) + offset(GEN_LOOP_START_OFFSET, GEN_LOOP_START_COARSE_OFFSET);
+                int64_t loopEnd = get32(sh + 32) + offset(GEN_LOOP_END_OFFSET, GEN_LOOP_END_COARSE_OFFSET);
+                // Interpolation reads one frame past the end, which the SF2
+                // format guarantees (each sample is followed by silence).
+                stop = min<int64_t>(stop, int64_t(sampleFrames) - 1);
+                if (start < 0 || start >= stop)
+                    continue;
+                r.start = static_cast<uint32_t>(start);
+                r.end = static_cast<uint32_t>(stop);
+                r.loopMode = static_cast<uint8_t>(iz.value[GEN_SAMPLE_MODES] & 3);
+                if (r.loopMode == 2)
+                    r.loopMode = 0;   // Reserved, plays as unlooped
+                if (loopStart < start || loopEnd > stop || loopEnd - loopStart < 2)
+                    r.loopMode = 0;
+                r.loopStart = r.loopMode ? static_cast<uint32_t>(loopStart) : r.start;
+                r.loopEnd = r.loopMode ? static_cast<uint32_t>(loopEnd) : r.end;
+
+                int rootKey = iz.value[GEN_OVERRIDING_ROOT_KEY];
+                if (rootKey < 0 || rootKey > 127)
+                    rootKey = static_cast<uint8_t>(sh[40]);
+                r.rootKey = static_cast<uint8_t>(rootKey > 127 ? 60 : rootKey);
+                r.tuneCents = static_cast<int16_t>(sum(GEN_COARSE_TUNE) * 100 + sum(GEN_FINE_TUNE)
+                                                   + static_cast<int8_t>(sh[41]));
+                r.scaleTuning = static_cast<int16_t>(sum(GEN_SCALE_TUNING));
+                r.sampleRate = max<uint32_t>(1, get32(sh + 36));
+                r.gain = centibelsToGain(sum(GEN_INITIAL_ATTENUATION));
+                r.attackSec = timecentsToSeconds(sum(GEN_ATTACK_VOL_ENV));
+                r.decaySec = timecentsToSeconds(sum(GEN_DECAY_VOL_ENV));
+                r.sustain = centibelsToGain(sum(GEN_SUSTAIN_VOL_ENV));
+                r.releaseSec = timecentsToSeconds(sum(GEN_RELEASE_VOL_ENV));
+                regions.push_back(r);
+            }
+        }
+        preset.regionCount = static_cast<uint32_t>(regions.size()) - preset.firstRegion;
+        presetIndex.emplace((uint32_t(preset.bank) << 8) | (preset.program & 0xFF),
+                            static_cast<uint32_t>(presetList.size()));
+        presetList.push_back(move(preset));
+    }
+    return true;
+}
+
+const SoundFontPreset* SoundFont::findPreset(int bank, int program) const
+{
+    auto lookup = [this](int b, int p) -> const SoundFontPreset* {
+        auto it = presetIndex.find((uint32_t(b) << 8) | (p & 0xFF));
+        return it == presetIndex.end() ? nullptr : &presetList[it->second];
+    };
+    const SoundFontPreset* preset = lookup(bank, program);
+    if (!preset)
+        preset = (bank == SF2_DRUM_BANK) ? lookup(SF2_DRUM_BANK, 0) : lookup(0, program);
+    return preset;
+}
+
+int SoundFont::findRegions(const SoundFontPreset& preset, int key, int velocity,
+                           const SoundFontRegion** out, int maxRegions) const
+{
+    int count = 0;
+    for (uint32_t i = 0; i < preset.regionCount && count < maxRegions; ++i) {
+        const SoundFontRegion& r = regions[preset.firstRegion + i];
+        if (key >= r.keyLow && key <= r.keyHigh && velocity >= r.velocityLow && velocity <= r.velocityHigh)
+            out[count++] = &r;
+    }
+    return count;
+}
+
+void SoundFont::prefetchPreset(const SoundFontPreset& preset) const
+{
+    for (uint32_t i = 0; i < preset.regionCount; ++i) {
+        const SoundFontRegion& r = regions[preset.firstRegion + i];
+        file.prefetch(sampleOffset + size_t(r.start) * 2, (size_t(r.end) - r.start + 1) * 2);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef SOUNDFONT_H
+#define SOUNDFONT_H
+
+// SoundFont 2 (.sf2) sample banks for the offline renderer.
+// open() maps the file and parses only the preset/instrument/sample headers
+// (the "pdta" chunk, usually well under 1 MB); the sample data is never read
+// during open. Each preset is flattened into regions that already combine the
+// preset and instrument generators, so starting a note is a range check over
+// a few regions. Sample pages are read from disk the first time a note
+// plays them, so only the instruments a song uses become resident.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+using namespace std;
+
+const int SF2_DRUM_BANK = 128;
+
+// One key/velocity zone of a preset, ready to play.
+struct SoundFontRegion {
+    uint8_t keyLow, keyHigh;
+    uint8_t velocityLow, velocityHigh;
+    // Sample frame indices into SoundFont::samples()
+    uint32_t start, end;
+    uint32_t loopStart, loopEnd;
+    uint8_t loopMode;         // 0 none, 1 continuous, 3 until release
+    uint8_t rootKey;
+    int16_t tuneCents;        // Coarse + fine tune + sample pitch correction
+    int16_t scaleTuning;      // Cents per key (100 = normal keyboard)
+    uint32_t sampleRate;
+    float gain;               // From initial attenuation
+    float attackSec, decaySec, sustain, releaseSec;
+};
+
+struct SoundFontPreset {
+    string name;
+    uint16_t bank, program;
+    uint32_t firstRegion, regionCount;   // Range in SoundFont's region list
+};
+
+class SoundFont {
+public:
+    // Maps path and parses its headers. On failure returns false and sets error.
+    bool open(const string& path, string& error);
+
+    // Preset for bank/program; falls back to bank 0 (or program 0 of the drum
+    // bank) like a GM synth does. Null if there is nothing usable.
+    const SoundFontPreset* findPreset(int bank, int program) const;
+
+    // Regions of preset that cover key at velocity; writes up to maxRegions
+    // pointers and returns how many were written.
+    int findRegions(const SoundFontPreset& preset, int key, int velocity,
+                    const SoundFontRegion** out, int maxRegions) const;
+
+    // Starts reading the samples preset uses, ahead of its first note.
+    void prefetchPreset(const SoundFontPreset& preset) const;
+
+    const int16_t* samples() const { return sampleData; }
+    size_t sampleCount() const { return sampleFrames; }
+    const vector<SoundFontPreset>& presets() const { return presetList; }
+
+private:
+    MappedFile file;
+    const int16_t* sampleData = nullptr;
+    size_t sampleFrames = 0;
+    size_t sampleOffset = 0;                       // Byte offset of sampleData in the file
+    vector<SoundFontPreset> presetList;
+    vector<SoundFontRegion> regions;
+    unordered_map<uint32_t, uint32_t> presetIndex;   // bank << 8 | program -> presetList index
+};
+
+#endif // SOUNDFONT_H
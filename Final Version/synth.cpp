@@ -0,0 +1,375 @@
+// synth.cpp
+// Offline renderer: turns songSections into PCM using band-limited oscillators
+// or SoundFont samples, and the block mixer. Reads the compiled timeline, so timing matches MIDI
+// playback exactly; blocks are split at event frames, so every note starts and
+// stops on its exact sample.
+
+#include "synth.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include "mixer.h"
+#include "oscillator.h"
+#include "soundfont.h"
+#include "voice_pool.h"
+
+using namespace std;
+
+namespace {
+
+const int BLOCK_FRAMES = MIX_BLOCK_FRAMES;
+
+// Tone shaping for one GM program family.
+struct Patch {
+    OscillatorShape wave;
+    float attackSec;
+    float decaySec;     // Time constant toward the sustain level
+    float sustain;
+    float releaseSec;
+    float gain;
+};
+
+// GM programs come in families of eight (piano, chromatic percussion, organ, ...).
+Patch patchForInstrument(int instrument)
+{
+    static const Patch families[16] = {
+        {OSC_TRIANGLE, 0.002f, 0.60f, 0.25f, 0.08f, 1.00f}, // Piano
+        {OSC_SINE,     0.001f, 0.30f, 0.00f, 0.10f, 1.00f}, // Chromatic percussion
+        {OSC_SQUARE,   0.010f, 1.00f, 1.00f, 0.05f, 0.45f}, // Organ
+        {OSC_SAW,      0.002f, 0.40f, 0.20f, 0.08f, 0.60f}, // Guitar
+        {OSC_TRIANGLE, 0.005f, 0.50f, 0.70f, 0.05f, 1.10f}, // Bass
+        {OSC_SAW,      0.080f, 1.00f, 0.90f, 0.20f, 0.50f}, // Strings
+        {OSC_SAW,      0.060f, 1.00f, 0.90f, 0.25f, 0.50f}, // Ensemble / choir
+        {OSC_SAW,      0.030f, 0.50f, 0.80f, 0.08f, 0.55f}, // Brass
+        {OSC_SQUARE,   0.030f, 0.50f, 0.80f, 0.06f, 0.45f}, // Reed
+        {OSC_SINE,     0.040f, 0.50f, 0.85f, 0.08f, 0.90f}, // Pipe / flute
+        {OSC_SAW,      0.005f, 0.50f, 0.80f, 0.05f, 0.50f}, // Synth lead
+        {OSC_TRIANGLE, 0.150f, 1.00f, 0.90f, 0.40f, 0.80f}, // Synth pad
+        {OSC_SQUARE,   0.020f, 0.60f, 0.50f, 0.20f, 0.40f}, // Synth effects
+        {OSC_TRIANGLE, 0.002f, 0.40f, 0.30f, 0.10f, 0.90f}, // Ethnic
+        {OSC_SINE,     0.001f, 0.20f, 0.00f, 0.05f, 1.00f}, // Percussive
+        {OSC_SINE,     0.010f, 0.30f, 0.30f, 0.10f, 0.60f}  // Sound effects
+    };
+    if (instrument < 0 || instrument > 127)
+        instrument = 0;
+    return families[instrument / 8];
+}
+
+const int MAX_SAMPLE_LAYERS = 2;   // Enough for stereo pairs and velocity crossfades
+
+// One SoundFont region sounding in a voice.
+struct SampleLayer {
+    const int16_t* data;      // SoundFont::samples()
+    uint32_t end, loopStart, loopEnd;
+    uint8_t loopMode;         // As SoundFontRegion; 3 becomes 0 on release
+    bool playing;
+    uint64_t position;        // 32.32 fixed-point frame index into data
+    uint64_t step;
+    float gain;
+};
+
+struct Voice {
+    int channel;
+    int midiNote;
+    bool drum;
+    Oscillator osc;
+    uint32_t noiseState;
+    int layerCount;           // > 0: play SoundFont samples instead of osc
+    SampleLayer layers[MAX_SAMPLE_LAYERS];
+    float amplitude;          // Patch gain scaled by velocity
+    Envelope env;
+};
+
+double midiToFrequency(int midiNote)
+{
+    return 440.0 * pow(2.0, (midiNote - 69) / 12.0);
+}
+
+// Sets v up to play the regions of preset that cover the note. Returns false
+// if none do, leaving the built-in synth to play it.
+bool startSampleVoice(Voice& v, const SoundFont& font, const SoundFontPreset& preset, int midiNote,
+                      int velocity, int sampleRate)
+{
+    const SoundFontRegion* regions[MAX_SAMPLE_LAYERS];
+    v.layerCount = font.findRegions(preset, midiNote, velocity, regions, MAX_SAMPLE_LAYERS);
+    if (v.layerCount == 0)
+        return false;
+    for (int i = 0; i < v.layerCount; ++i) {
+        const SoundFontRegion& r = *regions[i];
+        SampleLayer& layer = v.layers[i];
+        double cents = (midiNote - r.rootKey) * r.scaleTuning + r.tuneCents;
+        double ratio = pow(2.0, cents / 1200.0) * r.sampleRate / sampleRate;
+        layer.data = font.samples();
+        layer.end = r.end;
+        layer.loopStart = r.loopStart;
+        layer.loopEnd = r.loopEnd;
+        layer.loopMode = r.loopMode;
+        layer.playing = true;
+        layer.position = uint64_t(r.start) << 32;
+        layer.step = static_cast<uint64_t>(ratio * 4294967296.0);
+        layer.gain = r.gain * (1.0f / 32768.0f);
+    }
+    // The first region shapes the voice. SF2 decay and release are 100 dB
+    // exponential fades: the decay time constant is a 100 dB fade's length / 11.5,
+    // and the linear release ends about where the fade would reach -40 dB.
+    const SoundFontRegion& r = *regions[0];
+    startEnvelope(v.env, r.attackSec, r.decaySec / 11.513f, r.sustain, r.releaseSec * 0.4f, sampleRate);
+    // Squared velocity is close to the SF2 default velocity-to-attenuation curve.
+    v.amplitude = (velocity / 127.0f) * (velocity / 127.0f);
+    return true;
+}
+
+void startVoice(Voice& v, int channel, int midiNote, int velocity, int instrument, int sampleRate,
+                const SoundFont* font, const SoundFontPreset* preset)
+{
+    v.channel = channel;
+    v.midiNote = midiNote;
+    v.drum = (channel == DRUM_CHANNEL);
+    v.noiseState = 0x9E3779B9u ^ static_cast<uint32_t>(midiNote * 2654435761u);
+    v.layerCount = 0;
+    if (font && preset && startSampleVoice(v, *font, *preset, midiNote, velocity, sampleRate))
+        return;
+
+    Patch p;
+    if (v.drum) {
+        // Kicks (35/36) are a low sine thump, everything else is a noise burst.
+        bool kick = (midiNote == 35 || midiNote == 36);
+        p = {OSC_SINE, 0.001f, kick ? 0.12f : 0.06f, 0.0f, 0.03f, kick ? 1.2f : 0.5f};
+        v.drum = !kick;
+        setupOscillator(v.osc, OSC_SINE, 55.0, sampleRate);
+    } else {
+        p = patchForInstrument(instrument);
+        setupOscillator(v.osc, p.wave, midiToFrequency(midiNote), sampleRate);
+    }
+    v.amplitude = p.gain * velocity / 127.0f;
+    startEnvelope(v.env, p.attackSec, p.decaySec, p.sustain, p.releaseSec, sampleRate);
+}
+
+void releaseVoice(Voice& v)
+{
+    releaseEnvelope(v.env);
+    for (int i = 0; i < v.layerCount; ++i) {
+        if (v.layers[i].loopMode == 3)
+            v.layers[i].loopMode = 0;   // Loop until release: play on to the end
+    }
+}
+
+// Writes frames of the voice's sample layers (linear interpolation) to wave.
+// Ends the voice once every unlooped layer has played to its end.
+void renderSampleLayers(Voice& v, float* wave, int frames)
+{
+    fill(wave, wave + frames, 0.0f);
+    bool playing = false;
+    for (int l = 0; l < v.layerCount; ++l) {
+        SampleLayer& layer = v.layers[l];
+        if (!layer.playing)
+            continue;
+        const uint64_t loopLength = uint64_t(layer.loopEnd - layer.loopStart) << 32;
+        for (int i = 0; i < frames; ++i) {
+            uint32_t index = static_cast<uint32_t>(layer.position >> 32);
+            if (layer.loopMode != 0) {
+                while (index >= layer.loopEnd) {
+                    layer.position -= loopLength;
+                    index = static_cast<uint32_t>(layer.position >> 32);
+                }
+            } else if (index >= layer.end) {
+                layer.playing = false;
+                break;
+            }
+            float frac = static_cast<uint32_t>(layer.position) * (1.0f / 4294967296.0f);
+            float a = layer.data[index];
+            float b = layer.data[index + 1];
+            wave[i] += (a + (b - a) * frac) * layer.gain;
+            layer.position += layer.step;
+        }
+        playing = playing || layer.playing;
+    }
+    if (!playing) {
+        v.env.stage = ENV_DONE;
+        v.env.level = 0.0f;
+    }
+}
+
+// Adds frames of one voice into its channel's buffer on the mix bus.
+void renderVoice(Voice& v, float* out, int frames)
+{
+    // Envelope first: once it finishes there is nothing left to synthesize.
+    float gain[BLOCK_FRAMES];
+    frames = renderEnvelope(v.env, gain, frames);
+    if (frames == 0)
+        return;
+
+    float wave[BLOCK_FRAMES];
+    if (v.layerCount > 0) {
+        renderSampleLayers(v, wave, frames);
+    } else if (v.drum) {
+        for (int i = 0; i < frames; ++i) {
+            v.noiseState ^= v.noiseState << 13;
+            v.noiseState ^= v.noiseState >> 17;
+            v.noiseState ^= v.noiseState << 5;
+            wave[i] = static_cast<int32_t>(v.noiseState) * (1.0f / 2147483648.0f);
+        }
+    } else {
+        renderOscillator(v.osc, wave, frames);
+    }
+
+    const float amplitude = v.amplitude;
+    for (int i = 0; i < frames; ++i)
+        out[i] += wave[i] * gain[i] * amplitude;
+}
+
+void writeLE(ofstream& file, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        file.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+void writeWavHeader(ofstream& file, int sampleRate, uint32_t dataBytes)
+{
+    file.write("RIFF", 4);
+    writeLE(file, 36 + dataBytes, 4);
+    file.write("WAVEfmt ", 8);
+    writeLE(file, 16, 4);              // PCM fmt chunk size
+    writeLE(file, 1, 2);               // PCM
+    writeLE(file, 2, 2);               // Stereo
+    writeLE(file, sampleRate, 4);
+    writeLE(file, sampleRate * 4, 4);  // Byte rate
+    writeLE(file, 4, 2);               // Block align
+    writeLE(file, 16, 2);              // Bits per sample
+    file.write("data", 4);
+    writeLE(file, dataBytes, 4);
+}
+
+void floatToPCM(const float* in, int16_t* out, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        float s = in[i];
+        s = s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s);
+        out[i] = static_cast<int16_t>(s * 32767.0f);
+    }
+}
+
+} // namespace
+
+int64_t renderTimeline(const Timeline& timeline, const RenderSettings& settings,
+                       const RenderBlockSink& sink)
+{
+    const int sampleRate = settings.sampleRate;
+    const vector<TimelineEvent>& events = timeline.events;
+    if (events.empty())
+        return 0;
+
+    int programs[16] = {0};
+    // SoundFont preset per channel, looked up when the channel's program first
+    // plays; that is also when its sample pages are first requested.
+    const SoundFont* font = settings.soundFont;
+    const SoundFontPreset* presets[16] = {nullptr};
+    int presetProgram[16];
+    fill(presetProgram, presetProgram + 16, -1);
+    auto presetFor = [&](int channel) {
+        if (font && presetProgram[channel] != programs[channel]) {
+            presetProgram[channel] = programs[channel];
+            presets[channel] = font->findPreset(channel == DRUM_CHANNEL ? SF2_DRUM_BANK : 0, programs[channel]);
+            if (presets[channel])
+                font->prefetchPreset(*presets[channel]);
+        }
+        return presets[channel];
+    };
+    // Everything the loop below touches is allocated here, once.
+    VoicePool pool(settings.polyphony);
+    vector<Voice> voices(pool.polyphony());
+    auto loudness = [&voices](int slot) { return voices[slot].env.level * voices[slot].amplitude; };
+    MixBus bus;
+    for (int ch = 0; ch < MIX_CHANNELS; ++ch)
+        bus.setStrip(ch, settings.channels[ch]);
+    float stereo[BLOCK_FRAMES * 2];
+
+    auto eventFrame = [sampleRate](const TimelineEvent& e) {
+        return e.timeUs * sampleRate / 1000000;
+    };
+
+    int64_t frame = 0;
+    size_t nextEvent = 0;
+    while (nextEvent < events.size() || pool.activeCount() > 0) {
+        // Apply every event that is due at the current frame.
+        while (nextEvent < events.size() && eventFrame(events[nextEvent]) <= frame) {
+            const TimelineEvent& ev = events[nextEvent++];
+            if (ev.type == EVENT_PROGRAM_CHANGE) {
+                programs[ev.channel] = ev.data1;
+            } else if (ev.type == EVENT_NOTE_ON || ev.type == EVENT_NOTE_OFF) {
+                int slot = pool.held(ev.channel, ev.data1);
+                if (slot != VoicePool::NO_VOICE) {
+                    releaseVoice(voices[slot]);
+                    pool.release(slot);
+                }
+                if (ev.type == EVENT_NOTE_ON) {
+                    bool stolen;
+                    slot = pool.allocate(ev.channel, ev.data1, loudness, stolen);
+                    startVoice(voices[slot], ev.channel, ev.data1, ev.data2, programs[ev.channel], sampleRate,
+                               font, presetFor(ev.channel));
+                }
+            }
+        }
+        if (nextEvent == events.size()) {
+            // Nothing can release a note any more; let hanging notes fade out.
+            for (size_t i = 0; i < pool.activeCount(); ++i) {
+                int slot = pool.activeSlot(i);
+                releaseVoice(voices[slot]);
+                pool.release(slot);
+            }
+        }
+
+        // Render up to the next event or the end of the block, whichever is first.
+        int frames = BLOCK_FRAMES;
+        if (nextEvent < events.size())
+            frames = static_cast<int>(min<int64_t>(frames, eventFrame(events[nextEvent]) - frame));
+
+        for (size_t i = 0; i < pool.activeCount();) {
+            int slot = pool.activeSlot(i);
+            Voice& v = voices[slot];
+            renderVoice(v, bus.channelBuffer(v.channel, frames), frames);
+            if (v.env.stage == ENV_DONE)
+                pool.retire(slot);   // The last active slot moves into index i
+            else
+                ++i;
+        }
+
+        bus.mix(stereo, frames, settings.masterGain);
+        sink(stereo, frames);
+        frame += frames;
+    }
+    return frame;
+}
+
+vector<int16_t> renderTimelineToPCM(const Timeline& timeline, const RenderSettings& settings)
+{
+    vector<int16_t> pcm;
+    renderTimeline(timeline, settings, [&pcm](const float* samples, int frames) {
+        size_t offset = pcm.size();
+        pcm.resize(offset + frames * 2);
+        floatToPCM(samples, pcm.data() + offset, frames * 2);
+    });
+    return pcm;
+}
+
+bool renderTimelineToWavFile(const Timeline& timeline, const string& filename,
+                             const RenderSettings& settings)
+{
+    ofstream file(filename, ios::binary);
+    if (!file)
+        return false;
+
+    // Header is rewritten with the real sizes once the length is known.
+    writeWavHeader(file, settings.sampleRate, 0);
+    int16_t pcm[BLOCK_FRAMES * 2];
+    int64_t frames = renderTimeline(timeline, settings, [&](const float* samples, int count) {
+        floatToPCM(samples, pcm, count * 2);
+        file.write(reinterpret_cast<const char*>(pcm), count * 2 * sizeof(int16_t));
+    });
+
+    file.seekp(0);
+    writeWavHeader(file, settings.sampleRate, static_cast<uint32_t>(frames * 4));
+    return static_cast<bool>(file);
+}
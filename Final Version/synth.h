@@ -0,0 +1,49 @@
+#pragma once
+#ifndef SYNTH_H
+#define SYNTH_H
+
+// Offline software synthesizer.
+// Reads the same compiled timeline the MIDI playback uses (note-ons, note-offs,
+// program changes) and renders it to PCM with a small built-in synth, or with
+// the samples of a SoundFont, so a song can be auditioned or exported without
+// any audio device.
+// Portable: depends only on timeline.h, mixer.h, oscillator.h, soundfont.h,
+// voice_pool.h and the standard library.
+
+#include <cstdint>
+#include <functional>
+
+#include "mixer.h"
+#include "timeline.h"
+
+class SoundFont;
+
+// Output format and master controls for offline rendering.
+struct RenderSettings {
+    int sampleRate = 44100;
+    float masterGain = 0.35f;   // Headroom for dense measures; a centred channel is -3 dB per side
+    int polyphony = 64;         // Voices preallocated; extra notes steal the quietest
+    ChannelStrip channels[MIX_CHANNELS];   // Volume and pan per MIDI channel
+    // Sample bank for GM programs (drums use bank 128). Programs or keys it
+    // does not cover fall back to the built-in synth. Not owned.
+    const SoundFont* soundFont = nullptr;
+};
+
+// Receives each finished block of interleaved stereo float samples.
+typedef function<void(const float* samples, int frames)> RenderBlockSink;
+
+// Renders the timeline, handing interleaved stereo blocks to sink.
+// Returns the number of frames rendered.
+int64_t renderTimeline(const Timeline& timeline, const RenderSettings& settings,
+                       const RenderBlockSink& sink);
+
+// Renders the timeline to interleaved 16-bit stereo PCM in memory.
+vector<int16_t> renderTimelineToPCM(const Timeline& timeline,
+                                    const RenderSettings& settings = RenderSettings());
+
+// Renders the timeline and streams it to a 16-bit stereo WAV file.
+// Returns false if the file cannot be written.
+bool renderTimelineToWavFile(const Timeline& timeline, const string& filename,
+                             const RenderSettings& settings = RenderSettings());
+
+#endif // SYNTH_H
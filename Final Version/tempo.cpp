@@ -0,0 +1,123 @@
+// tempo.cpp
+// Tempo track compilation and tick <-> time conversion.
+
+#include "tempo.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// a / b rounded to the nearest integer (b > 0).
+int64_t roundDiv(int64_t a, int64_t b)
+{
+    return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+// Sorts changes by tick, keeping the last of several at one tick, and makes
+// sure the first one starts at tick 0.
+template <typename T>
+vector<T> mergeChanges(vector<T> changes, const T& initial)
+{
+    stable_sort(changes.begin(), changes.end(), [](const T& a, const T& b) { return a.tick < b.tick; });
+    vector<T> merged;
+    merged.push_back(initial);
+    for (const T& change : changes) {
+        if (change.tick < 0)
+            continue;
+        if (merged.back().tick == change.tick)
+            merged.back() = change;
+        else
+            merged.push_back(change);
+    }
+    return merged;
+}
+
+} // namespace
+
+uint32_t bpmToUsPerQuarter(double bpm)
+{
+    if (!(bpm > 0.0))
+        return DEFAULT_US_PER_QUARTER;
+    // SMF tempos are 24-bit.
+    return static_cast<uint32_t>(min(16777215.0, max(1.0, floor(60000000.0 / bpm + 0.5))));
+}
+
+double usPerQuarterToBpm(uint32_t usPerQuarter)
+{
+    return 60000000.0 / max<uint32_t>(1, usPerQuarter);
+}
+
+TempoMap::TempoMap(const TempoTrack& track, int ticksPerQuarterValue)
+    : ticksPerQuarter(max(1, ticksPerQuarterValue))
+{
+    vector<TempoChange> tempos;
+    for (const auto& change : track.tempos) {
+        if (change.usPerQuarter > 0)
+            tempos.push_back(change);
+    }
+    tempoChanges = mergeChanges(move(tempos), TempoChange{0, DEFAULT_US_PER_QUARTER});
+
+    vector<TimeSignatureChange> meters;
+    for (const auto& change : track.timeSignatures) {
+        if (change.beats > 0 && change.beatUnit > 0)
+            meters.push_back(change);
+    }
+    signatures = mergeChanges(move(meters), TimeSignatureChange{0, 4, 4});
+
+    // Running sum of segment lengths: each segment's start time.
+    segmentStartUs.resize(tempoChanges.size());
+    segmentUsPerTick.resize(tempoChanges.size());
+    segmentStartUs[0] = 0;
+    for (size_t i = 0; i < tempoChanges.size(); ++i) {
+        const TempoChange& c = tempoChanges[i];
+        // The default tempo (and any whole-us tick) converts without a division.
+        segmentUsPerTick[i] = c.usPerQuarter % ticksPerQuarter == 0 ? c.usPerQuarter / ticksPerQuarter : 0;
+        if (i + 1 < tempoChanges.size())
+            segmentStartUs[i + 1] = segmentStartUs[i] +
+                                    roundDiv((tempoChanges[i + 1].tick - c.tick) * c.usPerQuarter, ticksPerQuarter);
+    }
+}
+
+size_t TempoMap::segmentAt(int64_t tick) const
+{
+    auto it = upper_bound(tempoChanges.begin(), tempoChanges.end(), tick,
+                          [](int64_t t, const TempoChange& c) { return t < c.tick; });
+    return it == tempoChanges.begin() ? 0 : static_cast<size_t>(it - tempoChanges.begin()) - 1;
+}
+
+int64_t TempoMap::tickToUs(int64_t tick) const
+{
+    size_t s = segmentAt(tick);
+    const TempoChange& c = tempoChanges[s];
+    if (segmentUsPerTick[s])
+        return segmentStartUs[s] + (tick - c.tick) * segmentUsPerTick[s];
+    return segmentStartUs[s] + roundDiv((tick - c.tick) * c.usPerQuarter, ticksPerQuarter);
+}
+
+int64_t TempoMap::usToTick(int64_t us) const
+{
+    auto it = upper_bound(segmentStartUs.begin(), segmentStartUs.end(), us);
+    size_t s = it == segmentStartUs.begin() ? 0 : static_cast<size_t>(it - segmentStartUs.begin()) - 1;
+    const TempoChange& c = tempoChanges[s];
+    return c.tick + roundDiv((us - segmentStartUs[s]) * ticksPerQuarter, c.usPerQuarter);
+}
+
+uint32_t TempoMap::usPerQuarterAt(int64_t tick) const
+{
+    return tempoChanges[segmentAt(tick)].usPerQuarter;
+}
+
+TimeSignatureChange TempoMap::timeSignatureAt(int64_t tick) const
+{
+    auto it = upper_bound(signatures.begin(), signatures.end(), tick,
+                          [](int64_t t, const TimeSignatureChange& c) { return t < c.tick; });
+    return it == signatures.begin() ? signatures[0] : *(it - 1);
+}
+
+int64_t TempoMap::barTicks(const TimeSignatureChange& signature) const
+{
+    return int64_t(ticksPerQuarter) * 4 * signature.beats / max<int>(1, signature.beatUnit);
+}
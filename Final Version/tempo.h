@@ -0,0 +1,74 @@
+#pragma once
+#ifndef TEMPO_H
+#define TEMPO_H
+
+// Musical time.
+// Measure and note durations are stored in ticks; the song's tempo track says
+// how long a tick lasts from each point on. TempoMap compiles the track into
+// constant-tempo segments that know their own start time, so converting a
+// tick to a 64-bit microsecond timestamp is a binary search over the
+// segments. Changing the tempo edits a handful of TempoChange entries
+// instead of rewriting every measure and note.
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// 500 ticks per quarter at 120 bpm makes one tick exactly one millisecond, so
+// durations written before the tempo map existed keep their meaning.
+const int TICKS_PER_QUARTER = 500;
+const uint32_t DEFAULT_US_PER_QUARTER = 500000;
+
+struct TempoChange {
+    int64_t tick;
+    uint32_t usPerQuarter;
+};
+
+struct TimeSignatureChange {
+    int64_t tick;
+    uint8_t beats;      // Beats per bar
+    uint8_t beatUnit;   // Note value of one beat (4 = quarter)
+};
+
+// Tempo and meter changes as stored with a song, in any order. Empty lists
+// mean 120 bpm and 4/4 throughout.
+struct TempoTrack {
+    vector<TempoChange> tempos;
+    vector<TimeSignatureChange> timeSignatures;
+};
+
+uint32_t bpmToUsPerQuarter(double bpm);
+double usPerQuarterToBpm(uint32_t usPerQuarter);
+
+// Compiled tempo track. Construction sorts and merges the changes (the later
+// of two changes at the same tick wins) in O(changes log changes).
+class TempoMap {
+public:
+    // ticksPerQuarter lets other resolutions (imported MIDI files) share the map.
+    explicit TempoMap(const TempoTrack& track = TempoTrack(), int ticksPerQuarter = TICKS_PER_QUARTER);
+
+    // Both conversions round to the nearest unit and are O(log segments).
+    int64_t tickToUs(int64_t tick) const;
+    int64_t usToTick(int64_t us) const;
+
+    uint32_t usPerQuarterAt(int64_t tick) const;
+    TimeSignatureChange timeSignatureAt(int64_t tick) const;
+    // Ticks in one bar of the given time signature.
+    int64_t barTicks(const TimeSignatureChange& signature) const;
+
+    // Merged changes; the first of each starts at tick 0.
+    const vector<TempoChange>& tempos() const { return tempoChanges; }
+    const vector<TimeSignatureChange>& timeSignatures() const { return signatures; }
+
+private:
+    size_t segmentAt(int64_t tick) const;
+
+    int ticksPerQuarter;
+    vector<TempoChange> tempoChanges;
+    vector<int64_t> segmentStartUs;   // Start time of each tempoChanges segment
+    vector<int64_t> segmentUsPerTick; // Whole microseconds per tick, 0 if fractional
+    vector<TimeSignatureChange> signatures;
+};
+
+#endif // TEMPO_H
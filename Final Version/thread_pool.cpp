@@ -0,0 +1,97 @@
+// thread_pool.cpp
+// Work-stealing pool: per-worker deques, LIFO for the owner, FIFO for thieves.
+
+#include "thread_pool.h"
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i)
+        queues.push_back(make_unique<WorkQueue>());
+    for (unsigned i = 0; i < threads; ++i)
+        workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    wait();
+    {
+        lock_guard<mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void WorkStealingPool::submit(function<void()> job)
+{
+    pending.fetch_add(1);
+    unsigned index = nextQueue.fetch_add(1) % queues.size();
+    {
+        lock_guard<mutex> guard(queues[index]->lock);
+        queues[index]->jobs.push_back(move(job));
+    }
+    {
+        // Counted under stateLock so a worker about to sleep cannot miss it.
+        lock_guard<mutex> guard(stateLock);
+        ++queued;
+    }
+    workAvailable.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+    unique_lock<mutex> guard(stateLock);
+    allDone.wait(guard, [this] { return pending.load() == 0; });
+}
+
+bool WorkStealingPool::takeJob(unsigned self, function<void()>& job)
+{
+    // Own queue first, newest job (its data is most likely still in cache).
+    {
+        WorkQueue& own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.jobs.empty()) {
+            job = move(own.jobs.back());
+            own.jobs.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    // Then steal the oldest job from the other workers.
+    for (size_t k = 1; k < queues.size(); ++k) {
+        WorkQueue& victim = *queues[(self + k) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.jobs.empty()) {
+            job = move(victim.jobs.front());
+            victim.jobs.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(unsigned self)
+{
+    function<void()> job;
+    while (true) {
+        if (takeJob(self, job)) {
+            job();
+            job = nullptr;
+            if (pending.fetch_sub(1) == 1) {
+                lock_guard<mutex> guard(stateLock);
+                allDone.notify_all();
+            }
+            continue;
+        }
+        unique_lock<mutex> guard(stateLock);
+        workAvailable.wait(guard, [this] { return stopping || queued.load() > 0; });
+        if (stopping)
+            return;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Work-stealing thread pool for coarse, independent jobs (one file, one song).
+// Each worker owns a deque: it takes its own newest job first and, when it
+// runs dry, steals the oldest job from another worker. Jobs that finish fast
+// therefore never leave a core idle while another still has a backlog.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class WorkStealingPool {
+public:
+    // threads = 0 uses all hardware threads.
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Queues a job. Jobs are dealt round-robin to the workers' deques.
+    void submit(function<void()> job);
+    // Blocks until every submitted job has finished.
+    void wait();
+
+    unsigned threadCount() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<function<void()>> jobs;
+    };
+
+    bool takeJob(unsigned self, function<void()>& job);
+    void workerLoop(unsigned self);
+
+    vector<unique_ptr<WorkQueue>> queues;
+    vector<thread> workers;
+    atomic<unsigned> nextQueue{0};
+    atomic<size_t> pending{0};   // Submitted but not yet finished
+    atomic<size_t> queued{0};    // Submitted but not yet taken by a worker
+    bool stopping = false;
+    mutex stateLock;
+    condition_variable workAvailable;
+    condition_variable allDone;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,193 @@
+// timeline.cpp
+// Song -> flat sorted event array.
+
+#include "timeline.h"
+
+#include <algorithm>
+
+using namespace std;
+
+Timeline compileTimeline(const vector<MusicSection>& sections, const NoteArena& notes, const TempoTrack& tempo,
+                         const Arrangement& arrangement)
+{
+    Timeline timeline;
+    timeline.tempo = TempoMap(tempo);
+    const TempoMap& tempoMap = timeline.tempo;
+    timeline.partSections = arrangementOrder(arrangement, sections.size());
+    const vector<uint32_t>& parts = timeline.partSections;
+
+    size_t noteCount = 0, measureCount = 0;
+    for (uint32_t s : parts) {
+        measureCount += sections[s].measures.size();
+        for (const auto& measure : sections[s].measures)
+            noteCount += measure.notes.count;
+    }
+    timeline.events.reserve(noteCount * 2 + measureCount);
+    timeline.measures.reserve(measureCount);
+    timeline.partFirstMeasure.reserve(parts.size() + 1);
+    timeline.partPrograms.reserve(parts.size() * 16);
+
+    int lastProgram[16];
+    fill(lastProgram, lastProgram + 16, -1);
+    const PitchId* pitches = notes.pitch();
+    const uint8_t* velocities = notes.velocity();
+    const uint8_t* channels = notes.channel();
+    const uint8_t* instruments = notes.instrument();
+    const int32_t* onsets = notes.onset();
+    const int32_t* durations = notes.duration();
+    vector<uint32_t> order;   // One measure's rows, by onset
+
+    int64_t startTick = 0;
+    for (size_t p = 0; p < parts.size(); ++p) {
+        const uint32_t s = parts[p];
+        timeline.partFirstMeasure.push_back(timeline.measures.size());
+        for (int ch = 0; ch < 16; ++ch)
+            timeline.partPrograms.push_back(static_cast<int8_t>(lastProgram[ch] < 0 ? -1 : lastProgram[ch] & 0x7F));
+        const auto& measures = sections[s].measures;
+        // Notes may sustain past their measure but are released by the end of the part.
+        int64_t sectionEndTick = startTick;
+        for (const auto& measure : measures)
+            sectionEndTick += max(0, measure.duration);
+        const int64_t sectionEndUs = tempoMap.tickToUs(sectionEndTick);
+        for (size_t m = 0; m < measures.size(); ++m) {
+            const Measure& measure = measures[m];
+            const int64_t endTick = startTick + max(0, measure.duration);
+            const int64_t startUs = tempoMap.tickToUs(startTick);
+            const int64_t durationUs = tempoMap.tickToUs(endTick) - startUs;
+            uint32_t index = static_cast<uint32_t>(timeline.measures.size());
+            timeline.measures.push_back({s, static_cast<uint32_t>(m), startUs, durationUs, static_cast<uint32_t>(p)});
+            timeline.events.push_back({startUs, index, EVENT_MEASURE_START, 0, 0, 0});
+
+            // The measure's notes are one run of rows in each column. A note
+            // starts inside its measure: onsets are clamped to its last tick.
+            // Rows are visited in onset order so that a program change lands
+            // just before the first note that needs it.
+            const int32_t lastOnset = max(0, measure.duration - 1);
+            auto onsetOf = [&](uint32_t row) { return min(max(0, onsets[row]), lastOnset); };
+            order.clear();
+            for (uint32_t row = measure.notes.first; row < measure.notes.end(); ++row)
+                order.push_back(row);
+            auto byOnset = [&](uint32_t a, uint32_t b) { return onsetOf(a) < onsetOf(b); };
+            if (!is_sorted(order.begin(), order.end(), byOnset))
+                stable_sort(order.begin(), order.end(), byOnset);
+            for (uint32_t row : order) {
+                uint8_t channel = static_cast<uint8_t>(channels[row] & 0x0F);
+                uint8_t key = static_cast<uint8_t>(pitches[row] & 0x7F);
+                const int64_t onTick = startTick + onsetOf(row);
+                const int64_t onUs = tempoMap.tickToUs(onTick);
+                // Nothing of a note that starts as its part ends can sound.
+                if (onUs >= sectionEndUs)
+                    continue;
+                if (lastProgram[channel] != instruments[row]) {
+                    lastProgram[channel] = instruments[row];
+                    timeline.events.push_back({onUs, index, EVENT_PROGRAM_CHANGE, channel,
+                                               static_cast<uint8_t>(instruments[row] & 0x7F), 0});
+                }
+                timeline.events.push_back({onUs, index, EVENT_NOTE_ON, channel, key,
+                                           static_cast<uint8_t>(min<int>(127, velocities[row]))});
+                int64_t offUs = durations[row] > 0 ? tempoMap.tickToUs(onTick + durations[row]) : startUs + durationUs;
+                // Offs sort before ons at the same time, so a note that would
+                // end as it starts (zero-length measure, rounding) is held 1 us.
+                offUs = max(min(offUs, sectionEndUs), onUs + 1);
+                timeline.events.push_back({offUs, index, EVENT_NOTE_OFF, channel, key, 0});
+            }
+            startTick = endTick;
+        }
+    }
+    timeline.partFirstMeasure.push_back(timeline.measures.size());
+    timeline.lengthUs = tempoMap.tickToUs(startTick);
+
+    // Events are generated almost in order (only note-offs land later), so a
+    // stable sort keeps generation order for equal keys.
+    stable_sort(timeline.events.begin(), timeline.events.end(),
+                [](const TimelineEvent& a, const TimelineEvent& b) {
+                    if (a.timeUs != b.timeUs)
+                        return a.timeUs < b.timeUs;
+                    return a.type < b.type;
+                });
+    return timeline;
+}
+
+size_t findEventAt(const Timeline& timeline, int64_t timeUs)
+{
+    auto it = lower_bound(timeline.events.begin(), timeline.events.end(), timeUs,
+                          [](const TimelineEvent& e, int64_t t) { return e.timeUs < t; });
+    return static_cast<size_t>(it - timeline.events.begin());
+}
+
+size_t findMeasureAt(const Timeline& timeline, int64_t timeUs)
+{
+    auto it = upper_bound(timeline.measures.begin(), timeline.measures.end(), timeUs,
+                          [](int64_t t, const TimelineMeasure& m) { return t < m.startUs; });
+    return it == timeline.measures.begin() ? 0 : static_cast<size_t>(it - timeline.measures.begin()) - 1;
+}
+
+void seekTimeline(const Timeline& timeline, int64_t timeUs, TimelineSeek& seek)
+{
+    const auto& events = timeline.events;
+    seek.held.clear();
+    fill(seek.programs, seek.programs + 16, static_cast<int8_t>(-1));
+    size_t end = findEventAt(timeline, timeUs);
+    while (end < events.size() && events[end].timeUs == timeUs && events[end].type == EVENT_NOTE_OFF)
+        ++end;
+    seek.event = end;
+    if (timeline.measures.empty())
+        return;
+
+    size_t part = timeline.measures[findMeasureAt(timeline, timeUs)].part;
+    copy(timeline.partPrograms.begin() + part * 16, timeline.partPrograms.begin() + part * 16 + 16, seek.programs);
+    size_t sectionStart = findEventAt(timeline, timeline.measures[timeline.partFirstMeasure[part]].startUs);
+
+    // Replay the part so far: the latest note-on per key, unless released.
+    int32_t heldAt[16 * 128];
+    fill(heldAt, heldAt + 16 * 128, -1);
+    for (size_t i = sectionStart; i < end; ++i) {
+        const TimelineEvent& ev = events[i];
+        int slot = (ev.channel & 0x0F) * 128 + (ev.data1 & 0x7F);
+        if (ev.type == EVENT_NOTE_ON)
+            heldAt[slot] = static_cast<int32_t>(i);
+        else if (ev.type == EVENT_NOTE_OFF)
+            heldAt[slot] = -1;
+        else if (ev.type == EVENT_PROGRAM_CHANGE)
+            seek.programs[ev.channel & 0x0F] = static_cast<int8_t>(ev.data1 & 0x7F);
+    }
+    for (size_t i = sectionStart; i < end; ++i) {
+        const TimelineEvent& ev = events[i];
+        if (ev.type == EVENT_NOTE_ON && heldAt[(ev.channel & 0x0F) * 128 + (ev.data1 & 0x7F)] == static_cast<int32_t>(i))
+            seek.held.push_back(ev);
+    }
+}
+
+size_t findSectionPart(const Timeline& timeline, size_t sectionIndex)
+{
+    for (size_t p = 0; p < timeline.partSections.size(); ++p) {
+        if (timeline.partSections[p] == sectionIndex)
+            return p;
+    }
+    return SIZE_MAX;
+}
+
+void partEventRange(const Timeline& timeline, size_t part, size_t& first, size_t& last)
+{
+    first = last = 0;
+    if (part + 1 >= timeline.partFirstMeasure.size())
+        return;
+    size_t firstMeasure = timeline.partFirstMeasure[part];
+    size_t endMeasure = timeline.partFirstMeasure[part + 1];
+    if (firstMeasure == endMeasure)
+        return;
+
+    int64_t startUs = timeline.measures[firstMeasure].startUs;
+    int64_t endUs = timeline.measures[endMeasure - 1].startUs + timeline.measures[endMeasure - 1].durationUs;
+    first = findEventAt(timeline, startUs);
+    // The part's last note-offs share endUs with the next part's first events;
+    // include only the events that belong to this part's measures.
+    last = findEventAt(timeline, endUs);
+    while (last < timeline.events.size() && timeline.events[last].timeUs == endUs &&
+           timeline.events[last].type == EVENT_NOTE_OFF && timeline.events[last].measure < endMeasure)
+        ++last;
+    // Drop note-offs of the previous part that share our start time.
+    while (first < last && timeline.events[first].type == EVENT_NOTE_OFF &&
+           timeline.events[first].measure < firstMeasure)
+        ++first;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+// Compiled, flat view of a song.
+// compileTimeline() walks sections -> measures -> notes once and produces a
+// single array of time-stamped events sorted by time. Playback, offline
+// rendering and export all read this array instead of re-walking the tree.
+// Durations in the song are ticks; the song's tempo map turns them into
+// absolute 64-bit microsecond times here, once. The arrangement decides the
+// order of the parts; a section played several times is read from the same
+// measures each time.
+
+#include <cstdint>
+
+#include "arrangement.h"
+#include "note_arena.h"
+#include "song.h"
+#include "tempo.h"
+
+// Event kinds, in the order they are processed when they share a timestamp:
+// releases first so repeated notes retrigger, then program changes so the
+// following note-ons use the new instrument, then the measure marker.
+enum TimelineEventType {
+    EVENT_NOTE_OFF = 0,
+    EVENT_PROGRAM_CHANGE = 1,
+    EVENT_NOTE_ON = 2,
+    EVENT_MEASURE_START = 3
+};
+
+// One entry of the compiled timeline (16 bytes).
+struct TimelineEvent {
+    int64_t timeUs;     // Absolute time from the start of the song
+    uint32_t measure;   // Index into Timeline::measures
+    uint8_t type;       // TimelineEventType
+    uint8_t channel;
+    uint8_t data1;      // Note number or program
+    uint8_t data2;      // Velocity
+};
+
+// Location and timing of one measure in the compiled song.
+struct TimelineMeasure {
+    uint32_t section;   // Index into the source section list
+    uint32_t measure;   // Index within that section
+    int64_t startUs;
+    int64_t durationUs;
+    uint32_t part;      // Index into Timeline::partSections
+};
+
+struct Timeline {
+    vector<TimelineEvent> events;
+    vector<TimelineMeasure> measures;
+    // A part is one pass over a section in play order.
+    vector<uint32_t> partSections;        // Source section of each part
+    vector<size_t> partFirstMeasure;      // First Timeline::measures index per part, plus an end entry
+    // 16 entries per part: the program each channel has when the part starts
+    // (-1 if none yet), so a seek never scans earlier parts.
+    vector<int8_t> partPrograms;
+    int64_t lengthUs = 0;
+    TempoMap tempo;                       // The map the times were computed with
+};
+
+// What playback needs to start in the middle of the timeline.
+struct TimelineSeek {
+    size_t event = 0;              // First event still to send
+    int8_t programs[16];           // Program per channel at that time, -1 if none
+    vector<TimelineEvent> held;    // Note-ons still sounding at that time, in start order
+};
+
+// Flattens the arranged sections into a sorted event array. Program changes
+// are emitted whenever a channel's instrument differs from the previous note
+// on it. Each note is released after its own duration (the measure's if
+// unset), but never later than the end of its part; notes with an onset
+// start that far into their measure. Note data is read from the columns of
+// notes. Tick positions are converted through tempo.
+Timeline compileTimeline(const vector<MusicSection>& sections, const NoteArena& notes,
+                         const TempoTrack& tempo = TempoTrack(), const Arrangement& arrangement = Arrangement());
+
+// Index of the first event at or after timeUs (binary search).
+size_t findEventAt(const Timeline& timeline, int64_t timeUs);
+
+// Measure playing at timeUs: the last one starting at or before it. Measure
+// start times are running sums of the durations, so this is a binary search.
+size_t findMeasureAt(const Timeline& timeline, int64_t timeUs);
+
+// Fills seek for starting playback at timeUs. Cost is O(log n) plus the events
+// of the current part up to timeUs (notes never outlive their part).
+// Note-offs at exactly timeUs are treated as already sent.
+void seekTimeline(const Timeline& timeline, int64_t timeUs, TimelineSeek& seek);
+
+// First part that plays the section, or SIZE_MAX if the arrangement skips it.
+size_t findSectionPart(const Timeline& timeline, size_t sectionIndex);
+
+// Half-open event range [first, last) covering all measures of one part.
+void partEventRange(const Timeline& timeline, size_t part, size_t& first, size_t& last);
+
+#endif // TIMELINE_H
@@ -0,0 +1,267 @@
+// transport.cpp
+// Playback thread and command handling for Transport.
+
+#include "transport.h"
+
+#include <algorithm>
+
+using namespace std;
+
+Transport::Transport(EventSink& sinkRef, function<void(const TimelineEvent&)> onMeasureFn)
+    : sink(sinkRef), onMeasure(move(onMeasureFn))
+{
+    worker = thread(&Transport::run, this);
+}
+
+Transport::~Transport()
+{
+    quitting.store(true);
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    worker.join();
+}
+
+// ===== Control thread =====
+
+bool Transport::send(const TransportCommand& command)
+{
+    if (!commands.tryPush(command))
+        return false;
+    ++issued;
+    // Only pay for the mutex when the playback thread is idle; a playing
+    // thread sees the command at its next poll. The fence pairs with the one
+    // in run(): the queue's release store and the flag load must not be
+    // reordered, or both sides could miss each other.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (threadWaiting.load()) {
+        lock_guard<mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    return true;
+}
+
+bool Transport::play(const Timeline& timelineRef, size_t first, size_t lastEvent)
+{
+    return send({TRANSPORT_PLAY, 0, &timelineRef, first, lastEvent});
+}
+
+bool Transport::pause()
+{
+    return send({TRANSPORT_PAUSE, 0, nullptr, 0, 0});
+}
+
+bool Transport::resume()
+{
+    return send({TRANSPORT_RESUME, 0, nullptr, 0, 0});
+}
+
+bool Transport::stop()
+{
+    return send({TRANSPORT_STOP, 0, nullptr, 0, 0});
+}
+
+bool Transport::seek(int64_t offsetUs)
+{
+    return send({TRANSPORT_SEEK, offsetUs, nullptr, 0, 0});
+}
+
+bool Transport::setTempo(int percent)
+{
+    return send({TRANSPORT_TEMPO, percent, nullptr, 0, 0});
+}
+
+bool Transport::busy() const
+{
+    // apply() publishes the new state before counting the command as applied.
+    return applied.load(memory_order_acquire) != issued || state() != TRANSPORT_STOPPED;
+}
+
+// ===== Playback thread =====
+
+void Transport::run()
+{
+    TransportCommand command;
+    while (true) {
+        while (commands.tryPop(command)) {
+            apply(command);
+            applied.fetch_add(1, memory_order_release);
+        }
+        if (quitting.load()) {
+            if (timeline)
+                silence();
+            timeline = nullptr;
+            publishState(TRANSPORT_STOPPED);
+            return;
+        }
+
+        if (state() == TRANSPORT_PLAYING) {
+            const TimelineEvent& ev = timeline->events[next];
+            int64_t songUs = ev.timeUs - baseUs;
+            bool due = sleepUntil(clock.deadline(clockOffset(songUs)), TRANSPORT_BLOCK,
+                                  [this] { return !commands.empty() || quitting.load(); });
+            if (!due)
+                continue;   // Handle the command first; the event is still pending
+            dispatch(ev);
+            position.store(songUs, memory_order_release);
+            if (++next == last) {
+                silence();
+                timeline = nullptr;
+                publishState(TRANSPORT_STOPPED);
+            }
+            continue;
+        }
+
+        // Stopped or paused: nothing to do until a command arrives.
+        unique_lock<mutex> lock(wakeMutex);
+        threadWaiting.store(true);
+        atomic_thread_fence(memory_order_seq_cst);
+        // Re-check after publishing threadWaiting: either the producer sees the
+        // flag and notifies under the lock, or we see its command here.
+        wake.wait(lock, [this] { return quitting.load() || !commands.empty(); });
+        threadWaiting.store(false);
+    }
+}
+
+void Transport::apply(const TransportCommand& command)
+{
+    const TransportState current = state();
+    switch (command.type) {
+        case TRANSPORT_PLAY:
+            if (timeline)
+                silence();
+            timeline = command.timeline;
+            next = command.first;
+            last = min(command.last, timeline->events.size());
+            if (next >= last) {
+                timeline = nullptr;
+                publishState(TRANSPORT_STOPPED);
+                break;
+            }
+            baseUs = timeline->events[next].timeUs;
+            rangeFirst = next;
+            position.store(0, memory_order_release);
+            anchor(0);
+            publishState(TRANSPORT_PLAYING);
+            break;
+
+        case TRANSPORT_PAUSE:
+            if (current != TRANSPORT_PLAYING)
+                break;
+            pausedAtUs = currentSongUs();
+            position.store(pausedAtUs, memory_order_release);
+            silence();
+            publishState(TRANSPORT_PAUSED);
+            break;
+
+        case TRANSPORT_RESUME:
+            if (current != TRANSPORT_PAUSED)
+                break;
+            jumpTo(pausedAtUs, true);
+            anchor(pausedAtUs);
+            publishState(TRANSPORT_PLAYING);
+            break;
+
+        case TRANSPORT_STOP:
+            if (timeline)
+                silence();
+            timeline = nullptr;
+            publishState(TRANSPORT_STOPPED);
+            break;
+
+        case TRANSPORT_SEEK: {
+            if (!timeline)
+                break;
+            int64_t rangeUs = timeline->events[last - 1].timeUs - baseUs;
+            int64_t target = max<int64_t>(0, min(command.value, rangeUs));
+            silence();
+            // A paused transport re-strikes held notes when it resumes.
+            jumpTo(target, current == TRANSPORT_PLAYING);
+            position.store(target, memory_order_release);
+            if (current == TRANSPORT_PAUSED)
+                pausedAtUs = target;
+            else
+                anchor(target);
+            break;
+        }
+
+        case TRANSPORT_TEMPO: {
+            int percent = static_cast<int>(max<int64_t>(10, min<int64_t>(400, command.value)));
+            // Re-anchor at the current position so the change applies from now on.
+            int64_t now = (current == TRANSPORT_PLAYING) ? currentSongUs() : 0;
+            tempo.store(percent, memory_order_release);
+            if (current == TRANSPORT_PLAYING)
+                anchor(now);
+            break;
+        }
+    }
+}
+
+void Transport::dispatch(const TimelineEvent& ev)
+{
+    switch (ev.type) {
+        case EVENT_NOTE_ON:
+        case EVENT_NOTE_OFF: {
+            MidiEvent message = (ev.type == EVENT_NOTE_ON) ? noteOnEvent(ev.channel, ev.data1, ev.data2)
+                                                           : noteOffEvent(ev.channel, ev.data1);
+            sounding.track(message);
+            sink.send(message);
+            break;
+        }
+        case EVENT_PROGRAM_CHANGE:
+            sink.send(programChangeEvent(ev.channel, ev.data1));
+            break;
+        case EVENT_MEASURE_START:
+            if (onMeasure)
+                onMeasure(ev);
+            break;
+    }
+}
+
+void Transport::silence()
+{
+    sounding.releaseAll(sink);
+}
+
+void Transport::jumpTo(int64_t songUs, bool strike)
+{
+    seekTimeline(*timeline, baseUs + songUs, seekState);
+    next = min(max(seekState.event, rangeFirst), last - 1);
+    for (int ch = 0; ch < 16; ++ch) {
+        if (seekState.programs[ch] >= 0)
+            sink.send(programChangeEvent(ch, seekState.programs[ch]));
+    }
+    if (!strike)
+        return;
+    for (const TimelineEvent& ev : seekState.held) {
+        // Held notes from before the range (a section played on its own) stay silent.
+        if (ev.timeUs >= baseUs)
+            dispatch(ev);
+    }
+}
+
+int64_t Transport::clockOffset(int64_t songUs) const
+{
+    return (songUs - anchorSongUs) * 100 / tempo.load(memory_order_relaxed);
+}
+
+int64_t Transport::currentSongUs() const
+{
+    int64_t songUs = anchorSongUs + clock.nowUs() * tempo.load(memory_order_relaxed) / 100;
+    // The next event has not been sent yet, so the playhead cannot be past it.
+    if (timeline && next < last)
+        songUs = min(songUs, timeline->events[next].timeUs - baseUs);
+    return max(songUs, position.load(memory_order_relaxed));
+}
+
+void Transport::anchor(int64_t songUs)
+{
+    anchorSongUs = songUs;
+    clock.start(0);
+}
+
+void Transport::publishState(TransportState s)
+{
+    published.store(s, memory_order_release);
+}
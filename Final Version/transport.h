@@ -0,0 +1,126 @@
+#pragma once
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+// Playback transport.
+// A dedicated thread plays a range of the compiled timeline to an EventSink.
+// The control thread (the UI) never touches playback state directly: it
+// pushes commands into a lock-free queue and reads the published state from
+// atomics. While waiting for the next event the playback thread checks the
+// queue at least every TRANSPORT_BLOCK, so a pause or stop takes effect
+// within one audio block instead of at the end of a measure, and only the
+// notes that are actually sounding are released. A pause keeps the exact
+// playhead; resume and seek restore each channel's program and re-strike the
+// notes held across the new position, so playback continues mid-measure.
+//
+// Only one thread may issue commands. The sink is only written by the
+// playback thread while the transport exists.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "output.h"
+#include "ring_buffer.h"
+#include "scheduler.h"
+#include "timeline.h"
+
+using namespace std;
+
+// One 256-frame block at 44.1 kHz.
+const chrono::microseconds TRANSPORT_BLOCK(5800);
+
+enum TransportState { TRANSPORT_STOPPED, TRANSPORT_PLAYING, TRANSPORT_PAUSED };
+
+enum TransportCommandType {
+    TRANSPORT_PLAY,
+    TRANSPORT_PAUSE,
+    TRANSPORT_RESUME,
+    TRANSPORT_STOP,
+    TRANSPORT_SEEK,
+    TRANSPORT_TEMPO
+};
+
+struct TransportCommand {
+    TransportCommandType type;
+    int64_t value;                // SEEK: offset in us; TEMPO: percent
+    const Timeline* timeline;     // PLAY only
+    size_t first, last;           // PLAY only: event range
+};
+
+class Transport {
+public:
+    // onMeasure receives EVENT_MEASURE_START events on the playback thread.
+    Transport(EventSink& sink, function<void(const TimelineEvent&)> onMeasure);
+    // Stops playback (silencing the sink) and joins the thread.
+    ~Transport();
+    Transport(const Transport&) = delete;
+    Transport& operator=(const Transport&) = delete;
+
+    // Commands. Each returns false if the queue is full.
+    // The timeline must stay alive and unchanged until playback stops.
+    bool play(const Timeline& timeline, size_t first, size_t last);
+    bool pause();
+    bool resume();
+    bool stop();
+    // Moves the playhead to offsetUs from the start of the range.
+    bool seek(int64_t offsetUs);
+    // Playback speed in percent of the written tempo (10..400).
+    bool setTempo(int percent);
+
+    TransportState state() const { return static_cast<TransportState>(published.load(memory_order_acquire)); }
+    // Playhead, in microseconds from the start of the range.
+    int64_t positionUs() const { return position.load(memory_order_acquire); }
+    int tempoPercent() const { return tempo.load(memory_order_acquire); }
+    // True while commands are pending or a range is playing or paused.
+    bool busy() const;
+
+private:
+    bool send(const TransportCommand& command);
+    void run();
+    void apply(const TransportCommand& command);
+    void dispatch(const TimelineEvent& event);
+    void silence();
+    // Moves the playhead to songUs and restores the channel programs; with
+    // strike, also re-sounds the notes held across that point.
+    void jumpTo(int64_t songUs, bool strike);
+    // Clock time (us since the last anchor) at which song offset songUs is due.
+    int64_t clockOffset(int64_t songUs) const;
+    int64_t currentSongUs() const;
+    void anchor(int64_t songUs);
+    void publishState(TransportState s);
+
+    EventSink& sink;
+    function<void(const TimelineEvent&)> onMeasure;
+
+    SPSCRingBuffer<TransportCommand, 64> commands;
+    uint64_t issued = 0;                 // Control thread only
+    atomic<uint64_t> applied{0};
+    atomic<int> published{TRANSPORT_STOPPED};
+    atomic<int64_t> position{0};
+    atomic<int> tempo{100};
+
+    // Wake-up for an idle (stopped or paused) playback thread.
+    mutex wakeMutex;
+    condition_variable wake;
+    atomic<bool> threadWaiting{false};
+    atomic<bool> quitting{false};
+
+    // Playback thread only
+    const Timeline* timeline = nullptr;
+    size_t rangeFirst = 0, next = 0, last = 0;
+    int64_t baseUs = 0;                  // Timeline time of the range start
+    int64_t anchorSongUs = 0;            // Song offset where the clock was last started
+    int64_t pausedAtUs = 0;
+    PlaybackClock clock;
+    ActiveNotes sounding;                // Notes this transport has left on
+    TimelineSeek seekState;              // Reused by jumpTo()
+
+    thread worker;
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,62 @@
+// voice_pool.cpp
+// Slot bookkeeping for the synth's preallocated voices.
+
+#include "voice_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+VoicePool::VoicePool(int polyphony)
+    : slots(max(1, polyphony)), keyTable(16 * 128, NO_VOICE)
+{
+    freeSlots.reserve(slots.size());
+    active.reserve(slots.size());
+    // Hand out low slots first so small songs touch little memory.
+    for (int i = static_cast<int>(slots.size()) - 1; i >= 0; --i)
+        freeSlots.push_back(i);
+}
+
+int VoicePool::claim(int channel, int note)
+{
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    int key = keyOf(channel, note);
+    // A retriggered key releases its previous voice, which then fades out.
+    if (keyTable[key] != NO_VOICE)
+        release(keyTable[key]);
+    keyTable[key] = slot;
+
+    Slot& s = slots[slot];
+    s.key = static_cast<int16_t>(key);
+    s.released = false;
+    s.serial = nextSerial++;
+    s.activeIndex = static_cast<int32_t>(active.size());
+    active.push_back(slot);
+    return slot;
+}
+
+void VoicePool::release(int slot)
+{
+    Slot& s = slots[slot];
+    if (s.key >= 0 && keyTable[s.key] == slot)
+        keyTable[s.key] = NO_VOICE;
+    s.key = -1;
+    s.released = true;
+}
+
+void VoicePool::retire(int slot)
+{
+    Slot& s = slots[slot];
+    if (s.activeIndex < 0)
+        return;
+    release(slot);
+
+    int last = active.back();
+    active[s.activeIndex] = last;
+    slots[last].activeIndex = s.activeIndex;
+    active.pop_back();
+    s.activeIndex = -1;
+    freeSlots.push_back(slot);
+}
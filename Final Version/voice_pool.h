@@ -0,0 +1,96 @@
+#pragma once
+#ifndef VOICE_POOL_H
+#define VOICE_POOL_H
+
+// Fixed-size voice allocator for the software synth.
+// All storage is allocated up front for the configured polyphony, so note-on,
+// note-off and voice retirement never touch the heap. The pool only manages
+// slot numbers; the synth keeps its per-voice DSP state in a parallel array.
+//
+//   held(channel, note)   O(1) via a 16 x 128 key table
+//   allocate / retire     O(1) free list and swap-remove active list
+//   steal (pool full)     O(polyphony) scan, only when every slot is busy:
+//                         released voices first, then the quietest, then the oldest
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class VoicePool {
+public:
+    static constexpr int NO_VOICE = -1;
+
+    explicit VoicePool(int polyphony);
+
+    int polyphony() const { return static_cast<int>(slots.size()); }
+    size_t activeCount() const { return active.size(); }
+    int activeSlot(size_t index) const { return active[index]; }
+
+    // Slot currently holding (channel, note) down, or NO_VOICE. Released
+    // voices that are still fading out are not returned.
+    int held(int channel, int note) const { return keyTable[keyOf(channel, note)]; }
+
+    // Returns a slot for a new note on (channel, note), stealing one if the
+    // pool is full. loudness(slot) must return the voice's current output
+    // level; it is only called while stealing. stolen reports whether the
+    // returned slot interrupted another voice.
+    template <typename Loudness>
+    int allocate(int channel, int note, Loudness loudness, bool& stolen);
+
+    // Marks a slot's note as released; it keeps sounding until retire().
+    void release(int slot);
+    // Returns a finished slot to the free list. Invalidates activeSlot() indices
+    // at or after this slot's position (the last active slot moves into it).
+    void retire(int slot);
+
+private:
+    struct Slot {
+        int16_t key = -1;        // channel * 128 + note while held, else -1
+        bool released = false;
+        int32_t activeIndex = -1;
+        uint64_t serial = 0;     // Start order, for oldest-first stealing
+    };
+
+    static int keyOf(int channel, int note) { return ((channel & 0x0F) << 7) | (note & 0x7F); }
+    int claim(int channel, int note);
+
+    vector<Slot> slots;
+    vector<int> freeSlots;
+    vector<int> active;
+    vector<int> keyTable;   // 16 * 128 entries
+    uint64_t nextSerial = 0;
+};
+
+template <typename Loudness>
+int VoicePool::allocate(int channel, int note, Loudness loudness, bool& stolen)
+{
+    stolen = freeSlots.empty();
+    if (!stolen)
+        return claim(channel, note);
+
+    int victim = active[0];
+    bool victimReleased = slots[victim].released;
+    float victimLevel = loudness(victim);
+    for (size_t i = 1; i < active.size(); ++i) {
+        int slot = active[i];
+        bool released = slots[slot].released;
+        float level = loudness(slot);
+        bool better;
+        if (released != victimReleased)
+            better = released;
+        else if (level != victimLevel)
+            better = level < victimLevel;
+        else
+            better = slots[slot].serial < slots[victim].serial;
+        if (better) {
+            victim = slot;
+            victimReleased = released;
+            victimLevel = level;
+        }
+    }
+    retire(victim);
+    return claim(channel, note);
+}
+
+#endif // VOICE_POOL_H